@@ -0,0 +1,370 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Benchmark of the regex engines over synthetic corpora, see `make bench-regex`.
+ * Writes one tab separated row per corpus, expression and engine: compile
+ * time, matches, MB/s and matches/s. GRegex (PCRE) is the baseline.
+ *
+ * Usage: bench_regex [MiB per corpus, default 4] [output file, default stdout]
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib-2.0/glib.h>
+
+#include <nativeextractor/common.h>
+#include <nativeextractor/dfa_miner.h>
+#include <nativeextractor/extractor.h>
+#include <nativeextractor/regex_generator.h>
+#include <nativeextractor/shift_and_miner.h>
+#include <nativeextractor/stream.h>
+
+/** Expressions run by every engine, in the syntax of both regex_compile and GRegex. */
+static const char *exprs[] = {
+  "error",
+  "(?i)failed password",
+  "[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}",
+  "[0-9]{4}-[0-9]{2}-[0-9]{2}",
+  "[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+",
+  "https?://[a-z0-9./]+",
+  "[a-zá-ž]+ský",
+  "\\w+",
+};
+
+#define EXPRS_COUNT (sizeof(exprs) / sizeof(exprs[0]))
+
+static const char *english[] = {
+  "the", "of", "and", "to", "in", "is", "was", "that", "for", "it", "with",
+  "as", "his", "on", "be", "at", "by", "had", "are", "but", "from", "or",
+  "have", "an", "they", "which", "one", "you", "were", "all", "we", "when",
+  "there", "can", "been", "has", "more", "if", "no", "out", "so", "said",
+  "what", "up", "its", "about", "than", "into", "them", "only", "other",
+  "new", "some", "could", "time", "these", "two", "may", "first", "then",
+  "error", "server", "failed", "report", "market", "river", "history",
+};
+
+static const char *czech[] = {
+  "příliš", "žluťoučký", "kůň", "úpěl", "ďábelské", "ódy", "město", "Praha",
+  "čeština", "řeka", "hrad", "národní", "český", "moravský", "slezský",
+  "zámek", "ulice", "náměstí", "škola", "učitel", "dítě", "večer", "ráno",
+  "léto", "zima", "jaro", "podzim", "strom", "les", "pole", "voda", "oheň",
+  "a", "v", "na", "se", "že", "je", "to", "s", "z", "do", "ale", "jako",
+};
+
+/** Xorshift generator, the corpora are the same for the same seed. */
+static uint32_t bench_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return (*state = x);
+}
+
+static void corpus_words(GString *out, size_t size, uint32_t *seed,
+  const char **words, size_t words_count) {
+  while (out->len < size) {
+    size_t length = 4 + bench_random(seed) % 16;
+    for (size_t i = 0; i < length; ++i) {
+      const char *word = words[bench_random(seed) % words_count];
+      if (i == 0) {
+        // Capitalized first word, as ASCII only
+        g_string_append_c(out, (char)toupper((unsigned char)*word));
+        g_string_append(out, word + 1);
+      } else {
+        g_string_append_c(out, ' ');
+        g_string_append(out, word);
+      }
+      if (bench_random(seed) % 50 == 0) {
+        g_string_append_printf(out, " %u", bench_random(seed) % 10000);
+      }
+    }
+    g_string_append(out, (bench_random(seed) % 8 == 0) ? ".\n" : ". ");
+  }
+}
+
+static void corpus_logs(GString *out, size_t size, uint32_t *seed) {
+  static const char *levels[] = { "INFO", "WARN", "error", "DEBUG" };
+  while (out->len < size) {
+    uint32_t r = bench_random(seed);
+    g_string_append_printf(out, "2026-%02u-%02u %02u:%02u:%02u host%u %s ",
+      1 + r % 12, 1 + (r >> 4) % 28, (r >> 9) % 24, (r >> 14) % 60, (r >> 20) % 60,
+      (r >> 26) % 8, levels[bench_random(seed) % 4]);
+    switch (bench_random(seed) % 4) {
+      case 0:
+        g_string_append_printf(out, "sshd[%u]: Failed password for user%u from 10.%u.%u.%u port %u\n",
+          bench_random(seed) % 65536, bench_random(seed) % 1000, bench_random(seed) % 256,
+          bench_random(seed) % 256, bench_random(seed) % 256, bench_random(seed) % 65536);
+        break;
+      case 1:
+        g_string_append_printf(out, "mail: delivered to user%u@example.cz in %u ms\n",
+          bench_random(seed) % 1000, bench_random(seed) % 5000);
+        break;
+      case 2:
+        g_string_append_printf(out, "GET https://www.example.cz/page/%u.html 200 %u\n",
+          bench_random(seed) % 1000, bench_random(seed) % 100000);
+        break;
+      default:
+        corpus_words(out, out->len + 40, seed, english, sizeof(english) / sizeof(english[0]));
+        break;
+    }
+  }
+}
+
+/** Random bytes, valid UTF-8 so that every engine reads the same characters. */
+static void corpus_noise(GString *out, size_t size, uint32_t *seed) {
+  static const char *letters[] = { "č", "ř", "ž", "á", "ů", "€", "→" };
+  while (out->len < size) {
+    uint32_t r = bench_random(seed);
+    if (r % 16 == 0) {
+      g_string_append(out, letters[(r >> 8) % 7]);
+    } else {
+      g_string_append_c(out, (char)(1 + (r >> 8) % 127));
+    }
+  }
+}
+
+typedef struct bench_corpus_t {
+  const char *name;
+  GString *text;
+} bench_corpus_t;
+
+/**
+ * Runs miners added by `add` over a corpus.
+ *
+ * @return Number of occurrences, the time is stored to `seconds`.
+ */
+static size_t bench_run(const bench_corpus_t *corpus, bool (*add)(extractor_c *, void *),
+  void *data, double *seconds) {
+  miner_c **miners = calloc(1, sizeof(miner_c *));
+  extractor_c *e = extractor_c_new(1, miners);
+  size_t count = 0;
+
+  if (add(e, data)) {
+    stream_buffer_c *s = stream_buffer_c_new((const uint8_t *)corpus->text->str, corpus->text->len);
+    e->set_stream(e, (stream_c *)s);
+
+    gint64 start = g_get_monotonic_time();
+    while (!(e->stream->state_flags & STREAM_EOF)) {
+      occurrence_t **res = e->next(e, 1 << 20);
+      for (occurrence_t **pres = res; *pres; ++pres) {
+        free(*pres);
+        ++count;
+      }
+      free(res);
+    }
+    *seconds = (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC;
+
+    e->unset_stream(e);
+    DESTROY((stream_c *)s);
+  } else {
+    *seconds = -1;
+  }
+
+  e->destroy(e);
+  free(e);
+  return count;
+}
+
+static bool add_module(extractor_c *e, void *module) {
+  return ((regex_module_c *)module)->load((regex_module_c *)module, e);
+}
+
+static bool add_table(extractor_c *e, void *re) {
+  return e->add_miner(e, (miner_c *)dfa_miner_c_create(NULL, dfa_copy(((regex_t *)re)->dfa)));
+}
+
+static bool add_shift_and(extractor_c *e, void *re) {
+  if (!((regex_t *)re)->dfa->shift_and) {
+    return false;
+  }
+  return e->add_miner(e, (miner_c *)shift_and_miner_c_create(NULL, dfa_copy(((regex_t *)re)->dfa)));
+}
+
+/** Counts matches of GRegex, which also skips past each match. */
+static size_t bench_gregex(const bench_corpus_t *corpus, GRegex *regex, double *seconds) {
+  size_t count = 0;
+  GMatchInfo *info = NULL;
+
+  gint64 start = g_get_monotonic_time();
+  g_regex_match_full(regex, corpus->text->str, corpus->text->len, 0, 0, &info, NULL);
+  while (g_match_info_matches(info)) {
+    ++count;
+    g_match_info_next(info, NULL);
+  }
+  *seconds = (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC;
+  g_match_info_free(info);
+  return count;
+}
+
+/** Output of the rows, debug builds print to stdout too. */
+static FILE *out = NULL;
+
+static void bench_print(const bench_corpus_t *corpus, const char *expr, const char *engine,
+  double compile_ms, size_t matches, double seconds) {
+  if (seconds < 0) {
+    return;
+  }
+  // Expressions contain no tabs or newlines and are printed as they are
+  double mb = corpus->text->len / 1e6;
+  fprintf(out, "%s\t%s\t%s\t%.3f\t%zu\t%zu\t%.6f\t%.2f\t%.0f\n", corpus->name, expr, engine,
+    compile_ms, corpus->text->len, matches, seconds,
+    mb / MAX(seconds, 1e-9), matches / MAX(seconds, 1e-9));
+  fflush(out);
+}
+
+static double elapsed_ms(gint64 since) {
+  return (g_get_monotonic_time() - since) / 1e3;
+}
+
+/**
+ * Compiles a module of regexes to a .so, or a table union DFA with `merge`.
+ *
+ * @param compile_ms Time of the build is added to it.
+ */
+static regex_module_c *bench_module(const char *naming, regex_t **res, size_t count,
+  bool merge, double *compile_ms) {
+  gint64 start = g_get_monotonic_time();
+  regex_module_c *module = regex_module_c_new(naming, NULL);
+  module->cache_path = NULL;
+  module->merge = merge;
+  module->backend = (merge ? REGEX_BACKEND_TABLE : REGEX_BACKEND_SO);
+  for (size_t i = 0; i < count; ++i) {
+    module->add_regex(module, res[i]);
+  }
+  if (!module->build(module)) {
+    fprintf(stderr, "Building module %s failed.\n", naming);
+    module->destroy(module);
+    return NULL;
+  }
+  *compile_ms += elapsed_ms(start);
+  return module;
+}
+
+int main(int argc, char **argv) {
+  size_t size = ((argc > 1 && *argv[1]) ? strtoul(argv[1], NULL, 10) : 4) << 20;
+  if (!size) {
+    fprintf(stderr, "Corpus size must be a positive number of MiB.\n");
+    return 1;
+  }
+  out = (argc > 2) ? fopen(argv[2], "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Cannot open %s.\n", argv[2]);
+    return 1;
+  }
+  uint32_t seed = 1;
+
+  bench_corpus_t corpora[] = {
+    { "logs", g_string_sized_new(size + 256) },
+    { "prose", g_string_sized_new(size + 256) },
+    { "czech", g_string_sized_new(size + 256) },
+    { "noise", g_string_sized_new(size + 256) },
+  };
+  size_t corpora_count = sizeof(corpora) / sizeof(corpora[0]);
+  corpus_logs(corpora[0].text, size, &seed);
+  corpus_words(corpora[1].text, size, &seed, english, sizeof(english) / sizeof(english[0]));
+  corpus_words(corpora[2].text, size, &seed, czech, sizeof(czech) / sizeof(czech[0]));
+  corpus_noise(corpora[3].text, size, &seed);
+
+  fprintf(out, "corpus\texpr\tengine\tcompile_ms\tbytes\tmatches\tseconds\tmb_per_s\tmatches_per_s\n");
+
+  regex_t *res[EXPRS_COUNT];
+  double all_ms = 0;
+  for (size_t i = 0; i < EXPRS_COUNT; ++i) {
+    gchar *naming = g_strdup_printf("bench_%zu", i);
+    gint64 start = g_get_monotonic_time();
+    res[i] = regex_compile(exprs[i], naming, "BENCH");
+    double re_ms = elapsed_ms(start);
+    all_ms += re_ms;
+    free(naming);
+    if (!res[i]->state) {
+      fprintf(stderr, "Compiling %s failed.\n", exprs[i]);
+      return 1;
+    }
+
+    double so_ms = re_ms;
+    gchar *module_naming = g_strdup_printf("bench_so_%zu", i);
+    regex_module_c *module = bench_module(module_naming, &(res[i]), 1, false, &so_ms);
+    free(module_naming);
+
+    start = g_get_monotonic_time();
+    GRegex *regex = g_regex_new(exprs[i], G_REGEX_OPTIMIZE, 0, NULL);
+    double gregex_ms = elapsed_ms(start);
+
+    for (size_t c = 0; c < corpora_count; ++c) {
+      double seconds;
+      size_t matches;
+      if (module) {
+        matches = bench_run(&(corpora[c]), add_module, module, &seconds);
+        bench_print(&(corpora[c]), exprs[i], "so", so_ms, matches, seconds);
+      }
+      matches = bench_run(&(corpora[c]), add_table, res[i], &seconds);
+      bench_print(&(corpora[c]), exprs[i], "table", re_ms, matches, seconds);
+      matches = bench_run(&(corpora[c]), add_shift_and, res[i], &seconds);
+      bench_print(&(corpora[c]), exprs[i], "shift-and", re_ms, matches, seconds);
+      if (regex) {
+        matches = bench_gregex(&(corpora[c]), regex, &seconds);
+        bench_print(&(corpora[c]), exprs[i], "gregex", gregex_ms, matches, seconds);
+      }
+    }
+
+    if (module) {
+      unlink(module->so_path);
+      module->destroy(module);
+    }
+    if (regex) {
+      g_regex_unref(regex);
+    }
+  }
+
+  // All expressions at once: one module of miners, one union DFA
+  double so_ms = all_ms;
+  double union_ms = all_ms;
+  regex_module_c *all = bench_module("bench_all", res, EXPRS_COUNT, false, &so_ms);
+  regex_module_c *merged = bench_module("bench_union", res, EXPRS_COUNT, true, &union_ms);
+  for (size_t c = 0; c < corpora_count; ++c) {
+    double seconds;
+    size_t matches;
+    if (all) {
+      matches = bench_run(&(corpora[c]), add_module, all, &seconds);
+      bench_print(&(corpora[c]), "*", "so", so_ms, matches, seconds);
+    }
+    if (merged) {
+      matches = bench_run(&(corpora[c]), add_module, merged, &seconds);
+      bench_print(&(corpora[c]), "*", "union", union_ms, matches, seconds);
+    }
+  }
+  if (all) {
+    unlink(all->so_path);
+    all->destroy(all);
+  }
+  if (merged) {
+    merged->destroy(merged);
+  }
+
+  for (size_t i = 0; i < EXPRS_COUNT; ++i) {
+    regex_destroy(res[i]);
+  }
+  for (size_t c = 0; c < corpora_count; ++c) {
+    g_string_free(corpora[c].text, true);
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  return 0;
+}
@@ -26,6 +26,9 @@
 #include <sys/types.h>
 #include <stddef.h>
 
+/** Library version, keep in sync with nativeextractor.pc. */
+#define NE_VERSION "0.1.0"
+
 #define CONTAINER_OF(addr, type, member) \
   ((type*)((void*)addr - offsetof(type, member)))
 
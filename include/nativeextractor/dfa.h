@@ -0,0 +1,529 @@
+// Copyright (C) 2021 SpongeData s.r.o.
+//
+// NativeExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NativeExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DFA_H
+#define DFA_H
+
+#include <nativeextractor/common.h>
+#include <nativeextractor/finite_automaton.h>
+#include <nativeextractor/miner.h>
+#include <nativeextractor/stream.h>
+#include <nativeextractor/unicode.h>
+
+/** The dead state; no transition leads out of it. */
+#define DFA_DEAD 0
+/** A transition of a lazy DFA which is not computed yet. */
+#define DFA_UNKNOWN 0xFFFFFFFFu
+/** Number of unicode general categories (GUnicodeType). */
+#define DFA_CATEGORIES 30
+/** Flag of an interval entry holding a class instead of a row index. */
+#define DFA_CLASS_CONSTANT 0x80000000u
+
+/** The automaton uses the stream begin assertion (^). */
+#define DFA_LINE_BEGIN (1<<0)
+/** The automaton uses the stream end assertion ($). */
+#define DFA_LINE_END (1<<1)
+/** The automaton uses the line begin assertion ((?m)^). */
+#define DFA_MULTILINE_BEGIN (1<<2)
+/** The automaton uses the line end assertion ((?m)$). */
+#define DFA_MULTILINE_END (1<<3)
+/** The automaton uses the word boundary assertion (\b). */
+#define DFA_WORD_BOUNDARY (1<<4)
+/** The automaton uses the not word boundary assertion (\B). */
+#define DFA_NOT_WORD_BOUNDARY (1<<5)
+
+/** Kind of a missing character, before the start or after the end. */
+#define DFA_KIND_NONE 0
+/** Kind of a line feed. */
+#define DFA_KIND_NEWLINE 1
+/** Kind of a word character (\w). */
+#define DFA_KIND_WORD 2
+/** Kind of the other characters. */
+#define DFA_KIND_OTHER 3
+/**
+ * Number of contexts of a position, a context is the kind of the previous
+ * character times 4 plus the kind of the next one.
+ */
+#define DFA_CONTEXTS 16
+
+typedef enum dfa_item_type_e {
+  /** A single code point. */
+  DFA_ITEM_CHAR,
+  /** An inclusive range of code points. */
+  DFA_ITEM_RANGE,
+  /** A character class function, e.g. unicode_isspace. */
+  DFA_ITEM_FUNCTION
+} dfa_item_type_e;
+
+/** A part of a predicate. */
+typedef struct dfa_item_t {
+  dfa_item_type_e type;
+  /** The code point or the first code point of the range. */
+  uint32_t from;
+  /** The last code point of the range. */
+  uint32_t to;
+  /** The class function. */
+  match_fn_t fn;
+} dfa_item_t;
+
+typedef enum dfa_predicate_type_e {
+  /** Matches a character which matches any of the items. */
+  DFA_PREDICATE_SET,
+  /** Matches the beginning of the stream (^). */
+  DFA_PREDICATE_LINEBEGIN,
+  /** Matches the end of the stream ($). */
+  DFA_PREDICATE_LINEEND,
+  /** Matches the beginning of a line ((?m)^). */
+  DFA_PREDICATE_MULTILINE_BEGIN,
+  /** Matches the end of a line ((?m)$). */
+  DFA_PREDICATE_MULTILINE_END,
+  /** Matches between a word and a non-word character (\b). */
+  DFA_PREDICATE_WORD_BOUNDARY,
+  /** Matches between two word or two non-word characters (\B). */
+  DFA_PREDICATE_NOT_WORD_BOUNDARY,
+  /** Matches `min` to `max` characters which match any of the items. */
+  DFA_PREDICATE_REPEAT
+} dfa_predicate_type_e;
+
+/** Upper bound of a repetition without one. */
+#define DFA_REPEAT_UNBOUNDED UINT32_MAX
+
+/**
+ * Meaning of an NFA edge symbol. Class functions must depend only on the
+ * general category of non-ASCII characters, which holds for all functions
+ * the regex syntax maps to.
+ */
+typedef struct dfa_predicate_t {
+  dfa_predicate_type_e type;
+  /** Matches characters which match none of the items. */
+  bool negated;
+  size_t items_count;
+  dfa_item_t* items;
+  /** Least number of characters of a repetition. */
+  uint32_t min;
+  /** Most characters of a repetition, or DFA_REPEAT_UNBOUNDED. */
+  uint32_t max;
+} dfa_predicate_t;
+
+/** Entering the state keeps the counter. */
+#define DFA_COUNT_KEEP 0
+/** Entering the state starts the counter at one. */
+#define DFA_COUNT_RESET 1
+/** Entering the state increments the counter. */
+#define DFA_COUNT_INCREMENT 2
+
+/**
+ * Counter action of a state. A repetition of a character set is counted
+ * instead of having a state per count: a state stands for all counts of a
+ * phase (below the minimum, up to the maximum, at the maximum) and the
+ * counter tells them apart. A state entered by one more repeat increments
+ * the counter and moves on to `next` when it reaches `limit`.
+ */
+typedef struct dfa_count_t {
+  /** DFA_COUNT_KEEP, DFA_COUNT_RESET or DFA_COUNT_INCREMENT. */
+  uint32_t op;
+  /** Counter value ending the phase of an incrementing state. */
+  uint32_t limit;
+  /** State of the next phase. */
+  uint32_t next;
+} dfa_count_t;
+
+/**
+ * Bit-parallel (Shift-And) form of a small NFA over the classes of a DFA.
+ * A set of Glushkov positions fits in a 64-bit word and a character moves
+ * it by table lookups, see dfa_shift_and_step.
+ */
+typedef struct dfa_shift_and_t {
+  /** Number of positions, the first one is the initial position. */
+  uint32_t positions_count;
+  /** Positions entered by characters of each class. */
+  uint64_t* class_masks;
+  /** Number of follow tables, one per byte of a position set. */
+  uint32_t tables_count;
+  /** Positions following any position of a set by its bytes, 256 per table. */
+  uint64_t* follow;
+  /** Positions a match may end at. */
+  uint64_t finals;
+} dfa_shift_and_t;
+
+/** NFA and state cache of a lazy DFA, see dfa_lazy_step. */
+typedef struct dfa_lazy_t dfa_lazy_t;
+
+/**
+ * A deterministic automaton over character classes stored in flat arrays.
+ * Characters are mapped to classes by a table for ASCII and by sorted
+ * intervals of code points (further split by unicode general category) for
+ * the rest. State 0 is the dead state.
+ *
+ * Assertions (^, $, \b, ...) are zero-width: every set of assertions holding
+ * together in some context is a context class after the character classes.
+ * Its transitions already lead as far as the class can, so it is fed once
+ * per position, see dfa_assert, and adds no states.
+ *
+ * An automaton too large for tables is lazy: it simulates the NFA and keeps
+ * a bounded cache of the states reached in the tables. Step it with
+ * dfa_next and do not share it between threads.
+ *
+ * An automaton counting a repetition has a counter action per state, apply
+ * it by dfa_count after every character.
+ */
+typedef struct dfa_t {
+  /** Number of states including the dead state. */
+  uint32_t states_count;
+  /** Number of classes including the context classes. */
+  uint32_t classes_count;
+  /** The starting state. */
+  uint32_t start;
+  /** Assertions used, e.g. DFA_LINE_BEGIN or DFA_WORD_BOUNDARY. */
+  uint32_t flags;
+  /** Number of context classes, 0 if no assertions are used. */
+  uint32_t contexts_count;
+  /** Context class of each context, 0 if no assertion holds in it. */
+  uint16_t context_classes[DFA_CONTEXTS];
+  /** Classes of ASCII characters. */
+  uint16_t ascii_classes[128];
+  /** Number of code point intervals. */
+  uint32_t intervals_count;
+  /** First code points of the intervals, ascending, starting with 0x80. */
+  uint32_t* interval_starts;
+  /** Class of each interval (with DFA_CLASS_CONSTANT) or its row index. */
+  uint32_t* interval_classes;
+  /** Number of rows. */
+  uint32_t rows_count;
+  /** Classes by general category, DFA_CATEGORIES per row. */
+  uint16_t* rows;
+  /** Transitions, classes_count per state. */
+  uint32_t* transitions;
+  /** Offset of the list of accepted labels of each state, 0 if none. */
+  uint32_t* accepts;
+  /** Size of the accept_lists array. */
+  uint32_t accept_lists_size;
+  /** Count-prefixed lists of label indices; the first one is empty. */
+  uint32_t* accept_lists;
+  /** Number of labels. */
+  uint32_t labels_count;
+  /** The labels. */
+  char** labels;
+  /** NFA of a lazy DFA, NULL if the tables hold all states. */
+  dfa_lazy_t* lazy;
+  /** Bit-parallel form of a single NFA of up to 64 positions without
+   * assertions, NULL otherwise. */
+  dfa_shift_and_t* shift_and;
+  /** Counter action of each state, NULL if no repetition is counted. */
+  dfa_count_t* counts;
+  /** The tables belong to another DFA or a mapped file, see dfa_borrow. */
+  bool borrowed;
+} dfa_t;
+
+/** Magic string of the serialized DFA format. */
+#define DFA_FILE_MAGIC "NEDFA"
+/** Version of the serialized DFA format, files of other versions are refused. */
+#define DFA_FILE_VERSION 3
+/** Written in native byte order, tells files of other hosts. */
+#define DFA_FILE_BYTE_ORDER 0x01020304u
+
+/**
+ * Header of a serialized DFA file. It is followed by an array of
+ * dfa_file_entry_t and the tables, every table aligned to 8 bytes, so the
+ * file is used in place when mapped.
+ */
+typedef struct dfa_file_header_t {
+  /** Magic string - NEDFA */
+  char magic_str[5];
+  /** DFA_FILE_VERSION */
+  uint32_t version;
+  /** DFA_FILE_BYTE_ORDER */
+  uint32_t byte_order;
+  /** Number of DFAs */
+  uint32_t dfas_count;
+  /** Size of the whole file */
+  uint64_t size;
+  /** Offset of the entries */
+  uint64_t entries_offset;
+} dfa_file_header_t;
+
+/** A DFA in a serialized file, offsets are from the file start. */
+typedef struct dfa_file_entry_t {
+  uint32_t states_count;
+  uint32_t classes_count;
+  uint32_t start;
+  uint32_t flags;
+  uint32_t intervals_count;
+  uint32_t rows_count;
+  uint32_t accept_lists_size;
+  uint32_t labels_count;
+  uint64_t interval_starts_offset;
+  uint64_t interval_classes_offset;
+  uint64_t rows_offset;
+  uint64_t transitions_offset;
+  uint64_t accepts_offset;
+  uint64_t accept_lists_offset;
+  /** Offset of labels_count offsets of NUL terminated labels. */
+  uint64_t labels_offset;
+  /** Offset of the NUL terminated name of the miner. */
+  uint64_t naming_offset;
+  /** Offset of the NUL terminated regular expression, empty for a union. */
+  uint64_t expr_offset;
+  /** Offset of the counter actions, 0 if no repetition is counted. */
+  uint64_t counts_offset;
+  uint16_t ascii_classes[128];
+  uint32_t contexts_count;
+  uint16_t context_classes[DFA_CONTEXTS];
+} dfa_file_entry_t;
+
+/** DFAs loaded from a serialized file, see dfa_file_c_from_file. */
+typedef struct dfa_file_c {
+  /** The mapped file. */
+  stream_file_c* mmap_binary;
+  size_t dfas_count;
+  /** DFAs using the tables of the mapped file in place. */
+  dfa_t** dfas;
+  /** Name of the miner of each DFA, pointing into the file. */
+  const char** namings;
+  /** Regular expression of each DFA, pointing into the file. */
+  const char** exprs;
+} dfa_file_c;
+
+/**
+ * Creates a table DFA from a NFA.
+ *
+ * @param nfa        the NFA; symbols of its edges must be in `symbols`
+ * @param symbols    distinct edge symbols
+ * @param predicates meaning of each symbol
+ * @param count      number of symbols
+ * @param label      label of the final states
+ *
+ * @returns a new dfa_t instance, free with dfa_destroy
+ */
+dfa_t* dfa_create(fa_t* nfa, const char** symbols,
+  const dfa_predicate_t* predicates, size_t count, const char* label);
+
+/**
+ * Creates a table DFA matching any of several NFAs at once. Accepting states
+ * list indices of all NFAs they accept. If the powerset construction exceeds
+ * its state budget, the DFA is lazy.
+ *
+ * The longest repetition (DFA_PREDICATE_REPEAT edge) is counted when its
+ * counts cannot overlap, see dfa_count_t, the others are expanded.
+ *
+ * @param nfas       the NFAs; symbols of their edges must be in `symbols`
+ * @param labels     label of each NFA
+ * @param nfas_count number of NFAs
+ * @param symbols    distinct edge symbols of all NFAs
+ * @param predicates meaning of each symbol
+ * @param count      number of symbols
+ *
+ * @returns a new dfa_t instance, free with dfa_destroy
+ */
+dfa_t* dfa_create_union(fa_t** nfas, const char** labels, size_t nfas_count,
+  const char** symbols, const dfa_predicate_t* predicates, size_t count);
+
+/**
+ * Creates a DFA which reads the text from any position and accepts wherever
+ * a nonempty match of `dfa` ends. Its starting state is reached only while
+ * no match is in progress.
+ *
+ * @returns a new dfa_t instance, or NULL if `dfa` uses assertions, has
+ *          several labels, counts a repetition or the result would be too
+ *          large
+ */
+dfa_t* dfa_create_unanchored(const dfa_t* dfa);
+
+/**
+ * Creates a DFA which reads a match of `dfa` backwards from its end and
+ * accepts at the possible starts of nonempty matches.
+ *
+ * @returns a new dfa_t instance, or NULL as dfa_create_unanchored
+ */
+dfa_t* dfa_create_reverse(const dfa_t* dfa);
+
+/**
+ * Creates a DFA using the tables of `dfa`, which must outlive it. A lazy DFA
+ * is copied instead, its cache is written while matching.
+ */
+dfa_t* dfa_borrow(const dfa_t* dfa);
+
+/**
+ * Saves table DFAs to a file in the serialized format, together with the
+ * metadata of their miners.
+ *
+ * @param path    path of the file
+ * @param dfas    the DFAs, lazy DFAs cannot be saved
+ * @param namings name of the miner of each DFA
+ * @param exprs   regular expression of each DFA
+ * @param count   number of DFAs
+ *
+ * @returns true on success
+ */
+bool dfa_save(const char* path, dfa_t** dfas, const char** namings,
+  const char** exprs, size_t count);
+
+/**
+ * Maps a file saved by dfa_save. The tables are used in place, so the file
+ * pages are shared by all processes loading it.
+ *
+ * @returns a new dfa_file_c instance, NULL if the file cannot be read or
+ *          has another format, version or byte order
+ */
+dfa_file_c* dfa_file_c_from_file(const char* path);
+
+/** Unmaps a file, DFAs borrowed from it must be destroyed before. */
+void dfa_file_c_destroy(dfa_file_c* self);
+
+/** Creates a deep copy of a DFA. A lazy DFA gets an empty cache. */
+dfa_t* dfa_copy(const dfa_t* dfa);
+
+/** Destroys a DFA. */
+void dfa_destroy(dfa_t* dfa);
+
+/** Returns the class of a non-ASCII character. */
+uint32_t dfa_class_unicode(const dfa_t* dfa, const char* c);
+
+/** Returns the class of a character. */
+static inline uint32_t dfa_class(const dfa_t* dfa, const char* c) {
+  uint8_t b = (uint8_t)*c;
+  return (b < 0x80) ? dfa->ascii_classes[b] : dfa_class_unicode(dfa, c);
+}
+
+/** Advances a local copy of the stream position by one character. */
+static inline void dfa_advance(char** pos, uint64_t* offset, char* end) {
+  // Same as stream_c movement, a truncated character ends the stream
+  char* next = *pos + unicode_getbytesize(*pos);
+  if (next > end) {
+    *pos = end;
+  } else {
+    *pos = next;
+    ++(*offset);
+  }
+}
+
+/** Returns the number of character classes, the context classes follow. */
+static inline uint32_t dfa_chars_count(const dfa_t* dfa) {
+  return dfa->classes_count - dfa->contexts_count;
+}
+
+/** Returns the kind of a character, e.g. DFA_KIND_WORD. */
+static inline uint32_t dfa_kind(const char* c) {
+  uint8_t b = (uint8_t)*c;
+  if (b >= 0x80) {
+    return unicode_isw((char*)c) ? DFA_KIND_WORD : DFA_KIND_OTHER;
+  }
+  if (b == '\n') {
+    return DFA_KIND_NEWLINE;
+  }
+  uint8_t lower = b | 0x20;
+  return ((b >= '0' && b <= '9') || (lower >= 'a' && lower <= 'z') || b == '_')
+    ? DFA_KIND_WORD : DFA_KIND_OTHER;
+}
+
+/** Returns the kind of the character before `pos`, the stream starts at `start`. */
+static inline uint32_t dfa_kind_before(const char* start, const char* pos) {
+  if (pos <= start) {
+    return DFA_KIND_NONE;
+  }
+  // Back over continuation bytes, no cursor movement is needed
+  const char* c = pos - 1;
+  while (c > start && ((uint8_t)*c & 0xC0) == 0x80) {
+    --c;
+  }
+  return dfa_kind(c);
+}
+
+/** Returns the state reached from `state` by a character of `cls`. */
+static inline uint32_t dfa_step(const dfa_t* dfa, uint32_t state, uint32_t cls) {
+  return dfa->transitions[(size_t)state * dfa->classes_count + cls];
+}
+
+/** Computes a transition missing in the cache of a lazy DFA. */
+uint32_t dfa_lazy_step(dfa_t* dfa, uint32_t state, uint32_t cls);
+
+/** Returns how many times the cache of a lazy DFA was flushed. */
+uint32_t dfa_lazy_flushes(const dfa_t* dfa);
+
+/**
+ * Returns the state reached from `state` by a character of `cls`, computing
+ * the transition of a lazy DFA if needed. States of a lazy DFA other than
+ * the returned one and the start may be flushed from the cache.
+ */
+static inline uint32_t dfa_next(dfa_t* dfa, uint32_t state, uint32_t cls) {
+  uint32_t next = dfa_step(dfa, state, cls);
+  return (next != DFA_UNKNOWN) ? next : dfa_lazy_step(dfa, state, cls);
+}
+
+/**
+ * Returns the context class between a character of kind `*kind` and the one
+ * at `pos`, 0 if no assertion holds there, and moves `*kind` to the latter.
+ */
+static inline uint32_t dfa_context_class(const dfa_t* dfa, uint32_t* kind,
+  const char* pos, const char* end) {
+  uint32_t next = (pos < end) ? dfa_kind(pos) : DFA_KIND_NONE;
+  uint32_t cls = dfa->context_classes[*kind * 4 + next];
+  *kind = next;
+  return cls;
+}
+
+/**
+ * Feeds the assertions holding at `pos` to `*state`, see dfa_context_class.
+ * Call it at the start and after every character.
+ */
+static inline void dfa_assert(dfa_t* dfa, uint32_t* state, uint32_t* kind,
+  const char* pos, const char* end) {
+  if (!dfa->contexts_count) {
+    return;
+  }
+  uint32_t cls = dfa_context_class(dfa, kind, pos, end);
+  if (cls && *state != DFA_DEAD) {
+    *state = dfa_next(dfa, *state, cls);
+  }
+}
+
+/**
+ * Applies the counter action of a state just entered, see dfa_count_t, and
+ * returns the state to go on from.
+ */
+static inline uint32_t dfa_count(const dfa_t* dfa, uint32_t state, uint32_t* counter) {
+  const dfa_count_t* count = &(dfa->counts[state]);
+  if (count->op == DFA_COUNT_RESET) {
+    *counter = 1;
+  } else if (count->op == DFA_COUNT_INCREMENT && ++(*counter) == count->limit) {
+    return count->next;
+  }
+  return state;
+}
+
+/** Returns the positions entered from a set of positions by a class. */
+static inline uint64_t dfa_shift_and_step(const dfa_shift_and_t* sa,
+  uint64_t positions, uint32_t cls) {
+  uint64_t next = 0;
+  for (const uint64_t* table = sa->follow; positions; positions >>= 8, table += 256) {
+    next |= table[positions & 0xFF];
+  }
+  return next & sa->class_masks[cls];
+}
+
+/** Returns true if the state accepts any label. */
+static inline bool dfa_is_accepting(const dfa_t* dfa, uint32_t state) {
+  return dfa->accepts[state] != 0;
+}
+
+/**
+ * Returns labels accepted in a state as a count followed by label indices
+ * in ascending order.
+ */
+static inline const uint32_t* dfa_accepted(const dfa_t* dfa, uint32_t state) {
+  return &(dfa->accept_lists[dfa->accepts[state]]);
+}
+
+#endif  // DFA_H
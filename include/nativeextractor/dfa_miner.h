@@ -0,0 +1,73 @@
+// Copyright (C) 2021 SpongeData s.r.o.
+//
+// NativeExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NativeExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef DFA_MINER_H
+#define DFA_MINER_H
+
+#include <nativeextractor/dfa.h>
+#include <nativeextractor/miner.h>
+
+/**
+ * Miner executing a table DFA directly, without generating and compiling
+ * code. Finds the longest match starting at the current position. A union
+ * DFA with several labels reports the longest match of every label.
+ *
+ * A single DFA without ^ and $ is run in scan mode: the text is read once by
+ * an unanchored DFA up to the next match and the positions before it are
+ * skipped instead of being tried one by one.
+ */
+typedef struct dfa_miner_c {
+  miner_c base;
+  dfa_t *dfa;
+  /** Per label start of its last occurrence (union DFA only). */
+  char **last_starts;
+  /** Per label end of its last occurrence (union DFA only). */
+  char **last_ends;
+  /** Per label end of the longest match in the current run. */
+  mark_t *accepts;
+  /** Labels matched in the current run. */
+  uint32_t *accepted;
+  uint32_t accepted_count;
+  /** DFA finding match ends in scan mode, NULL if not scanning. */
+  dfa_t *unanchored;
+  /** DFA finding match starts from their ends in scan mode. */
+  dfa_t *reverse;
+  /** Position the last scan started at, NULL if not valid. */
+  char *scan_from;
+  /** Start of the match found by the last scan, the stream end if none. */
+  mark_t next_start;
+  /** End of the match found by the last scan, NULL position if none. */
+  mark_t next_end;
+  void (*destroy_super)(miner_c *self);
+  void (*set_stream_super)(miner_c *self, stream_c *stream);
+} dfa_miner_c;
+
+/**
+ * Creates a new DFA miner.
+ *
+ * @param name Name of the miner (label of occurrences), the first label of
+ *             the DFA when NULL.
+ * @param dfa  The automaton; the miner takes ownership of it.
+ *
+ * @return The created miner.
+ */
+dfa_miner_c *dfa_miner_c_create(const char *name, dfa_t *dfa);
+
+dfa_miner_c *dfa_miner_c_clone(dfa_miner_c *self);
+
+void dfa_miner_c_destroy(dfa_miner_c *self);
+
+#endif // DFA_MINER_H
@@ -17,6 +17,7 @@
 #define EXTRACTOR_H
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 
 #include <nativeextractor/common.h>
 #include <nativeextractor/miner.h>
@@ -29,6 +30,15 @@
 #define E_SORT_RESULTS (1<<0)
 /** Do not return enclosed occurrences. */
 #define E_NO_ENCLOSED_OCCURRENCES (1<<1)
+/**
+ * Count occurrences per label instead of returning them, see get_counts.
+ * Cannot be combined with E_NO_ENCLOSED_OCCURRENCES.
+ */
+#define E_COUNT_ONLY (1<<2)
+/**
+ * Stop mining the stream once any miner finds an occurrence, see first_found.
+ */
+#define E_FIRST_MATCH (1<<3)
 
 typedef struct dl_symbol_t {
   /** Path to the .so library. */
@@ -49,6 +59,31 @@ typedef struct thread_args_t {
   unsigned batch;
 } thread_args_t;
 
+/** Number of occurrences of a label found with E_COUNT_ONLY. */
+typedef struct label_count_t {
+  /** The label, NULL at the end of an array. */
+  const char * label;
+  /** Number of occurrences. */
+  uint64_t count;
+} label_count_t;
+
+/** Occurrence counters of a single miner. */
+typedef struct miner_counts_t {
+  label_count_t * items;
+  unsigned count;
+  unsigned capacity;
+} miner_counts_t;
+
+/**
+ * Limits of a single batch for latency-bound callers. Zero means no limit.
+ */
+typedef struct batch_budget_t {
+  /** Maximum time spent on the batch in microseconds. */
+  uint64_t time_limit_us;
+  /** Maximum number of occurrences returned from the batch. */
+  size_t max_occurrences;
+} batch_budget_t;
+
 typedef struct extractor_c {
   /**
    * Analyzes next batch with miners.
@@ -59,6 +94,33 @@ typedef struct extractor_c {
    */
   occurrence_t** (*next)(struct extractor_c * self, unsigned batch);
 
+  /**
+   * Analyzes next batch with miners until the budget is exhausted. Mining
+   * stops cleanly at position granularity and `budget_exhausted` is set. The
+   * stream then stays at the position of the least advanced miner and the
+   * following call of next or next_budget resumes the analysis, each miner
+   * from its own progress, so no occurrence is returned twice.
+   * Miners taken by a thread after the budget is exhausted make no progress
+   * in the batch. Miners ahead of the others get a shorter batch on resume,
+   * so the ones left behind catch up in the following calls.
+   *
+   * @param self   self pointer
+   * @param batch  number of logical symbols to be analyzed in the stream
+   * @param budget limits of the batch or NULL for none
+   * @return       NULL-terminated array of occurencies (need to be correctly freed by user)
+   */
+  occurrence_t** (*next_budget)(struct extractor_c * self, unsigned batch,
+    const batch_budget_t * budget);
+
+  /**
+   * Returns progress of a miner in the last batch.
+   *
+   * @param self  self pointer
+   * @param miner index of the miner in the miners array
+   * @return      unicode offset in the stream reached by the miner
+   */
+  uint64_t (*get_progress)(struct extractor_c * self, unsigned miner);
+
   /**
    * Set stream to extract on.
    *
@@ -88,6 +150,16 @@ typedef struct extractor_c {
    */
   bool (*add_miner_so)(struct extractor_c * self, const char * so_dir, const char * symb, void * params);
 
+  /**
+   * Adds an already created miner to miner array, e.g. a dfa_miner_c
+   *
+   * @param self    self pointer
+   * @param miner   the miner; the extractor takes ownership of it
+   *
+   * @returns       true on success
+   */
+  bool (*add_miner)(struct extractor_c * self, miner_c * miner);
+
   void (*set_last_error)(struct extractor_c * self, const char * err);
 
   const char * (*get_last_error)(struct extractor_c * self);
@@ -117,6 +189,35 @@ typedef struct extractor_c {
    */
   bool (*unset_flags)(struct extractor_c * self, unsigned flags);
 
+  /**
+   * Returns runtime statistics of the miners. Statistics are collected only
+   * when the library is built with NE_STATS (`make stats=true ...`).
+   *
+   * @param self an extractor_c instance
+   *
+   * @returns array of `miners_count` statistics in the order of `miners`
+   *          (need to be freed by user) or NULL when built without NE_STATS
+   */
+  miner_stats_t* (*get_stats)(struct extractor_c * self);
+
+  /**
+   * Zeroes runtime statistics of all miners.
+   *
+   * @param self an extractor_c instance
+   */
+  void (*reset_stats)(struct extractor_c * self);
+
+  /**
+   * Returns numbers of occurrences by label counted with E_COUNT_ONLY since
+   * the stream was set. Counts of miners with the same label are summed.
+   *
+   * @param self an extractor_c instance
+   *
+   * @returns array of counts terminated by an item with NULL label (need to
+   *          be freed by user)
+   */
+  label_count_t* (*get_counts)(struct extractor_c * self);
+
   /**
    * List of miners
    */
@@ -125,6 +226,55 @@ typedef struct extractor_c {
    * Count of miners in the miners array
    */
   unsigned miners_count;
+  /**
+   * Measured cost of each miner in nanoseconds per 1024 characters,
+   * exponentially averaged over batches; the most expensive miners are
+   * handed to the threads first
+   */
+  uint64_t * miners_cost;
+  /**
+   * Occurrence counters of each miner with E_COUNT_ONLY, every miner runs on
+   * one thread in a batch, so they are updated without locking
+   */
+  miner_counts_t * counts;
+  /**
+   * Position reached by each miner in the last batch
+   */
+  mark_t * progress;
+  /**
+   * Unicode offset of the stream at the start of the current batch
+   */
+  uint64_t batch_offset;
+  /**
+   * Deadline of the current batch (CLOCK_MONOTONIC nanoseconds), 0 if none
+   */
+  uint64_t budget_deadline;
+  /**
+   * Maximum number of occurrences of the current batch, 0 if unlimited
+   */
+  size_t budget_occurrences;
+  /**
+   * Number of occurrences found in the current batch
+   */
+  size_t occurrences_count;
+  /**
+   * Index of the miner which produced each occurrence of the current batch,
+   * kept only with NE_STATS to count the occurrences dropped as enclosed
+   */
+  unsigned * owners;
+  /**
+   * Token boundaries of the current batch shared with the miners
+   */
+  token_index_t tokens;
+  /**
+   * True if the last batch was interrupted by its budget
+   */
+  atomic_bool budget_exhausted;
+  /**
+   * True once an occurrence was found in the stream with E_FIRST_MATCH; next
+   * then returns empty arrays until another stream is set
+   */
+  atomic_bool first_found;
   /**
    * Limit of threads to run miners on (currently always 1)
    */
@@ -66,9 +66,69 @@ static inline fa_edge_t *fa_get_edge(fa_t *fa, fa_id_t id) {
   return fa->edges[id];
 }
 
-/** Creates a new DFA from a NFA. */
+/**
+ * Creates a new DFA from a NFA, keeping only nodes reachable from the start.
+ * Edges with equal symbols are treated as one transition.
+ */
 fa_t *fa_create_powerset(fa_t *fa);
 
+/**
+ * Same as fa_create_powerset, but gives up when the DFA would have more than
+ * `max_nodes` nodes.
+ *
+ * @returns a new DFA, or NULL if over the limit
+ */
+fa_t *fa_create_powerset_bounded(fa_t *fa, size_t max_nodes);
+
+/**
+ * Creates a new minimal DFA equivalent to a DFA, e.g. from fa_create_powerset.
+ * Edges with equal symbols are treated as one transition.
+ */
+fa_t *fa_minimize(fa_t *fa);
+
+/** Symbol id of epsilon edges in fa_frozen_t. */
+#define FA_EPSILON UINT32_MAX
+
+/**
+ * Read-only finite automaton with edges in compressed sparse rows. Edges of
+ * node q are at [offsets[q], offsets[q + 1]), sorted by symbol id with
+ * epsilon edges last. Equal symbol strings share one id.
+ */
+typedef struct fa_frozen_t {
+  size_t nodes_count;
+  size_t edges_count;
+  size_t symbols_count;
+  /** Symbol strings by id, owned by the automaton the symbols come from. */
+  const char **symbols;
+  size_t *offsets;
+  uint32_t *edge_symbols;
+  fa_id_t *edge_targets;
+  bool *starting;
+  bool *final;
+  size_t nodes_capacity;
+  size_t edges_capacity;
+} fa_frozen_t;
+
+/** Creates a frozen copy of a finite automaton, node ids are kept. */
+fa_frozen_t *fa_freeze(const fa_t *fa);
+
+/** Creates a finite automaton from a frozen one, node ids are kept. */
+fa_t *fa_thaw(const fa_frozen_t *frozen);
+
+/** Destroys a frozen finite automaton. */
+void fa_frozen_destroy(fa_frozen_t *frozen);
+
+/**
+ * Same as fa_create_powerset_bounded, over frozen automata. Pass SIZE_MAX
+ * for no limit.
+ *
+ * @returns a new DFA, or NULL if over the limit
+ */
+fa_frozen_t *fa_frozen_powerset(const fa_frozen_t *fa, size_t max_nodes);
+
+/** Same as fa_minimize, over frozen automata. */
+fa_frozen_t *fa_frozen_minimize(const fa_frozen_t *fa);
+
 /** Prints a finite automaton to the console. */
 void fa_print(fa_t *fa);
 
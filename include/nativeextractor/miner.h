@@ -19,6 +19,7 @@
 #include <nativeextractor/common.h>
 #include <nativeextractor/occurrence.h>
 #include <nativeextractor/stream.h>
+#include <nativeextractor/token_index.h>
 
 #define MATCH_DELIMITER(e, side, move) \
   ((e)->match_delimiter(e, move) || !(e)->can_move(e, side))
@@ -41,6 +42,43 @@ typedef occurrence_t* (*matcher_t)(struct miner_c* extractor);
 
 typedef bool (*match_fn_t)(char* c);
 
+/**
+ * Runtime statistics of a miner. Counters are updated only when the library
+ * is built with NE_STATS, otherwise they stay zeroed.
+ */
+typedef struct miner_stats_t {
+  /** The name of the miner. */
+  const char* name;
+  /** Wall-clock time spent mining, in nanoseconds. */
+  uint64_t wall_ns;
+  /** CPU time spent mining, in nanoseconds. */
+  uint64_t cpu_ns;
+  /** Number of stream positions the miner was run at. */
+  uint64_t positions;
+  /** Number of `reset_pos` calls which moved the head back. */
+  uint64_t backtracks;
+  /** Number of bytes the miner advanced in the stream. */
+  uint64_t bytes;
+  /** Number of occurrences produced. */
+  uint64_t occurrences;
+  /** Number of occurrences dropped by E_NO_ENCLOSED_OCCURRENCES. */
+  uint64_t dropped;
+} miner_stats_t;
+
+/** A cached search of a literal in the stream, see miner_c_find_literal. */
+typedef struct literal_search_t {
+  /** Where the last search started, NULL if there was none. */
+  char* from;
+  /** The first occurrence at or after `from`, NULL if there is none. */
+  char* found;
+} literal_search_t;
+
+#ifdef NE_STATS
+#define MINER_STATS_ADD(miner, counter, n) ((miner)->stats.counter += (n))
+#else
+#define MINER_STATS_ADD(miner, counter, n)
+#endif
+
 #define miner_c_BODY                                                           \
    /** The name of the extractor. */                                           \
   const char* name;                                                            \
@@ -81,6 +119,38 @@ typedef bool (*match_fn_t)(char* c);
   /** A function for finding occurrences. */                                   \
   matcher_t matcher;                                                           \
                                                                                \
+  /** Runtime statistics, collected only with NE_STATS. */                     \
+  miner_stats_t stats;                                                         \
+                                                                               \
+  /** Token boundaries of the current batch shared by the extractor, NULL if
+   * not available. Used by match_delimiter. */                                \
+  const token_index_t* tokens;                                                 \
+                                                                               \
+  /** If true then the miner matches only at a token start, at a delimiter or
+   * at the stream start, and it is not run inside tokens. Defaults to
+   * false. */                                                                 \
+  bool token_anchored;                                                         \
+                                                                               \
+  /** Maximal number of occurrences reported by one run. Defaults to 1. */     \
+  unsigned max_occurrences;                                                    \
+                                                                               \
+  /** Occurrences found by the last run besides the returned one, taken over
+   * by the extractor. Used by miners reporting several labels at one
+   * position. */                                                              \
+  occurrence_t** pending;                                                      \
+                                                                               \
+  /** Number of pending occurrences. */                                        \
+  unsigned pending_count;                                                      \
+                                                                               \
+  /** Storage of `max_occurrences` occurrences owned by the extractor when it
+   * only counts them (E_COUNT_ONLY), NULL otherwise. Occurrences made by the
+   * miner are then written there instead of being allocated. */              \
+  occurrence_t* scratch;                                                       \
+                                                                               \
+  /** The last search of a literal required by the matcher, see
+   * miner_c_find_literal. */                                                  \
+  literal_search_t literal_search;                                             \
+                                                                               \
   /**
    * Frees resources used by a miner from memory.
    *
@@ -96,6 +166,17 @@ typedef bool (*match_fn_t)(char* c);
    */                                                                          \
   void (*set_stream)(struct miner_c* self, stream_c* stream);                  \
                                                                                \
+  /**
+   * Creates a copy of a miner for mining another stream concurrently. The copy
+   * shares immutable parts (name, parameters, indices) with the original and
+   * has its own cursor state. It must be destroyed before the original.
+   *
+   * @param self An instance of a miner.
+   *
+   * @return The created copy.
+   */                                                                          \
+  struct miner_c* (*clone)(struct miner_c* self);                              \
+                                                                               \
   /**
    * Executes the miner's matcher function and returns found occurrence.
    *
@@ -321,6 +402,32 @@ miner_c* miner_c_create(const char* name, void* params, matcher_t matcher);
  */
 void miner_c_init(miner_c* self, const char* name, void* params, matcher_t matcher);
 
+/**
+ * Initializes a copy of a miner. Call this only in clone methods of classes
+ * which inherit from the miner class.
+ *
+ * @param self An instance to initialize.
+ * @param original The miner to copy.
+ * @param size Size of the instances in bytes.
+ */
+void miner_c_init_clone(miner_c* self, const miner_c* original, size_t size);
+
+miner_c* miner_c_clone(miner_c* self);
+
+/**
+ * Finds the first occurrence of a literal at or after the current position in
+ * the stream. The result is cached until the position passes it, so a miner
+ * run at every position scans the stream for the literal only once. A miner
+ * must always search for the same literal.
+ *
+ * @param self An instance of a miner.
+ * @param literal The literal, not necessarily null-terminated.
+ * @param len Length of the literal in bytes.
+ *
+ * @return The occurrence or NULL if there is none.
+ */
+char* miner_c_find_literal(miner_c* self, const char* literal, size_t len);
+
 void miner_c_destroy(miner_c* self);
 
 bool is_delimiter(char* c);
@@ -26,6 +26,8 @@ typedef struct ner_c {
 
 ner_c* ner_c_create(const char* name, patricia_c* index);
 
+ner_c* ner_c_clone(ner_c* self);
+
 void ner_c_init(ner_c* self, const char* name, patricia_c* index);
 
 #endif // NER_H
@@ -27,6 +27,8 @@ typedef struct patricia_miner_c {
 
 patricia_miner_c *patricia_miner_c_create(const char* name, void* params, matcher_t matcher);
 
+patricia_miner_c *patricia_miner_c_clone(patricia_miner_c *self);
+
 void patricia_miner_c_destroy(patricia_miner_c *self);
 
 #endif // PATRICIA_MINER_C
@@ -18,6 +18,27 @@
 
 #define REGEX_BUILD_PATH "/tmp/"
 #define REGEX_HEADER_FILES "./src/"
+/** Directory of the compiled module cache in the user cache directory
+ * ($XDG_CACHE_HOME or ~/.cache). */
+#define REGEX_CACHE_DIR "nativeextractor"
+/** Size limit of the compiled module cache in bytes. */
+#define REGEX_CACHE_SIZE (256UL << 20)
+
+/** Regexes are compiled to a .so library by REGEX_BUILD_CMD. */
+#define REGEX_BACKEND_SO 0
+/** Regexes run as table DFAs in-process, no compiler is needed. */
+#define REGEX_BACKEND_TABLE 1
+/** Regexes of up to 64 positions run bit-parallel in-process, the others as
+ * REGEX_BACKEND_TABLE. */
+#define REGEX_BACKEND_SHIFT_AND 2
+
+/** Flag of regex_compile_flags: letters match in any case, including
+ * non-ASCII ones. A leading "(?i)" in the expression sets it too. */
+#define REGEX_CASELESS 1
+/** Flag of regex_compile_flags: ^ and $ also match after and before a line
+ * feed, not only at the stream ends. A leading "(?m)" sets it too, "(?im)"
+ * sets both flags. */
+#define REGEX_MULTILINE 2
 
 #ifndef NE_PRODUCTION
   #define REGEX_BUILD_CMD "$CC $flags `pkg-config --cflags glib-2.0 python-2.7` " \
@@ -27,12 +48,33 @@
   #define REGEX_BUILD_CMD "$CC $flags `pkg-config --cflags glib-2.0 python-2.7 nativeextractor` " \
 	  "`pkg-config --libs glib-2.0 python-2.7 nativeextractor` " \
 	  "-Iinclude/ -shared -fPIC"
+  /** Prints the include directory REGEX_BUILD_CMD takes the library headers from. */
+  #define REGEX_INCLUDE_DIR_CMD "pkg-config --variable=includedir nativeextractor"
 #endif
 
+#include <stdio.h>
 #include <glib-2.0/glib.h>
+#include <nativeextractor/dfa.h>
 #include <nativeextractor/extractor.h>
 #include <nativeextractor/finite_automaton.h>
 
+/** Time spent in the stages of regex compilation, in seconds. */
+typedef struct regex_timing_t {
+  /** Lexing of the expression. */
+  double lex;
+  /** Transformation of the lexed tree to the operation tree. */
+  double op_tree;
+  /** Construction of the NFA. */
+  double nfa;
+  /** Construction of the minimal DFA. */
+  double dfa;
+  /** Generation of the C code. */
+  double codegen;
+  /** Running the compiler, only for modules. Wall time, compilers of the
+   * translation units run concurrently. */
+  double cc;
+} regex_timing_t;
+
 typedef struct regex_t {
   /** Regex expression string. */
   char* re_expr;
@@ -42,12 +84,24 @@ typedef struct regex_t {
   char* label;
   /** Reserved - tree for automaton construction. */
   GNode* internal_form;
-  /** C99 generated code. */
+  /** C99 generated code, NULL if the DFA is lazy. */
   char* code;
+  /** Table DFA executed in-process by the table backend. */
+  dfa_t* dfa;
+  /** A literal contained in every match, NULL if there is none. The generated
+   * miner looks for it before running the DFA. */
+  GString* literal;
+  /** Maximal distance in bytes from the start of a match to .literal, SIZE_MAX
+   * if not bounded. */
+  size_t literal_offset;
   /** List of errors during regex compilation. */
   GList* errors;
   /** Boolean state 0 - fail, 1 - success. */
   int state;
+  /** Flags the regex was compiled with, e.g. REGEX_CASELESS. */
+  int flags;
+  /** Time spent in compilation stages. */
+  regex_timing_t timing;
 } regex_t;
 
 /**
@@ -60,12 +114,28 @@ typedef struct regex_t {
  * @return A regex_t instance. For errors check .state and .errors.
  *  */
 regex_t* regex_compile(const char* re_expr, const char* naming, const char* label);
+/**
+ * Same as regex_compile with flags. Case is folded when building the automaton, so caseless regexes
+ * match as fast as the others.
+ *
+ * @param flags 0, REGEX_CASELESS and/or REGEX_MULTILINE.
+ *
+ * @return A regex_t instance. For errors check .state and .errors.
+ *  */
+regex_t* regex_compile_flags(const char* re_expr, const char* naming, const char* label, int flags);
 /**
  * Frees a previously instantiated regex_t instance via regex_compile.
  *
  * @param regex Regex instance. */
 void regex_destroy(regex_t *regex);
 
+/**
+ * Prints time spent in compilation stages, one stage per line.
+ *
+ * @param timing Timing of a regex_t or regex_module_c.
+ * @param out Output file, e.g. stderr. */
+void regex_timing_print(const regex_timing_t *timing, FILE *out);
+
 typedef struct regex_module_c {
   /** List of regexes. */
   GList *exprs;
@@ -79,12 +149,33 @@ typedef struct regex_module_c {
   char *build_cmd;
   /** Final generated code of the library. */
   char *code;
-  /** Concatenation .build_path/.naming".so" */
+  /** Concatenation .build_path/.naming".so", or the cache entry .cache_path/<hash>".so" when cached. */
   char *so_path;
+  /** Directory of the compiled module cache, freed with the module, NULL disables the cache. Default is REGEX_CACHE_DIR
+   * in the user cache directory. The cache is used only if the directory and the cached library
+   * belong to the user and nobody else can write to them. */
+  char *cache_path;
+  /** Size limit of the cache in bytes, least recently used entries are removed above it. */
+  size_t cache_size;
+  /** Number of translation units compiled concurrently and linked into one library, less than 1 for the number of processors.
+   * Default is 1, a single compiler run without a separate link step. */
+  int build_jobs;
   /** List of all errors. */
   GList * errors;
   /** Boolean state. */
   int state;
+  /** REGEX_BACKEND_SO (default), REGEX_BACKEND_TABLE or
+   * REGEX_BACKEND_SHIFT_AND. */
+  int backend;
+  /** If true, all regexes are merged into one union DFA run by a single miner
+   * which reports every label matched at a position in one pass. */
+  bool merge;
+  /** The union DFA built by .build when .merge is set. */
+  dfa_t *dfa;
+  /** Time spent in compilation stages of all added regexes and .build. */
+  regex_timing_t timing;
+  /** DFAs of a module loaded by regex_module_c_from_file, NULL otherwise. */
+  dfa_file_c *file;
   /**
    *  Add regex to module.
    * @param self An instance of regex_module_c.
@@ -95,6 +186,8 @@ typedef struct regex_module_c {
   int (*add_regex)(struct regex_module_c *self, regex_t * compiled_regex);
   /**
    * Perform build of the module containing regexes. Only function that possibly modifies .state -> 0.
+   * Nothing is built for the in-process backends, only the union DFA is built when .merge is set. When the same code was already built by the same
+   * command against the same headers and library, the cached library is reused without running the compiler.
    * @param self An instance of regex_module_c.
    *
    * @return Boolean return state.
@@ -102,12 +195,25 @@ typedef struct regex_module_c {
   int (*build)(struct regex_module_c *self);
   /**
    * Apply add_miner_so() for every regex from the module to an extractor. Before calling .load, .build must be called first.
+   * With REGEX_BACKEND_TABLE a dfa_miner_c is added for every regex instead, with .merge set a
+   * single dfa_miner_c named after the module is added. REGEX_BACKEND_SHIFT_AND adds a
+   * shift_and_miner_c where the regex has a bit-parallel form. Regexes with a lazy DFA are
+   * always run in-process, bit-parallel if possible.
    * @param self An instance of regex_module_c.
    * @param extractor An instance of extractor_c.
    *
    * @return Boolean return state.
    */
   int (*load)(struct regex_module_c * self, extractor_c *extractor);
+  /**
+   * Save the table DFAs of the module to a file loadable by regex_module_c_from_file. Before calling .save, .build must be called first.
+   * With .merge set the union DFA is saved, otherwise the DFA of every regex. Lazy DFAs cannot be saved.
+   * @param self An instance of regex_module_c.
+   * @param path Path of the file.
+   *
+   * @return Boolean return state.
+   */
+  int (*save)(struct regex_module_c * self, const char *path);
   /**
    * Frees memory used by the module.
    *
@@ -118,10 +224,25 @@ typedef struct regex_module_c {
 /**
  * Regex-module constructor.
  * Uses environmental variables REGEX_HEADER_FILES and REGEX_BUILD_PATH which defaults to equally named defines whenever not set.
+ * Environmental variable REGEX_BACKEND=table selects REGEX_BACKEND_TABLE, REGEX_BACKEND=shift-and
+ * selects REGEX_BACKEND_SHIFT_AND.
+ * Environmental variable REGEX_CACHE_PATH overrides the cache directory (empty disables the cache),
+ * REGEX_CACHE_SIZE (bytes) defaults to the equally named define. Environmental variable REGEX_BUILD_JOBS sets .build_jobs.
  *
  * @param naming Unique naming of the module.
  * @param path Optional build path for the module. When NULL is passed environment REGEX_BUILD_PATH will be used or default to REGEX_BUILD_PATH.
 */
 regex_module_c * regex_module_c_new(const char * naming, const char * path);
 
+/**
+ * Creates a module of the DFAs saved by .save. The file is mapped and its tables are run in-process
+ * by dfa_miner_c on .load, no regex is compiled again. .build does nothing.
+ *
+ * @param naming Unique naming of the module.
+ * @param path Path of the saved file.
+ *
+ * @return A regex_module_c instance, NULL if the file cannot be loaded.
+*/
+regex_module_c * regex_module_c_from_file(const char * naming, const char * path);
+
 #endif  // REGEX_GENERATOR_H
\ No newline at end of file
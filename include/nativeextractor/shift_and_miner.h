@@ -0,0 +1,51 @@
+// Copyright (C) 2021 SpongeData s.r.o.
+//
+// NativeExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NativeExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SHIFT_AND_MINER_H
+#define SHIFT_AND_MINER_H
+
+#include <nativeextractor/dfa.h>
+#include <nativeextractor/miner.h>
+
+/**
+ * Miner simulating a small NFA bit-parallel (Shift-And over Glushkov
+ * positions), see dfa_shift_and_t. Finds the longest match starting at the
+ * current position, like dfa_miner_c, without building DFA states.
+ */
+typedef struct shift_and_miner_c {
+  miner_c base;
+  /** Classes of characters and the bit-parallel automaton. */
+  dfa_t *dfa;
+  void (*destroy_super)(miner_c *self);
+} shift_and_miner_c;
+
+/**
+ * Creates a new Shift-And miner.
+ *
+ * @param name Name of the miner (label of occurrences), the label of the DFA
+ *             when NULL.
+ * @param dfa  The automaton with .shift_and set; the miner takes ownership
+ *             of it.
+ *
+ * @return The created miner, NULL if the DFA has no bit-parallel form.
+ */
+shift_and_miner_c *shift_and_miner_c_create(const char *name, dfa_t *dfa);
+
+shift_and_miner_c *shift_and_miner_c_clone(shift_and_miner_c *self);
+
+void shift_and_miner_c_destroy(shift_and_miner_c *self);
+
+#endif // SHIFT_AND_MINER_H
@@ -0,0 +1,83 @@
+// Copyright (C) 2021 SpongeData s.r.o.
+//
+// NativeExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NativeExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TOKEN_INDEX_H
+#define TOKEN_INDEX_H
+
+#include <nativeextractor/common.h>
+#include <nativeextractor/stream.h>
+
+/**
+ * Token boundaries of a part of a stream, one bit per byte. A character is a
+ * delimiter if `is_delimiter` holds for it (all its bytes have the bit set); a
+ * token starts at a non-delimiter preceded by a delimiter or the stream start.
+ * The extractor computes the index once per batch and shares it with miners.
+ */
+typedef struct token_index_t {
+  /** The first indexed byte. */
+  const char* start;
+  /** The byte behind the last indexed one. */
+  const char* end;
+  /** Bitmap of delimiter bytes. */
+  uint64_t* delimiters;
+  /** Bitmap of token starts. */
+  uint64_t* starts;
+  /** Number of words allocated for each bitmap. */
+  size_t capacity;
+} token_index_t;
+
+/**
+ * Indexes bytes from `start` to `end` of a stream. Buffers of the index are
+ * reused between calls.
+ *
+ * @param self   the index
+ * @param stream the stream the bytes belong to
+ * @param start  the first byte to index, must start a character
+ * @param end    the byte behind the last one to index
+ */
+void token_index_t_build(token_index_t* self, stream_c* stream,
+  const char* start, const char* end);
+
+/**
+ * Frees buffers of the index.
+ *
+ * @param self the index
+ */
+void token_index_t_clear(token_index_t* self);
+
+/** Returns true if the byte is indexed. */
+static inline bool token_index_t_covers(const token_index_t* self, const char* pos) {
+  return (pos >= self->start && pos < self->end);
+}
+
+/** Returns true if a delimiter is at an indexed byte. */
+static inline bool token_index_t_is_delimiter(const token_index_t* self, const char* pos) {
+  size_t i = (size_t)(pos - self->start);
+  return (self->delimiters[i >> 6] >> (i & 63)) & 1;
+}
+
+/** Returns true if a token starts at an indexed byte. */
+static inline bool token_index_t_is_start(const token_index_t* self, const char* pos) {
+  size_t i = (size_t)(pos - self->start);
+  return (self->starts[i >> 6] >> (i & 63)) & 1;
+}
+
+/** Returns true if an indexed byte is inside a token, but does not start it. */
+static inline bool token_index_t_is_inside(const token_index_t* self, const char* pos) {
+  size_t i = (size_t)(pos - self->start);
+  return !(((self->delimiters[i >> 6] | self->starts[i >> 6]) >> (i & 63)) & 1);
+}
+
+#endif // TOKEN_INDEX_H
@@ -0,0 +1,1989 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <glib-2.0/glib.h>
+
+#include <nativeextractor/dfa.h>
+
+/** Set of predicates matching a character, one bit per predicate. */
+typedef struct dfa_signature_t {
+  size_t words;
+  uint64_t bits[];
+} dfa_signature_t;
+
+/** Character classes under construction, one class per distinct signature. */
+typedef struct dfa_classes_t {
+  /** Maps signatures to class ids + 1. */
+  GHashTable* index;
+  /** Signature of each class. */
+  dfa_signature_t** signatures;
+  uint32_t count;
+  uint32_t capacity;
+  /** Words of each signature. */
+  size_t words;
+} dfa_classes_t;
+
+static gunichar category_representatives[DFA_CATEGORIES];
+static pthread_once_t category_representatives_once = PTHREAD_ONCE_INIT;
+
+/** Finds a non-ASCII code point of every general category. */
+static void find_category_representatives(void) {
+  unsigned missing = DFA_CATEGORIES;
+  bool found[DFA_CATEGORIES] = { false };
+
+  for (gunichar cp = 0x80; cp < 0x110000 && missing > 0; ++cp) {
+    GUnicodeType type = g_unichar_type(cp);
+    if (type < DFA_CATEGORIES && !found[type]) {
+      found[type] = true;
+      category_representatives[type] = cp;
+      --missing;
+    }
+  }
+}
+
+static guint dfa_signature_hash(gconstpointer key) {
+  const dfa_signature_t* sig = key;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sig->words; ++i) {
+    hash = (hash ^ sig->bits[i]) * 1099511628211ull;
+  }
+  return (guint)(hash ^ (hash >> 32));
+}
+
+static gboolean dfa_signature_equal(gconstpointer a, gconstpointer b) {
+  const dfa_signature_t* sa = a;
+  const dfa_signature_t* sb = b;
+  return memcmp(sa->bits, sb->bits, sa->words * sizeof(uint64_t)) == 0;
+}
+
+static inline bool dfa_signature_has(const dfa_signature_t* sig, size_t i) {
+  return (sig->bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static bool dfa_predicate_matches(const dfa_predicate_t* predicate,
+  gunichar cp, char* probe) {
+  bool any = false;
+
+  for (size_t i = 0; i < predicate->items_count && !any; ++i) {
+    const dfa_item_t* item = &(predicate->items[i]);
+    switch (item->type) {
+      case DFA_ITEM_CHAR:
+        any = (cp == item->from);
+        break;
+
+      case DFA_ITEM_RANGE:
+        any = (cp >= item->from && cp <= item->to);
+        break;
+
+      case DFA_ITEM_FUNCTION:
+        any = item->fn(probe);
+        break;
+    }
+  }
+
+  return any != predicate->negated;
+}
+
+/**
+ * Computes which predicates match a character. Explicit code points are
+ * compared with `cp`, class functions are called on `probe`.
+ */
+static dfa_signature_t* dfa_signature_create(const dfa_predicate_t* predicates,
+  size_t count, size_t words, gunichar cp, char* probe) {
+  dfa_signature_t* sig = calloc(1, sizeof(dfa_signature_t) + words * sizeof(uint64_t));
+  sig->words = words;
+
+  for (size_t i = 0; i < count; ++i) {
+    if ((predicates[i].type == DFA_PREDICATE_SET || predicates[i].type == DFA_PREDICATE_REPEAT)
+        && dfa_predicate_matches(&(predicates[i]), cp, probe)) {
+      sig->bits[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+  }
+
+  return sig;
+}
+
+/** Returns class of a signature, creating it if needed. Takes the signature. */
+static uint32_t dfa_classes_intern(dfa_classes_t* classes, dfa_signature_t* sig) {
+  gpointer found = g_hash_table_lookup(classes->index, sig);
+  if (found) {
+    free(sig);
+    return GPOINTER_TO_UINT(found) - 1;
+  }
+
+  if (classes->count == classes->capacity) {
+    classes->capacity = MAX(16, 2 * classes->capacity);
+    classes->signatures = realloc(classes->signatures,
+      classes->capacity * sizeof(dfa_signature_t*));
+  }
+  uint32_t cls = classes->count++;
+  classes->signatures[cls] = sig;
+  g_hash_table_insert(classes->index, sig, GUINT_TO_POINTER(cls + 1));
+  return cls;
+}
+
+static uint32_t dfa_classes_of(dfa_classes_t* classes,
+  const dfa_predicate_t* predicates, size_t count, gunichar cp, gunichar probe_cp) {
+  char probe[8] = { 0 };
+  g_unichar_to_utf8(probe_cp, probe);
+  return dfa_classes_intern(classes,
+    dfa_signature_create(predicates, count, classes->words, cp, probe));
+}
+
+static int uint32_t_compare(const void* a, const void* b) {
+  return CMP(*(const uint32_t*)a, *(const uint32_t*)b);
+}
+
+/**
+ * Splits non-ASCII code points into intervals by explicit code points of the
+ * predicates, so that only general categories matter within an interval.
+ */
+static uint32_t* dfa_interval_starts(const dfa_predicate_t* predicates,
+  size_t count, uint32_t* intervals_count) {
+  size_t size = 1;
+  size_t capacity = 16;
+  uint32_t* starts = malloc(capacity * sizeof(uint32_t));
+  starts[0] = 0x80;
+
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < predicates[i].items_count; ++j) {
+      const dfa_item_t* item = &(predicates[i].items[j]);
+      if (item->type == DFA_ITEM_FUNCTION || item->to < 0x80) {
+        continue;
+      }
+      if (size + 2 > capacity) {
+        capacity *= 2;
+        starts = realloc(starts, capacity * sizeof(uint32_t));
+      }
+      starts[size++] = MAX(item->from, 0x80);
+      starts[size++] = item->to + 1;
+    }
+  }
+
+  qsort(starts, size, sizeof(uint32_t), uint32_t_compare);
+
+  size_t unique = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (starts[i] < 0x110000 && (unique == 0 || starts[unique - 1] != starts[i])) {
+      starts[unique++] = starts[i];
+    }
+  }
+
+  *intervals_count = (uint32_t)unique;
+  return starts;
+}
+
+static void dfa_build_classes(dfa_t* dfa, dfa_classes_t* classes,
+  const dfa_predicate_t* predicates, size_t count) {
+  pthread_once(&category_representatives_once, find_category_representatives);
+
+  // Class 0 matches nothing
+  dfa_signature_t* none = calloc(1, sizeof(dfa_signature_t) + classes->words * sizeof(uint64_t));
+  none->words = classes->words;
+  dfa_classes_intern(classes, none);
+
+  for (gunichar c = 0; c < 128; ++c) {
+    dfa->ascii_classes[c] = dfa_classes_of(classes, predicates, count, c, c);
+  }
+
+  dfa->interval_starts = dfa_interval_starts(predicates, count, &(dfa->intervals_count));
+  dfa->interval_classes = malloc(dfa->intervals_count * sizeof(uint32_t));
+  dfa->rows = NULL;
+  dfa->rows_count = 0;
+
+  for (uint32_t i = 0; i < dfa->intervals_count; ++i) {
+    gunichar start = dfa->interval_starts[i];
+    gunichar end = (i + 1 < dfa->intervals_count) ? dfa->interval_starts[i + 1] : 0x110000;
+
+    if (end - start == 1) {
+      dfa->interval_classes[i] = DFA_CLASS_CONSTANT
+        | dfa_classes_of(classes, predicates, count, start, start);
+      continue;
+    }
+
+    uint16_t row[DFA_CATEGORIES];
+    bool constant = true;
+    for (unsigned k = 0; k < DFA_CATEGORIES; ++k) {
+      row[k] = dfa_classes_of(classes, predicates, count, start,
+        category_representatives[k]);
+      constant = constant && (row[k] == row[0]);
+    }
+
+    if (constant) {
+      dfa->interval_classes[i] = DFA_CLASS_CONSTANT | row[0];
+    } else {
+      dfa->rows = realloc(dfa->rows,
+        (dfa->rows_count + 1) * DFA_CATEGORIES * sizeof(uint16_t));
+      memcpy(&(dfa->rows[dfa->rows_count * DFA_CATEGORIES]), row, sizeof(row));
+      dfa->interval_classes[i] = dfa->rows_count++;
+    }
+  }
+}
+
+/** Flag of the assertion of each predicate type, 0 for sets. */
+static const uint32_t dfa_predicate_flags[] = {
+  [DFA_PREDICATE_SET] = 0,
+  [DFA_PREDICATE_LINEBEGIN] = DFA_LINE_BEGIN,
+  [DFA_PREDICATE_LINEEND] = DFA_LINE_END,
+  [DFA_PREDICATE_MULTILINE_BEGIN] = DFA_MULTILINE_BEGIN,
+  [DFA_PREDICATE_MULTILINE_END] = DFA_MULTILINE_END,
+  [DFA_PREDICATE_WORD_BOUNDARY] = DFA_WORD_BOUNDARY,
+  [DFA_PREDICATE_NOT_WORD_BOUNDARY] = DFA_NOT_WORD_BOUNDARY,
+  [DFA_PREDICATE_REPEAT] = 0,
+};
+
+/** Returns the assertions holding in a context. */
+static uint32_t dfa_context_assertions(uint32_t context) {
+  uint32_t prev = context / 4;
+  uint32_t next = context % 4;
+  uint32_t holds = ((prev == DFA_KIND_WORD) != (next == DFA_KIND_WORD))
+    ? DFA_WORD_BOUNDARY : DFA_NOT_WORD_BOUNDARY;
+
+  if (prev == DFA_KIND_NONE) {
+    holds |= DFA_LINE_BEGIN;
+  }
+  if (next == DFA_KIND_NONE) {
+    holds |= DFA_LINE_END;
+  }
+  if (prev == DFA_KIND_NONE || prev == DFA_KIND_NEWLINE) {
+    holds |= DFA_MULTILINE_BEGIN;
+  }
+  if (next == DFA_KIND_NONE || next == DFA_KIND_NEWLINE) {
+    holds |= DFA_MULTILINE_END;
+  }
+  return holds;
+}
+
+/**
+ * Appends a context class after `chars` character classes for each distinct
+ * nonempty set of the used assertions holding in some context.
+ */
+static void dfa_build_contexts(dfa_t* dfa, uint32_t chars) {
+  uint32_t sets[DFA_CONTEXTS];
+  dfa->contexts_count = 0;
+
+  for (uint32_t context = 0; context < DFA_CONTEXTS; ++context) {
+    uint32_t holds = dfa_context_assertions(context) & dfa->flags;
+    dfa->context_classes[context] = 0;
+    if (!holds) {
+      continue;
+    }
+    uint32_t k = 0;
+    while (k < dfa->contexts_count && sets[k] != holds) {
+      ++k;
+    }
+    if (k == dfa->contexts_count) {
+      sets[dfa->contexts_count++] = holds;
+    }
+    dfa->context_classes[context] = (uint16_t)(chars + k);
+  }
+  dfa->classes_count = chars + dfa->contexts_count;
+}
+
+/** Returns the assertions holding when a context class is fed. */
+static uint32_t dfa_class_assertions(const dfa_t* dfa, uint32_t cls) {
+  for (uint32_t context = 0; context < DFA_CONTEXTS; ++context) {
+    if (dfa->context_classes[context] == cls) {
+      return dfa_context_assertions(context) & dfa->flags;
+    }
+  }
+  return 0;
+}
+
+/** Prefix of marker symbols leading from final states of the label NFAs. */
+#define DFA_MARKER 'L'
+
+/** Phases of a counted repetition, by the count read so far. */
+typedef enum dfa_phase_e {
+  /** Fewer characters than the minimum. */
+  DFA_PHASE_BELOW,
+  /** At least the minimum and fewer than the maximum. */
+  DFA_PHASE_WITHIN,
+  /** The maximum. */
+  DFA_PHASE_FULL,
+  DFA_PHASES
+} dfa_phase_e;
+
+/** A phase without a node. */
+#define DFA_NO_NODE SIZE_MAX
+
+/** The repetition counted by a class NFA, see dfa_counted_from_nfa. */
+typedef struct dfa_counter_t {
+  /** The DFA_PREDICATE_REPEAT edge counted, NULL if none. */
+  const fa_edge_t* edge;
+  uint32_t min;
+  uint32_t max;
+  /** Node the repetition is started from. */
+  fa_id_t entry;
+  /** Node of each phase, DFA_NO_NODE if the bounds leave it out. */
+  fa_id_t phases[DFA_PHASES];
+  /** Phase of the first character. */
+  dfa_phase_e first;
+} dfa_counter_t;
+
+/** Adds an edge by every class matching the `p`-th predicate. */
+static void dfa_class_edges_add(const dfa_classes_t* classes, fa_t* cnfa,
+  fa_id_t from, size_t p, fa_id_t to, char** class_symbols) {
+  for (uint32_t c = 1; c < classes->count; ++c) {
+    if (dfa_signature_has(classes->signatures[c], p)) {
+      fa_add_edge(cnfa, from, class_symbols[c], to);
+    }
+  }
+}
+
+/**
+ * Expands a repetition as the regex syntax would: `min` copies followed by
+ * a loop, or by `max - min` optional copies nested as (x(x(x)?)?)?.
+ */
+static void dfa_repeat_add(const dfa_classes_t* classes, fa_t* cnfa, fa_id_t from,
+  const dfa_predicate_t* predicate, size_t p, fa_id_t to, char** class_symbols) {
+  fa_id_t node = from;
+
+  for (uint32_t i = 0; i < predicate->min; ++i) {
+    fa_id_t next = fa_add_node(cnfa);
+    dfa_class_edges_add(classes, cnfa, node, p, next, class_symbols);
+    node = next;
+  }
+
+  if (predicate->max == DFA_REPEAT_UNBOUNDED) {
+    fa_id_t loop = fa_add_node(cnfa);
+    fa_add_edge(cnfa, node, NULL, loop);
+    dfa_class_edges_add(classes, cnfa, loop, p, loop, class_symbols);
+    node = loop;
+  } else {
+    for (uint32_t i = predicate->min; i < predicate->max; ++i) {
+      fa_id_t next = fa_add_node(cnfa);
+      fa_add_edge(cnfa, node, NULL, to);
+      dfa_class_edges_add(classes, cnfa, node, p, next, class_symbols);
+      node = next;
+    }
+  }
+
+  fa_add_edge(cnfa, node, NULL, to);
+}
+
+/**
+ * Adds the nodes of a counted repetition: an entry node and a node per
+ * phase looping on the set while the count stays in the phase. Which
+ * phase a count is in is decided at run time, see dfa_count_t.
+ */
+static void dfa_counter_add(const dfa_classes_t* classes, fa_t* cnfa, fa_id_t from,
+  dfa_counter_t* counter, size_t p, fa_id_t to, char** class_symbols) {
+  uint32_t min = counter->min;
+  uint32_t max = counter->max;
+
+  counter->entry = fa_add_node(cnfa);
+  fa_add_edge(cnfa, from, NULL, counter->entry);
+  if (min == 0) {
+    fa_add_edge(cnfa, counter->entry, NULL, to);
+  }
+
+  fa_id_t* phases = counter->phases;
+  phases[DFA_PHASE_BELOW] = (min > 1) ? fa_add_node(cnfa) : DFA_NO_NODE;
+  phases[DFA_PHASE_WITHIN] = (max == DFA_REPEAT_UNBOUNDED || max > MAX(min, 1))
+    ? fa_add_node(cnfa) : DFA_NO_NODE;
+  phases[DFA_PHASE_FULL] = (max != DFA_REPEAT_UNBOUNDED) ? fa_add_node(cnfa) : DFA_NO_NODE;
+
+  counter->first = DFA_PHASE_BELOW;
+  while (phases[counter->first] == DFA_NO_NODE) {
+    ++counter->first;
+  }
+  dfa_class_edges_add(classes, cnfa, counter->entry, p, phases[counter->first], class_symbols);
+
+  for (int k = DFA_PHASE_BELOW; k < DFA_PHASES; ++k) {
+    if (phases[k] == DFA_NO_NODE) {
+      continue;
+    }
+    if (k != DFA_PHASE_FULL) {
+      dfa_class_edges_add(classes, cnfa, phases[k], p, phases[k], class_symbols);
+    }
+    if (k != DFA_PHASE_BELOW) {
+      fa_add_edge(cnfa, phases[k], NULL, to);
+    }
+  }
+}
+
+/** Copies a NFA over predicates into `cnfa` as a NFA over classes. */
+static void dfa_class_nfa_add(const dfa_t* dfa, dfa_classes_t* classes, fa_t* cnfa,
+  fa_t* nfa, fa_id_t sink, const char* marker, GHashTable* symbol_index,
+  const dfa_predicate_t* predicates, char** class_symbols, dfa_counter_t* counter) {
+  fa_id_t offset = cnfa->next_node_id;
+
+  for (fa_id_t id = 0; id < nfa->next_node_id; ++id) {
+    fa_id_t cid = fa_add_node(cnfa);
+    fa_node_t* node = fa_get_node(nfa, id);
+    if (node->is_starting) {
+      fa_add_edge(cnfa, 0, NULL, cid);
+    }
+    if (node->is_final) {
+      fa_add_edge(cnfa, cid, marker, sink);
+    }
+  }
+
+  for (fa_id_t id = 0; id < nfa->next_edge_id; ++id) {
+    fa_edge_t* edge = fa_get_edge(nfa, id);
+    fa_id_t from = edge->from->id + offset;
+    fa_id_t to = edge->to->id + offset;
+
+    if (!edge->symbol) {
+      fa_add_edge(cnfa, from, NULL, to);
+      continue;
+    }
+
+    size_t p = GPOINTER_TO_UINT(g_hash_table_lookup(symbol_index, edge->symbol)) - 1;
+
+    if (predicates[p].type == DFA_PREDICATE_SET) {
+      dfa_class_edges_add(classes, cnfa, from, p, to, class_symbols);
+      continue;
+    }
+
+    if (predicates[p].type == DFA_PREDICATE_REPEAT) {
+      if (edge == counter->edge) {
+        dfa_counter_add(classes, cnfa, from, counter, p, to, class_symbols);
+      } else {
+        dfa_repeat_add(classes, cnfa, from, &(predicates[p]), p, to, class_symbols);
+      }
+      continue;
+    }
+
+    // An assertion is passed by every context class it holds in
+    for (uint32_t c = dfa_chars_count(dfa); c < dfa->classes_count; ++c) {
+      if (dfa_class_assertions(dfa, c) & dfa_predicate_flags[predicates[p].type]) {
+        fa_add_edge(cnfa, from, class_symbols[c], to);
+      }
+    }
+  }
+}
+
+/**
+ * Joins NFAs over predicates into one NFA over classes. Final states of the
+ * i-th NFA get an edge with marker symbol "L<i>" to a sink, so the powerset
+ * tells which labels a state accepts.
+ */
+static fa_t* dfa_class_nfa(const dfa_t* dfa, dfa_classes_t* classes, fa_t** nfas,
+  size_t nfas_count, char** markers, GHashTable* symbol_index,
+  const dfa_predicate_t* predicates, char** class_symbols, dfa_counter_t* counter) {
+  fa_t* cnfa = fa_create();
+  fa_get_node(cnfa, fa_add_node(cnfa))->is_starting = true;
+  // The only final state, so minimization tells it from the dead state
+  fa_id_t sink = fa_add_node(cnfa);
+  fa_get_node(cnfa, sink)->is_final = true;
+
+  for (size_t i = 0; i < nfas_count; ++i) {
+    dfa_class_nfa_add(dfa, classes, cnfa, nfas[i], sink, markers[i], symbol_index,
+      predicates, class_symbols, counter);
+  }
+
+  // Feeding a context keeps all branches alive, not only the asserting ones
+  for (fa_id_t id = 0; id < cnfa->next_node_id; ++id) {
+    for (uint32_t c = dfa_chars_count(dfa); c < dfa->classes_count; ++c) {
+      fa_add_edge(cnfa, id, class_symbols[c], id);
+    }
+  }
+
+  return cnfa;
+}
+
+/**
+ * Picks the repetition to count: the one with the most copies when
+ * expanded. Repetitions of at most one character stay expanded.
+ */
+static dfa_counter_t dfa_counter_choose(fa_t** nfas, size_t nfas_count,
+  GHashTable* symbol_index, const dfa_predicate_t* predicates) {
+  dfa_counter_t counter = { .edge = NULL };
+  uint64_t longest = 1;
+
+  for (size_t i = 0; i < nfas_count; ++i) {
+    for (fa_id_t id = 0; id < nfas[i]->next_edge_id; ++id) {
+      fa_edge_t* edge = fa_get_edge(nfas[i], id);
+      if (!edge->symbol) {
+        continue;
+      }
+      size_t p = GPOINTER_TO_UINT(g_hash_table_lookup(symbol_index, edge->symbol)) - 1;
+      const dfa_predicate_t* predicate = &(predicates[p]);
+      if (predicate->type != DFA_PREDICATE_REPEAT) {
+        continue;
+      }
+      uint64_t copies = (predicate->max == DFA_REPEAT_UNBOUNDED)
+        ? (uint64_t)predicate->min + 1 : predicate->max;
+      if (copies > longest) {
+        longest = copies;
+        counter = (dfa_counter_t){ .edge = edge, .min = predicate->min, .max = predicate->max };
+      }
+    }
+  }
+  return counter;
+}
+
+/** Flag of marker symbols in the table made by dfa_symbol_classes. */
+#define DFA_SYMBOL_MARKER 0x80000000u
+
+/**
+ * Parses the symbols of a frozen class NFA once: a class number, or a label
+ * index with DFA_SYMBOL_MARKER for marker symbols.
+ */
+static uint32_t* dfa_symbol_classes(const fa_frozen_t* cnfa) {
+  uint32_t* symbol_classes = malloc(MAX(cnfa->symbols_count, 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < cnfa->symbols_count; ++i) {
+    const char* symbol = cnfa->symbols[i];
+    symbol_classes[i] = (*symbol == DFA_MARKER)
+      ? DFA_SYMBOL_MARKER | (uint32_t)strtoul(symbol + 1, NULL, 10)
+      : (uint32_t)strtoul(symbol, NULL, 10);
+  }
+  return symbol_classes;
+}
+
+/** Returns offset of a count-prefixed label list, adding it if new. */
+static uint32_t dfa_accept_list(dfa_t* dfa, GHashTable* lists, uint32_t* labels,
+  uint32_t count, uint32_t* capacity) {
+  qsort(labels, count, sizeof(uint32_t), uint32_t_compare);
+
+  GString* key = g_string_new("");
+  for (uint32_t i = 0; i < count; ++i) {
+    g_string_append_printf(key, "%u,", labels[i]);
+  }
+
+  gpointer found = g_hash_table_lookup(lists, key->str);
+  if (found) {
+    g_string_free(key, true);
+    return GPOINTER_TO_UINT(found);
+  }
+
+  if (dfa->accept_lists_size + count + 1 > *capacity) {
+    *capacity = MAX(2 * (*capacity), dfa->accept_lists_size + count + 1);
+    dfa->accept_lists = realloc(dfa->accept_lists, *capacity * sizeof(uint32_t));
+  }
+
+  uint32_t offset = dfa->accept_lists_size;
+  dfa->accept_lists[dfa->accept_lists_size++] = count;
+  memcpy(&(dfa->accept_lists[dfa->accept_lists_size]), labels, count * sizeof(uint32_t));
+  dfa->accept_lists_size += count;
+
+  g_hash_table_insert(lists, g_string_free(key, false), GUINT_TO_POINTER(offset));
+  return offset;
+}
+
+static void* memdup(const void* src, size_t size) {
+  if (!src) {
+    return NULL;
+  }
+  void* dst = malloc(MAX(size, 1));
+  memcpy(dst, src, size);
+  return dst;
+}
+
+/** Most states of a DFA derived by dfa_create_unanchored or dfa_create_reverse. */
+#define DFA_SUBSET_MAX_STATES 4096
+
+/**
+ * Nondeterministic automaton over the character classes of a DFA, excluding
+ * the context classes. Targets of state s and class c are stored from
+ * targets[offsets[s * classes_count + c]] up to the next offset.
+ */
+typedef struct dfa_nfa_t {
+  uint32_t states_count;
+  uint32_t classes_count;
+  uint32_t start;
+  uint32_t* offsets;
+  uint32_t* targets;
+  bool* finals;
+} dfa_nfa_t;
+
+static void dfa_nfa_init(dfa_nfa_t* nfa, uint32_t states_count,
+  uint32_t classes_count, uint32_t start) {
+  nfa->states_count = states_count;
+  nfa->classes_count = classes_count;
+  nfa->start = start;
+  nfa->offsets = calloc((size_t)states_count * classes_count + 1, sizeof(uint32_t));
+  nfa->targets = NULL;
+  nfa->finals = calloc(states_count, sizeof(bool));
+}
+
+static void dfa_nfa_clear(dfa_nfa_t* nfa) {
+  free(nfa->offsets);
+  free(nfa->targets);
+  free(nfa->finals);
+}
+
+/** Turns target counts in offsets into offsets of the ends of the lists. */
+static void dfa_nfa_allocate(dfa_nfa_t* nfa) {
+  size_t n = (size_t)nfa->states_count * nfa->classes_count;
+  for (size_t i = 1; i < n; ++i) {
+    nfa->offsets[i] += nfa->offsets[i - 1];
+  }
+  nfa->offsets[n] = nfa->offsets[n - 1];
+  nfa->targets = malloc(MAX(nfa->offsets[n], 1) * sizeof(uint32_t));
+}
+
+/**
+ * Counts a target in the first pass and adds it in the second one, filling
+ * the lists from their ends down to their starts.
+ */
+static inline void dfa_nfa_link(dfa_nfa_t* nfa, int pass, uint32_t from,
+  uint32_t cls, uint32_t to) {
+  size_t cell = (size_t)from * nfa->classes_count + cls;
+  if (pass) {
+    nfa->targets[--nfa->offsets[cell]] = to;
+  } else {
+    ++nfa->offsets[cell];
+  }
+}
+
+/** A set of NFA states, sorted. */
+typedef struct dfa_set_t {
+  uint32_t id;
+  uint32_t count;
+  uint32_t states[];
+} dfa_set_t;
+
+static guint dfa_set_hash(gconstpointer key) {
+  const dfa_set_t* set = key;
+  guint hash = set->count;
+  for (uint32_t i = 0; i < set->count; ++i) {
+    hash = hash * 31 + set->states[i];
+  }
+  return hash;
+}
+
+static gboolean dfa_set_equal(gconstpointer a, gconstpointer b) {
+  const dfa_set_t* x = a;
+  const dfa_set_t* y = b;
+  return x->count == y->count
+    && memcmp(x->states, y->states, x->count * sizeof(uint32_t)) == 0;
+}
+
+/**
+ * Determinizes a NFA over the classes of `dfa` by subset construction. Sets
+ * are not minimized, so the starting set is the only state equal to it.
+ *
+ * @returns a new DFA sharing the classes and labels of `dfa`, or NULL if it
+ *          would have more than DFA_SUBSET_MAX_STATES states
+ */
+static dfa_t* dfa_subset(const dfa_t* dfa, const dfa_nfa_t* nfa) {
+  GHashTable* index = g_hash_table_new(dfa_set_hash, dfa_set_equal);
+  GPtrArray* sets = g_ptr_array_new_with_free_func(free);
+  uint32_t* stamps = calloc(nfa->states_count, sizeof(uint32_t));
+  dfa_set_t* next = malloc(sizeof(dfa_set_t) + nfa->states_count * sizeof(uint32_t));
+  uint32_t classes_count = nfa->classes_count;
+  uint32_t* transitions = NULL;
+  bool ok = true;
+
+  dfa_set_t* start = malloc(sizeof(dfa_set_t) + sizeof(uint32_t));
+  *start = (dfa_set_t){ .id = 1, .count = 1 };
+  start->states[0] = nfa->start;
+  g_ptr_array_add(sets, start);
+  g_hash_table_insert(index, start, start);
+
+  // Sets are numbered from 1, the empty set is the dead state
+  for (uint32_t i = 0; i < sets->len && ok; ++i) {
+    dfa_set_t* set = g_ptr_array_index(sets, i);
+    transitions = realloc(transitions, (size_t)(i + 2) * classes_count * sizeof(uint32_t));
+    memset(&(transitions[(size_t)(i + 1) * classes_count]), 0, classes_count * sizeof(uint32_t));
+
+    for (uint32_t c = 0; c < nfa->classes_count; ++c) {
+      uint32_t stamp = i * nfa->classes_count + c + 1;
+      next->count = 0;
+      for (uint32_t k = 0; k < set->count; ++k) {
+        size_t cell = (size_t)set->states[k] * nfa->classes_count + c;
+        for (uint32_t t = nfa->offsets[cell]; t < nfa->offsets[cell + 1]; ++t) {
+          uint32_t to = nfa->targets[t];
+          if (stamps[to] != stamp) {
+            stamps[to] = stamp;
+            next->states[next->count++] = to;
+          }
+        }
+      }
+      if (next->count == 0) {
+        continue;
+      }
+      qsort(next->states, next->count, sizeof(uint32_t), uint32_t_compare);
+
+      dfa_set_t* found = g_hash_table_lookup(index, next);
+      if (!found) {
+        if (sets->len >= DFA_SUBSET_MAX_STATES) {
+          ok = false;
+          break;
+        }
+        found = malloc(sizeof(dfa_set_t) + next->count * sizeof(uint32_t));
+        memcpy(found, next, sizeof(dfa_set_t) + next->count * sizeof(uint32_t));
+        found->id = sets->len + 1;
+        g_ptr_array_add(sets, found);
+        g_hash_table_insert(index, found, found);
+      }
+      transitions[(size_t)(i + 1) * classes_count + c] = found->id;
+    }
+  }
+
+  dfa_t* out = NULL;
+  if (ok) {
+    out = calloc(1, sizeof(dfa_t));
+    memcpy(out->ascii_classes, dfa->ascii_classes, sizeof(dfa->ascii_classes));
+    out->classes_count = classes_count;
+    out->start = 1;
+    out->intervals_count = dfa->intervals_count;
+    out->interval_starts = memdup(dfa->interval_starts, dfa->intervals_count * sizeof(uint32_t));
+    out->interval_classes = memdup(dfa->interval_classes, dfa->intervals_count * sizeof(uint32_t));
+    out->rows_count = dfa->rows_count;
+    out->rows = memdup(dfa->rows, (size_t)dfa->rows_count * DFA_CATEGORIES * sizeof(uint16_t));
+    out->states_count = sets->len + 1;
+    memset(transitions, 0, classes_count * sizeof(uint32_t));
+    out->transitions = transitions;
+    transitions = NULL;
+
+    // A single list accepting the first label
+    out->accept_lists_size = 3;
+    out->accept_lists = malloc(3 * sizeof(uint32_t));
+    memcpy(out->accept_lists, (uint32_t[]){ 0, 1, 0 }, 3 * sizeof(uint32_t));
+    out->accepts = calloc(out->states_count, sizeof(uint32_t));
+    for (uint32_t i = 0; i < sets->len; ++i) {
+      dfa_set_t* set = g_ptr_array_index(sets, i);
+      for (uint32_t k = 0; k < set->count; ++k) {
+        if (nfa->finals[set->states[k]]) {
+          out->accepts[i + 1] = 1;
+          break;
+        }
+      }
+    }
+
+    out->labels_count = MIN(dfa->labels_count, 1);
+    out->labels = malloc(sizeof(char*));
+    if (out->labels_count) {
+      out->labels[0] = strdup(dfa->labels[0]);
+    }
+  }
+
+  free(transitions);
+  free(next);
+  free(stamps);
+  g_ptr_array_free(sets, true);
+  g_hash_table_destroy(index);
+  return out;
+}
+
+/** Most states of a table DFA, larger automata are run as lazy DFAs. */
+#define DFA_MAX_STATES 65536
+/** Most states cached by a lazy DFA before the cache is flushed. */
+#define DFA_LAZY_STATES 1024
+
+/**
+ * A class NFA simulated by a lazy DFA. The tables of the dfa_t cache the
+ * sets of NFA nodes reached so far as states, transitions not computed yet
+ * are DFA_UNKNOWN. A full cache is flushed and filled again.
+ */
+struct dfa_lazy_t {
+  /** Edges by class, the last column holds epsilon edges. */
+  dfa_nfa_t nfa;
+  /** Label index + 1 accepted by each NFA node, 0 if none. */
+  uint32_t* node_labels;
+  /** The starting set. */
+  dfa_set_t* start;
+  /** Cached set of each state. */
+  dfa_set_t** sets;
+  /** Maps cached sets to themselves. */
+  GHashTable* index;
+  /** Offsets of accept lists by their keys, see dfa_accept_list. */
+  GHashTable* lists;
+  uint32_t lists_capacity;
+  /** The set under construction. */
+  dfa_set_t* next;
+  /** Labels of the set under construction. */
+  uint32_t* labels;
+  uint32_t* stamps;
+  uint32_t stamp;
+  /** Number of flushes of the cache. */
+  uint32_t flushes;
+};
+
+static inline void dfa_lazy_add_node(dfa_lazy_t* lazy, uint32_t node) {
+  if (lazy->stamps[node] != lazy->stamp) {
+    lazy->stamps[node] = lazy->stamp;
+    lazy->next->states[lazy->next->count++] = node;
+  }
+}
+
+/** Starts a new set under construction. */
+static void dfa_lazy_begin(dfa_lazy_t* lazy) {
+  if (++lazy->stamp == 0) {
+    memset(lazy->stamps, 0, lazy->nfa.states_count * sizeof(uint32_t));
+    lazy->stamp = 1;
+  }
+  lazy->next->count = 0;
+}
+
+/**
+ * Adds the epsilon closure to the set under construction and sorts it. Edges
+ * of a context class `cls` are followed too, giving the set a table DFA
+ * reaches by the class, see dfa_close_contexts. Pass DFA_UNKNOWN otherwise.
+ */
+static void dfa_lazy_close(dfa_lazy_t* lazy, uint32_t cls) {
+  const dfa_nfa_t* nfa = &(lazy->nfa);
+  dfa_set_t* set = lazy->next;
+  uint32_t epsilon = nfa->classes_count - 1;
+
+  // The set grows while it is walked, so it serves as the stack
+  for (uint32_t i = 0; i < set->count; ++i) {
+    size_t cell = (size_t)set->states[i] * nfa->classes_count + epsilon;
+    for (uint32_t t = nfa->offsets[cell]; t < nfa->offsets[cell + 1]; ++t) {
+      dfa_lazy_add_node(lazy, nfa->targets[t]);
+    }
+    if (cls == DFA_UNKNOWN) {
+      continue;
+    }
+    cell = (size_t)set->states[i] * nfa->classes_count + cls;
+    for (uint32_t t = nfa->offsets[cell]; t < nfa->offsets[cell + 1]; ++t) {
+      dfa_lazy_add_node(lazy, nfa->targets[t]);
+    }
+  }
+  qsort(set->states, set->count, sizeof(uint32_t), uint32_t_compare);
+}
+
+/** Caches a copy of a set as a new state. */
+static uint32_t dfa_lazy_add(dfa_t* dfa, const dfa_set_t* set) {
+  dfa_lazy_t* lazy = dfa->lazy;
+  uint32_t id = dfa->states_count++;
+
+  dfa_set_t* copy = memdup(set, sizeof(dfa_set_t) + set->count * sizeof(uint32_t));
+  copy->id = id;
+  lazy->sets[id] = copy;
+  g_hash_table_insert(lazy->index, copy, copy);
+
+  // All bits set is DFA_UNKNOWN
+  memset(&(dfa->transitions[(size_t)id * dfa->classes_count]), 0xFF,
+    dfa->classes_count * sizeof(uint32_t));
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < set->count; ++i) {
+    uint32_t label = lazy->node_labels[set->states[i]];
+    if (label) {
+      lazy->labels[count++] = label - 1;
+    }
+  }
+  qsort(lazy->labels, count, sizeof(uint32_t), uint32_t_compare);
+  uint32_t unique = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (unique == 0 || lazy->labels[unique - 1] != lazy->labels[i]) {
+      lazy->labels[unique++] = lazy->labels[i];
+    }
+  }
+  dfa->accepts[id] = (unique > 0)
+    ? dfa_accept_list(dfa, lazy->lists, lazy->labels, unique, &(lazy->lists_capacity))
+    : 0;
+
+  return id;
+}
+
+/** Drops all cached states and accept lists and caches the start again. */
+static void dfa_lazy_flush(dfa_t* dfa) {
+  dfa_lazy_t* lazy = dfa->lazy;
+  g_hash_table_remove_all(lazy->index);
+  for (uint32_t id = 1; id < dfa->states_count; ++id) {
+    free(lazy->sets[id]);
+  }
+  g_hash_table_remove_all(lazy->lists);
+  dfa->accept_lists_size = 1;
+  dfa->states_count = 1;
+  dfa->start = dfa_lazy_add(dfa, lazy->start);
+  ++lazy->flushes;
+}
+
+uint32_t dfa_lazy_step(dfa_t* dfa, uint32_t state, uint32_t cls) {
+  dfa_lazy_t* lazy = dfa->lazy;
+  const dfa_nfa_t* nfa = &(lazy->nfa);
+  const dfa_set_t* set = lazy->sets[state];
+
+  dfa_lazy_begin(lazy);
+  for (uint32_t i = 0; i < set->count; ++i) {
+    size_t cell = (size_t)set->states[i] * nfa->classes_count + cls;
+    for (uint32_t t = nfa->offsets[cell]; t < nfa->offsets[cell + 1]; ++t) {
+      dfa_lazy_add_node(lazy, nfa->targets[t]);
+    }
+  }
+  dfa_lazy_close(lazy, (cls < dfa_chars_count(dfa)) ? DFA_UNKNOWN : cls);
+
+  uint32_t to = DFA_DEAD;
+  if (lazy->next->count > 0) {
+    dfa_set_t* found = g_hash_table_lookup(lazy->index, lazy->next);
+    if (!found && dfa->states_count > DFA_LAZY_STATES) {
+      // The source state is gone with the flush, the transition is not kept
+      dfa_lazy_flush(dfa);
+      state = DFA_DEAD;
+      found = g_hash_table_lookup(lazy->index, lazy->next);
+    }
+    to = (found ? found->id : dfa_lazy_add(dfa, lazy->next));
+  }
+
+  if (state != DFA_DEAD) {
+    dfa->transitions[(size_t)state * dfa->classes_count + cls] = to;
+  }
+  return to;
+}
+
+/** Turns a DFA into a lazy DFA of a class NFA, taking over its arrays. */
+static void dfa_lazy_init(dfa_t* dfa, dfa_nfa_t nfa, uint32_t* node_labels) {
+  dfa_lazy_t* lazy = calloc(1, sizeof(dfa_lazy_t));
+  lazy->nfa = nfa;
+  lazy->node_labels = node_labels;
+  lazy->sets = calloc(DFA_LAZY_STATES + 1, sizeof(dfa_set_t*));
+  lazy->index = g_hash_table_new(dfa_set_hash, dfa_set_equal);
+  lazy->lists = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  lazy->lists_capacity = 16;
+  lazy->next = malloc(sizeof(dfa_set_t) + nfa.states_count * sizeof(uint32_t));
+  lazy->labels = malloc(MAX(nfa.states_count, 1) * sizeof(uint32_t));
+  lazy->stamps = calloc(nfa.states_count, sizeof(uint32_t));
+  dfa->lazy = lazy;
+
+  dfa->transitions = calloc((size_t)(DFA_LAZY_STATES + 1) * dfa->classes_count, sizeof(uint32_t));
+  dfa->accepts = calloc(DFA_LAZY_STATES + 1, sizeof(uint32_t));
+  dfa->accept_lists = malloc(lazy->lists_capacity * sizeof(uint32_t));
+  dfa->accept_lists[0] = 0; // no labels
+  dfa->accept_lists_size = 1;
+
+  dfa_lazy_begin(lazy);
+  dfa_lazy_add_node(lazy, nfa.start);
+  dfa_lazy_close(lazy, DFA_UNKNOWN);
+  lazy->start = memdup(lazy->next, sizeof(dfa_set_t) + lazy->next->count * sizeof(uint32_t));
+
+  dfa->states_count = 1;
+  dfa->start = dfa_lazy_add(dfa, lazy->start);
+}
+
+/**
+ * Converts a class NFA into arrays of NFA edges by class, the last column
+ * holds epsilon edges. Marker edges become labels of their source nodes.
+ */
+static void dfa_nfa_from_frozen(dfa_nfa_t* nfa, uint32_t** node_labels,
+  const dfa_t* dfa, const fa_frozen_t* cnfa, const uint32_t* symbol_classes) {
+  uint32_t columns = dfa->classes_count + 1;
+  dfa_nfa_init(nfa, (uint32_t)cnfa->nodes_count, columns, 0);
+  *node_labels = calloc(MAX(cnfa->nodes_count, 1), sizeof(uint32_t));
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (fa_id_t from = 0; from < cnfa->nodes_count; ++from) {
+      for (size_t e = cnfa->offsets[from]; e < cnfa->offsets[from + 1]; ++e) {
+        uint32_t to = (uint32_t)cnfa->edge_targets[e];
+        uint32_t cls = (cnfa->edge_symbols[e] == FA_EPSILON)
+          ? columns - 1 : symbol_classes[cnfa->edge_symbols[e]];
+        if (cls & DFA_SYMBOL_MARKER) {
+          (*node_labels)[from] = (cls & ~DFA_SYMBOL_MARKER) + 1;
+        } else {
+          dfa_nfa_link(nfa, pass, (uint32_t)from, cls, to);
+        }
+      }
+    }
+    if (!pass) {
+      dfa_nfa_allocate(nfa);
+    }
+  }
+}
+
+/** Converts a class NFA into the arrays of a lazy DFA. */
+static void dfa_lazy_from_nfa(dfa_t* dfa, const fa_frozen_t* cnfa, const uint32_t* symbol_classes) {
+  dfa_nfa_t nfa;
+  uint32_t* node_labels;
+  dfa_nfa_from_frozen(&nfa, &node_labels, dfa, cnfa, symbol_classes);
+  dfa_lazy_init(dfa, nfa, node_labels);
+}
+
+/** Creates a lazy DFA with an empty cache running the same NFA. */
+static void dfa_lazy_copy(dfa_t* copy, const dfa_lazy_t* lazy) {
+  dfa_nfa_t nfa = lazy->nfa;
+  size_t cells = (size_t)nfa.states_count * nfa.classes_count;
+  nfa.offsets = memdup(nfa.offsets, (cells + 1) * sizeof(uint32_t));
+  nfa.targets = memdup(nfa.targets, nfa.offsets[cells] * sizeof(uint32_t));
+  nfa.finals = memdup(nfa.finals, nfa.states_count * sizeof(bool));
+  dfa_lazy_init(copy, nfa, memdup(lazy->node_labels, nfa.states_count * sizeof(uint32_t)));
+}
+
+static void dfa_lazy_destroy(dfa_t* dfa) {
+  dfa_lazy_t* lazy = dfa->lazy;
+  for (uint32_t id = 1; id < dfa->states_count; ++id) {
+    free(lazy->sets[id]);
+  }
+  free(lazy->sets);
+  free(lazy->start);
+  free(lazy->next);
+  free(lazy->labels);
+  free(lazy->stamps);
+  g_hash_table_destroy(lazy->index);
+  g_hash_table_destroy(lazy->lists);
+  dfa_nfa_clear(&(lazy->nfa));
+  free(lazy->node_labels);
+  free(lazy);
+}
+
+uint32_t dfa_lazy_flushes(const dfa_t* dfa) {
+  return dfa->lazy ? dfa->lazy->flushes : 0;
+}
+
+/** Returns true if a sorted set holds a node. */
+static bool dfa_set_has(const dfa_set_t* set, uint32_t node) {
+  return bsearch(&node, set->states, set->count, sizeof(uint32_t), uint32_t_compare) != NULL;
+}
+
+/** Returns true if the NFA has an edge from `from` to `to` by `cls`. */
+static bool dfa_nfa_has_edge(const dfa_nfa_t* nfa, uint32_t from, uint32_t cls, uint32_t to) {
+  size_t cell = (size_t)from * nfa->classes_count + cls;
+  for (uint32_t t = nfa->offsets[cell]; t < nfa->offsets[cell + 1]; ++t) {
+    if (nfa->targets[t] == to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Returns the count ending a phase, 0 if the count no longer matters in it. */
+static uint32_t dfa_counter_limit(const dfa_counter_t* counter, int phase) {
+  if (phase == DFA_PHASE_BELOW) {
+    return counter->min;
+  }
+  if (phase == DFA_PHASE_WITHIN && counter->max != DFA_REPEAT_UNBOUNDED) {
+    return counter->max;
+  }
+  return 0;
+}
+
+/**
+ * Returns the state of the set under construction entered by a counter
+ * action, adding it if new. The action is a pseudo node after the NFA nodes,
+ * so the same set entered otherwise is another state.
+ *
+ * @returns the state, DFA_UNKNOWN if there would be too many states
+ */
+static uint32_t dfa_counted_intern(dfa_lazy_t* work, GHashTable* index, GPtrArray* sets,
+  uint32_t op) {
+  dfa_set_t* next = work->next;
+  if (op != DFA_COUNT_KEEP) {
+    next->states[next->count++] = work->nfa.states_count + op;
+  }
+
+  dfa_set_t* found = g_hash_table_lookup(index, next);
+  if (!found) {
+    if (sets->len >= DFA_MAX_STATES) {
+      return DFA_UNKNOWN;
+    }
+    found = memdup(next, sizeof(dfa_set_t) + next->count * sizeof(uint32_t));
+    found->id = sets->len + 1;
+    g_ptr_array_add(sets, found);
+    g_hash_table_insert(index, found, found);
+  }
+  return found->id;
+}
+
+/**
+ * Determinizes a class NFA counting a repetition, see dfa_count_t. A set
+ * holds at most one phase node whose count matters, and a character may not
+ * both repeat it and start the repetition again, as in [a-z]*[a-z]{20}: the
+ * counts would overlap and one counter cannot hold them. Context classes are
+ * closed over as by a lazy DFA. States are not minimized.
+ *
+ * @returns false if the counts overlap or there are over DFA_MAX_STATES states
+ */
+static bool dfa_counted_from_nfa(dfa_t* dfa, const fa_frozen_t* cnfa,
+  const uint32_t* symbol_classes, const dfa_counter_t* counter) {
+  dfa_lazy_t work = { .stamp = 0 };
+  uint32_t* node_labels;
+  dfa_nfa_from_frozen(&(work.nfa), &node_labels, dfa, cnfa, symbol_classes);
+  uint32_t n = work.nfa.states_count;
+  work.next = malloc(sizeof(dfa_set_t) + (n + 1) * sizeof(uint32_t));
+  work.stamps = calloc(n, sizeof(uint32_t));
+
+  GHashTable* index = g_hash_table_new(dfa_set_hash, dfa_set_equal);
+  GPtrArray* sets = g_ptr_array_new_with_free_func(free);
+  uint32_t classes_count = dfa->classes_count;
+  uint32_t chars = dfa_chars_count(dfa);
+  const fa_id_t* phases = counter->phases;
+  uint32_t first = (uint32_t)phases[counter->first];
+  uint32_t* transitions = NULL;
+  dfa_count_t* counts = NULL;
+  bool ok = true;
+
+  dfa_lazy_begin(&work);
+  dfa_lazy_add_node(&work, work.nfa.start);
+  dfa_lazy_close(&work, DFA_UNKNOWN);
+  dfa_counted_intern(&work, index, sets, DFA_COUNT_KEEP);
+
+  // Sets are numbered from 1, the empty set is the dead state
+  for (uint32_t i = 0; i < sets->len && ok; ++i) {
+    dfa_set_t* set = g_ptr_array_index(sets, i);
+    uint32_t last = set->states[set->count - 1];
+    uint32_t op = (last >= n) ? last - n : DFA_COUNT_KEEP;
+    uint32_t size = set->count - (op != DFA_COUNT_KEEP);
+    bool entered = dfa_set_has(set, (uint32_t)counter->entry);
+
+    int phase = DFA_PHASES;
+    for (int k = DFA_PHASE_BELOW; k < DFA_PHASES; ++k) {
+      if (phases[k] != DFA_NO_NODE && dfa_counter_limit(counter, k)
+          && dfa_set_has(set, (uint32_t)phases[k])) {
+        phase = k;
+      }
+    }
+    uint32_t counted = (phase < DFA_PHASES) ? (uint32_t)phases[phase] : UINT32_MAX;
+
+    transitions = realloc(transitions, (size_t)(i + 2) * classes_count * sizeof(uint32_t));
+    counts = realloc(counts, (size_t)(i + 2) * sizeof(dfa_count_t));
+    counts[i + 1] = (dfa_count_t){ op, 0, DFA_DEAD };
+
+    for (uint32_t c = 0; c < classes_count && ok; ++c) {
+      dfa_lazy_begin(&work);
+      for (uint32_t k = 0; k < size; ++k) {
+        size_t cell = (size_t)set->states[k] * work.nfa.classes_count + c;
+        for (uint32_t t = work.nfa.offsets[cell]; t < work.nfa.offsets[cell + 1]; ++t) {
+          dfa_lazy_add_node(&work, work.nfa.targets[t]);
+        }
+      }
+      dfa_lazy_close(&work, (c < chars) ? DFA_UNKNOWN : c);
+
+      uint32_t to = DFA_DEAD;
+      if (work.next->count > 0) {
+        uint32_t action = DFA_COUNT_KEEP;
+        if (c < chars) {
+          bool repeats = (counted != UINT32_MAX
+            && dfa_nfa_has_edge(&(work.nfa), counted, c, counted));
+          bool starts = (entered && dfa_nfa_has_edge(&(work.nfa), (uint32_t)counter->entry, c, first));
+          ok = !(repeats && starts);
+          action = starts ? DFA_COUNT_RESET : (repeats ? DFA_COUNT_INCREMENT : DFA_COUNT_KEEP);
+        }
+        to = ok ? dfa_counted_intern(&work, index, sets, action) : DFA_UNKNOWN;
+        ok = (to != DFA_UNKNOWN);
+      }
+      transitions[(size_t)(i + 1) * classes_count + c] = to;
+    }
+
+    if (ok && op == DFA_COUNT_INCREMENT) {
+      // The same set in the next phase, entered when the count ends this one
+      int next = (phase == DFA_PHASE_BELOW && phases[DFA_PHASE_WITHIN] != DFA_NO_NODE)
+        ? DFA_PHASE_WITHIN : DFA_PHASE_FULL;
+      dfa_lazy_begin(&work);
+      for (uint32_t k = 0; k < size; ++k) {
+        if (set->states[k] != counted) {
+          dfa_lazy_add_node(&work, set->states[k]);
+        }
+      }
+      dfa_lazy_add_node(&work, (uint32_t)phases[next]);
+      dfa_lazy_close(&work, DFA_UNKNOWN);
+      uint32_t to = dfa_counted_intern(&work, index, sets,
+        dfa_counter_limit(counter, next) ? DFA_COUNT_INCREMENT : DFA_COUNT_KEEP);
+      ok = (to != DFA_UNKNOWN);
+      counts[i + 1] = (dfa_count_t){ op, dfa_counter_limit(counter, phase), to };
+    }
+  }
+
+  if (ok) {
+    dfa->states_count = sets->len + 1;
+    dfa->start = 1;
+    memset(transitions, 0, classes_count * sizeof(uint32_t));
+    dfa->transitions = transitions;
+    counts[0] = (dfa_count_t){ DFA_COUNT_KEEP, 0, DFA_DEAD };
+    dfa->counts = counts;
+
+    uint32_t capacity = 16;
+    dfa->accept_lists = malloc(capacity * sizeof(uint32_t));
+    dfa->accept_lists[0] = 0; // no labels
+    dfa->accept_lists_size = 1;
+    dfa->accepts = calloc(dfa->states_count, sizeof(uint32_t));
+    GHashTable* lists = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    uint32_t* labels = malloc(MAX(n, 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < sets->len; ++i) {
+      dfa_set_t* set = g_ptr_array_index(sets, i);
+      uint32_t count = 0;
+      for (uint32_t k = 0; k < set->count; ++k) {
+        uint32_t label = (set->states[k] < n) ? node_labels[set->states[k]] : 0;
+        if (label) {
+          labels[count++] = label - 1;
+        }
+      }
+      qsort(labels, count, sizeof(uint32_t), uint32_t_compare);
+      uint32_t unique = 0;
+      for (uint32_t k = 0; k < count; ++k) {
+        if (unique == 0 || labels[unique - 1] != labels[k]) {
+          labels[unique++] = labels[k];
+        }
+      }
+      if (unique > 0) {
+        dfa->accepts[i + 1] = dfa_accept_list(dfa, lists, labels, unique, &capacity);
+      }
+    }
+    free(labels);
+    g_hash_table_destroy(lists);
+  } else {
+    free(transitions);
+    free(counts);
+  }
+
+  g_ptr_array_free(sets, true);
+  g_hash_table_destroy(index);
+  free(work.next);
+  free(work.stamps);
+  free(node_labels);
+  dfa_nfa_clear(&(work.nfa));
+  return ok;
+}
+
+/** Returns the target of the edge of a DFA node by a symbol, SIZE_MAX if none. */
+static fa_id_t dfa_frozen_target(const fa_frozen_t* fa, fa_id_t node, uint32_t symbol) {
+  for (size_t e = fa->offsets[node]; e < fa->offsets[node + 1]; ++e) {
+    if (fa->edge_symbols[e] == symbol) {
+      return fa->edge_targets[e];
+    }
+  }
+  return SIZE_MAX;
+}
+
+/**
+ * Makes every context edge of a powerset DFA lead to the node reached by
+ * following its class until nothing changes. Context edges loop on every
+ * NFA node, so the sets only grow and a fixpoint exists; one step per
+ * position then passes any run of assertions, e.g. ^\b.
+ */
+static void dfa_close_contexts(const dfa_t* dfa, fa_frozen_t* fa, const uint32_t* symbol_classes) {
+  for (fa_id_t q = 0; q < fa->nodes_count; ++q) {
+    for (size_t e = fa->offsets[q]; e < fa->offsets[q + 1]; ++e) {
+      uint32_t symbol = fa->edge_symbols[e];
+      if (symbol == FA_EPSILON || (symbol_classes[symbol] & DFA_SYMBOL_MARKER)
+          || symbol_classes[symbol] < dfa_chars_count(dfa)) {
+        continue;
+      }
+      fa_id_t to = fa->edge_targets[e];
+      for (size_t i = 0; i < fa->nodes_count; ++i) {
+        fa_id_t next = dfa_frozen_target(fa, to, symbol);
+        if (next == to || next == SIZE_MAX) {
+          break;
+        }
+        to = next;
+      }
+      fa->edge_targets[e] = to;
+    }
+  }
+}
+
+/** Fills the tables of a DFA from a DFA over classes and marker symbols. */
+static void dfa_build_states(dfa_t* dfa, const fa_frozen_t* fa, const uint32_t* symbol_classes,
+  size_t labels_count) {
+  // Shift states by one to make room for the dead state
+  dfa->states_count = (uint32_t)fa->nodes_count + 1;
+  dfa->transitions = calloc((size_t)dfa->states_count * dfa->classes_count, sizeof(uint32_t));
+  dfa->accepts = calloc(dfa->states_count, sizeof(uint32_t));
+
+  uint32_t capacity = 16;
+  dfa->accept_lists = malloc(capacity * sizeof(uint32_t));
+  dfa->accept_lists[0] = 0; // no labels
+  dfa->accept_lists_size = 1;
+  GHashTable* lists = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  uint32_t* accepted = malloc(MAX(labels_count, 1) * sizeof(uint32_t));
+
+  for (fa_id_t id = 0; id < fa->nodes_count; ++id) {
+    uint32_t accepted_count = 0;
+
+    if (fa->starting[id]) {
+      dfa->start = (uint32_t)id + 1;
+    }
+    for (size_t e = fa->offsets[id]; e < fa->offsets[id + 1]; ++e) {
+      uint32_t cls = symbol_classes[fa->edge_symbols[e]];
+      if (cls & DFA_SYMBOL_MARKER) {
+        accepted[accepted_count++] = cls & ~DFA_SYMBOL_MARKER;
+        continue;
+      }
+      dfa->transitions[(size_t)(id + 1) * dfa->classes_count + cls] = (uint32_t)fa->edge_targets[e] + 1;
+    }
+
+    if (accepted_count > 0) {
+      dfa->accepts[id + 1] = dfa_accept_list(dfa, lists, accepted, accepted_count, &capacity);
+    }
+  }
+  free(accepted);
+  g_hash_table_destroy(lists);
+}
+
+/**
+ * Creates the bit-parallel form of a class NFA built from one NFA without
+ * assertions. Positions are the nodes entered by class edges, they must be
+ * entered from a single node each, as in a Thompson NFA.
+ *
+ * @returns the automaton, or NULL if there are more than 64 positions
+ */
+static dfa_shift_and_t* dfa_shift_and_from_nfa(dfa_t* dfa, const fa_frozen_t* cnfa,
+  const uint32_t* symbol_classes) {
+  size_t n = cnfa->nodes_count;
+  int* positions = malloc(MAX(n, 1) * sizeof(int));
+  fa_id_t* sources = malloc(MAX(n, 1) * sizeof(fa_id_t));
+  fa_id_t nodes[64];
+  uint32_t count = 0;
+  bool ok = true;
+
+  dfa_shift_and_t* sa = calloc(1, sizeof(dfa_shift_and_t));
+  sa->class_masks = calloc(dfa->classes_count, sizeof(uint64_t));
+
+  for (size_t i = 0; i < n; ++i) {
+    positions[i] = -1;
+  }
+  positions[0] = (int)count;
+  nodes[count++] = 0;
+
+  for (fa_id_t from = 0; from < n && ok; ++from) {
+    for (size_t e = cnfa->offsets[from]; e < cnfa->offsets[from + 1]; ++e) {
+      if (cnfa->edge_symbols[e] == FA_EPSILON) {
+        continue;
+      }
+      uint32_t cls = symbol_classes[cnfa->edge_symbols[e]];
+      if (cls & DFA_SYMBOL_MARKER) {
+        continue;
+      }
+      fa_id_t to = cnfa->edge_targets[e];
+      if (positions[to] < 0) {
+        if (count == 64) {
+          ok = false;
+          break;
+        }
+        positions[to] = (int)count;
+        sources[to] = from;
+        nodes[count++] = to;
+      } else if (positions[to] == 0 || sources[to] != from) {
+        ok = false;
+        break;
+      }
+      sa->class_masks[cls] |= (uint64_t)1 << positions[to];
+    }
+  }
+
+  uint64_t* follows = calloc(64, sizeof(uint64_t));
+  fa_id_t* stack = malloc(MAX(n, 1) * sizeof(fa_id_t));
+  size_t* stamps = calloc(MAX(n, 1), sizeof(size_t));
+
+  // Positions following a position are entered from its epsilon closure
+  for (uint32_t p = 0; p < count && ok; ++p) {
+    size_t top = 0;
+    stack[top++] = nodes[p];
+    stamps[nodes[p]] = p + 1;
+    while (top > 0) {
+      fa_id_t q = stack[--top];
+      for (size_t e = cnfa->offsets[q]; e < cnfa->offsets[q + 1]; ++e) {
+        fa_id_t to = cnfa->edge_targets[e];
+        if (cnfa->edge_symbols[e] == FA_EPSILON) {
+          if (stamps[to] != p + 1) {
+            stamps[to] = p + 1;
+            stack[top++] = to;
+          }
+        } else if (symbol_classes[cnfa->edge_symbols[e]] & DFA_SYMBOL_MARKER) {
+          sa->finals |= (uint64_t)1 << p;
+        } else {
+          follows[p] |= (uint64_t)1 << positions[to];
+        }
+      }
+    }
+  }
+
+  if (ok) {
+    sa->positions_count = count;
+    sa->tables_count = (count + 7) / 8;
+    sa->follow = calloc((size_t)sa->tables_count * 256, sizeof(uint64_t));
+    for (uint32_t t = 0; t < sa->tables_count; ++t) {
+      for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint64_t follow = 0;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+          if (byte & (1u << bit)) {
+            follow |= follows[t * 8 + bit];
+          }
+        }
+        sa->follow[t * 256 + byte] = follow;
+      }
+    }
+  } else {
+    free(sa->class_masks);
+    free(sa);
+    sa = NULL;
+  }
+
+  free(stamps);
+  free(stack);
+  free(follows);
+  free(sources);
+  free(positions);
+  return sa;
+}
+
+static void dfa_shift_and_destroy(dfa_shift_and_t* sa) {
+  free(sa->class_masks);
+  free(sa->follow);
+  free(sa);
+}
+
+static dfa_shift_and_t* dfa_shift_and_copy(const dfa_shift_and_t* sa, uint32_t classes_count) {
+  dfa_shift_and_t* copy = memdup(sa, sizeof(dfa_shift_and_t));
+  copy->class_masks = memdup(sa->class_masks, classes_count * sizeof(uint64_t));
+  copy->follow = memdup(sa->follow, (size_t)sa->tables_count * 256 * sizeof(uint64_t));
+  return copy;
+}
+
+dfa_t* dfa_create_union(fa_t** nfas, const char** labels, size_t nfas_count,
+  const char** symbols, const dfa_predicate_t* predicates, size_t count) {
+  dfa_t* dfa = calloc(1, sizeof(dfa_t));
+
+  GHashTable* symbol_index = g_hash_table_new(g_str_hash, g_str_equal);
+  for (size_t i = 0; i < count; ++i) {
+    g_hash_table_insert(symbol_index, (gpointer)symbols[i], GUINT_TO_POINTER(i + 1));
+  }
+
+  dfa_classes_t classes = {
+    .index = g_hash_table_new(dfa_signature_hash, dfa_signature_equal),
+    .signatures = NULL,
+    .count = 0,
+    .capacity = 0,
+    .words = MAX((count + 63) / 64, 1),
+  };
+  dfa_build_classes(dfa, &classes, predicates, count);
+  for (size_t i = 0; i < count; ++i) {
+    dfa->flags |= dfa_predicate_flags[predicates[i].type];
+  }
+  dfa_build_contexts(dfa, classes.count);
+
+  char** class_symbols = malloc(dfa->classes_count * sizeof(char*));
+  for (uint32_t c = 0; c < dfa->classes_count; ++c) {
+    class_symbols[c] = g_strdup_printf("%u", c);
+  }
+
+  // Edges keep symbol pointers, so the symbols must outlive the automata
+  char** markers = malloc(MAX(nfas_count, 1) * sizeof(char*));
+  for (size_t i = 0; i < nfas_count; ++i) {
+    markers[i] = g_strdup_printf("%c%zu", DFA_MARKER, i);
+  }
+
+  dfa_counter_t counter = dfa_counter_choose(nfas, nfas_count, symbol_index, predicates);
+  fa_t* cnfa = dfa_class_nfa(dfa, &classes, nfas, nfas_count, markers,
+    symbol_index, predicates, class_symbols, &counter);
+  fa_frozen_t* frozen = fa_freeze(cnfa);
+  fa_destroy(cnfa);
+  uint32_t* symbol_classes = dfa_symbol_classes(frozen);
+
+  if (counter.edge && !dfa_counted_from_nfa(dfa, frozen, symbol_classes, &counter)) {
+    // The counts overlap, the repetition is expanded as the others
+    free(symbol_classes);
+    fa_frozen_destroy(frozen);
+    counter.edge = NULL;
+    cnfa = dfa_class_nfa(dfa, &classes, nfas, nfas_count, markers,
+      symbol_index, predicates, class_symbols, &counter);
+    frozen = fa_freeze(cnfa);
+    fa_destroy(cnfa);
+    symbol_classes = dfa_symbol_classes(frozen);
+  }
+
+  if (!counter.edge) {
+    if (nfas_count == 1 && !dfa->flags) {
+      dfa->shift_and = dfa_shift_and_from_nfa(dfa, frozen, symbol_classes);
+    }
+
+    // Powerset and minimization keep the symbol ids of the frozen NFA
+    fa_frozen_t* powerset = fa_frozen_powerset(frozen, DFA_MAX_STATES);
+    if (powerset && dfa->contexts_count) {
+      // Closed context edges skip states, which are dropped by another pass
+      dfa_close_contexts(dfa, powerset, symbol_classes);
+      fa_frozen_t* reachable = fa_frozen_powerset(powerset, SIZE_MAX);
+      fa_frozen_destroy(powerset);
+      powerset = reachable;
+    }
+    if (powerset) {
+      fa_frozen_t* minimal = fa_frozen_minimize(powerset);
+      fa_frozen_destroy(powerset);
+      dfa_build_states(dfa, minimal, symbol_classes, nfas_count);
+      fa_frozen_destroy(minimal);
+    } else {
+      // Too many states, run the NFA and cache the states reached
+      dfa_lazy_from_nfa(dfa, frozen, symbol_classes);
+    }
+  }
+  free(symbol_classes);
+  fa_frozen_destroy(frozen);
+
+  dfa->labels_count = (uint32_t)nfas_count;
+  dfa->labels = malloc(MAX(nfas_count, 1) * sizeof(char*));
+  for (size_t i = 0; i < nfas_count; ++i) {
+    dfa->labels[i] = strdup(labels[i]);
+  }
+
+  for (size_t i = 0; i < nfas_count; ++i) {
+    free(markers[i]);
+  }
+  free(markers);
+  for (uint32_t c = 0; c < dfa->classes_count; ++c) {
+    free(class_symbols[c]);
+  }
+  free(class_symbols);
+  for (uint32_t c = 0; c < classes.count; ++c) {
+    free(classes.signatures[c]);
+  }
+  free(classes.signatures);
+  g_hash_table_destroy(classes.index);
+  g_hash_table_destroy(symbol_index);
+
+  return dfa;
+}
+
+dfa_t* dfa_create(fa_t* nfa, const char** symbols,
+  const dfa_predicate_t* predicates, size_t count, const char* label) {
+  return dfa_create_union(&nfa, &label, 1, symbols, predicates, count);
+}
+
+dfa_t* dfa_borrow(const dfa_t* dfa) {
+  if (dfa->lazy) {
+    return dfa_copy(dfa);
+  }
+  dfa_t* view = memdup(dfa, sizeof(dfa_t));
+  view->labels = memdup(dfa->labels, dfa->labels_count * sizeof(char*));
+  view->borrowed = true;
+  return view;
+}
+
+dfa_t* dfa_copy(const dfa_t* dfa) {
+  dfa_t* copy = memdup(dfa, sizeof(dfa_t));
+  copy->borrowed = false;
+  copy->interval_starts = memdup(dfa->interval_starts, dfa->intervals_count * sizeof(uint32_t));
+  copy->interval_classes = memdup(dfa->interval_classes, dfa->intervals_count * sizeof(uint32_t));
+  copy->rows = memdup(dfa->rows, (size_t)dfa->rows_count * DFA_CATEGORIES * sizeof(uint16_t));
+  if (dfa->shift_and) {
+    copy->shift_and = dfa_shift_and_copy(dfa->shift_and, dfa->classes_count);
+  }
+  if (dfa->lazy) {
+    dfa_lazy_copy(copy, dfa->lazy);
+  } else {
+    copy->counts = memdup(dfa->counts, dfa->states_count * sizeof(dfa_count_t));
+    copy->transitions = memdup(dfa->transitions,
+      (size_t)dfa->states_count * dfa->classes_count * sizeof(uint32_t));
+    copy->accepts = memdup(dfa->accepts, dfa->states_count * sizeof(uint32_t));
+    copy->accept_lists = memdup(dfa->accept_lists, dfa->accept_lists_size * sizeof(uint32_t));
+  }
+  copy->labels = malloc(dfa->labels_count * sizeof(char*));
+  for (uint32_t i = 0; i < dfa->labels_count; ++i) {
+    copy->labels[i] = strdup(dfa->labels[i]);
+  }
+  return copy;
+}
+
+void dfa_destroy(dfa_t* dfa) {
+  if (dfa->borrowed) {
+    free(dfa->labels);
+    free(dfa);
+    return;
+  }
+  if (dfa->shift_and) {
+    dfa_shift_and_destroy(dfa->shift_and);
+  }
+  if (dfa->lazy) {
+    dfa_lazy_destroy(dfa);
+  }
+  free(dfa->interval_starts);
+  free(dfa->interval_classes);
+  free(dfa->rows);
+  free(dfa->transitions);
+  free(dfa->counts);
+  free(dfa->accepts);
+  free(dfa->accept_lists);
+  for (uint32_t i = 0; i < dfa->labels_count; ++i) {
+    free(dfa->labels[i]);
+  }
+  free(dfa->labels);
+  free(dfa);
+}
+
+dfa_t* dfa_create_unanchored(const dfa_t* dfa) {
+  if (dfa->flags || dfa->labels_count != 1 || dfa->lazy || dfa->counts) {
+    return NULL;
+  }
+
+  // States of the DFA reached by a character and a restart state u
+  uint32_t u = dfa->states_count;
+  uint32_t chars = dfa_chars_count(dfa);
+  dfa_nfa_t nfa;
+  dfa_nfa_init(&nfa, dfa->states_count + 1, chars, u);
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t c = 0; c < chars; ++c) {
+      for (uint32_t s = 1; s < dfa->states_count; ++s) {
+        uint32_t to = dfa_step(dfa, s, c);
+        if (to != DFA_DEAD) {
+          dfa_nfa_link(&nfa, pass, s, c, to);
+        }
+      }
+      dfa_nfa_link(&nfa, pass, u, c, u);
+      uint32_t to = dfa_step(dfa, dfa->start, c);
+      if (to != DFA_DEAD) {
+        dfa_nfa_link(&nfa, pass, u, c, to);
+      }
+    }
+    if (!pass) {
+      dfa_nfa_allocate(&nfa);
+    }
+  }
+
+  // u stands for the empty match, which is never reported
+  for (uint32_t s = 1; s < dfa->states_count; ++s) {
+    nfa.finals[s] = dfa_is_accepting(dfa, s);
+  }
+
+  dfa_t* out = dfa_subset(dfa, &nfa);
+  dfa_nfa_clear(&nfa);
+  return out;
+}
+
+dfa_t* dfa_create_reverse(const dfa_t* dfa) {
+  if (dfa->flags || dfa->labels_count != 1 || dfa->lazy || dfa->counts) {
+    return NULL;
+  }
+
+  // Reversed transitions and a state r entering the accepting states
+  uint32_t r = dfa->states_count;
+  uint32_t chars = dfa_chars_count(dfa);
+  dfa_nfa_t nfa;
+  dfa_nfa_init(&nfa, dfa->states_count + 1, chars, r);
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t s = 1; s < dfa->states_count; ++s) {
+      for (uint32_t c = 0; c < chars; ++c) {
+        uint32_t to = dfa_step(dfa, s, c);
+        if (to == DFA_DEAD) {
+          continue;
+        }
+        dfa_nfa_link(&nfa, pass, to, c, s);
+        if (dfa_is_accepting(dfa, to)) {
+          dfa_nfa_link(&nfa, pass, r, c, s);
+        }
+      }
+    }
+    if (!pass) {
+      dfa_nfa_allocate(&nfa);
+    }
+  }
+
+  nfa.finals[dfa->start] = true;
+
+  dfa_t* out = dfa_subset(dfa, &nfa);
+  dfa_nfa_clear(&nfa);
+  return out;
+}
+
+uint32_t dfa_class_unicode(const dfa_t* dfa, const char* c) {
+  gunichar cp = g_utf8_get_char(c);
+  if (cp >= 0x110000) {
+    return 0;
+  }
+
+  // The last interval starting at or before the code point
+  uint32_t lo = 0;
+  uint32_t hi = dfa->intervals_count;
+  while (hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if (dfa->interval_starts[mid] <= cp) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  uint32_t entry = dfa->interval_classes[lo];
+  if (entry & DFA_CLASS_CONSTANT) {
+    return entry & ~DFA_CLASS_CONSTANT;
+  }
+  return dfa->rows[(size_t)entry * DFA_CATEGORIES + g_unichar_type(cp)];
+}
+
+/** Appends data aligned to 8 bytes and returns its offset. */
+static uint64_t dfa_file_append(GString* out, const void* data, size_t size) {
+  while (out->len % 8) {
+    g_string_append_c(out, '\0');
+  }
+  uint64_t offset = out->len;
+  g_string_append_len(out, data, size);
+  return offset;
+}
+
+bool dfa_save(const char* path, dfa_t** dfas, const char** namings,
+  const char** exprs, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (dfas[i]->lazy) {
+      return false;
+    }
+  }
+
+  dfa_file_header_t header;
+  memset(&header, 0, sizeof(dfa_file_header_t));
+  memcpy(&(header.magic_str), DFA_FILE_MAGIC, sizeof(char) * 5);
+  header.version = DFA_FILE_VERSION;
+  header.byte_order = DFA_FILE_BYTE_ORDER;
+  header.dfas_count = (uint32_t)count;
+
+  dfa_file_entry_t* entries = calloc(MAX(count, 1), sizeof(dfa_file_entry_t));
+  GString* out = g_string_new_len((const char*)&header, sizeof(dfa_file_header_t));
+  // Entries are written again once the offsets are known
+  header.entries_offset = dfa_file_append(out, entries, count * sizeof(dfa_file_entry_t));
+
+  for (size_t i = 0; i < count; ++i) {
+    const dfa_t* dfa = dfas[i];
+    dfa_file_entry_t* entry = &(entries[i]);
+    entry->states_count = dfa->states_count;
+    entry->classes_count = dfa->classes_count;
+    entry->start = dfa->start;
+    entry->flags = dfa->flags;
+    entry->contexts_count = dfa->contexts_count;
+    memcpy(entry->context_classes, dfa->context_classes, sizeof(dfa->context_classes));
+    entry->intervals_count = dfa->intervals_count;
+    entry->rows_count = dfa->rows_count;
+    entry->accept_lists_size = dfa->accept_lists_size;
+    entry->labels_count = dfa->labels_count;
+    memcpy(entry->ascii_classes, dfa->ascii_classes, sizeof(dfa->ascii_classes));
+
+    entry->interval_starts_offset = dfa_file_append(out, dfa->interval_starts,
+      dfa->intervals_count * sizeof(uint32_t));
+    entry->interval_classes_offset = dfa_file_append(out, dfa->interval_classes,
+      dfa->intervals_count * sizeof(uint32_t));
+    entry->rows_offset = dfa_file_append(out, dfa->rows,
+      (size_t)dfa->rows_count * DFA_CATEGORIES * sizeof(uint16_t));
+    entry->transitions_offset = dfa_file_append(out, dfa->transitions,
+      (size_t)dfa->states_count * dfa->classes_count * sizeof(uint32_t));
+    entry->accepts_offset = dfa_file_append(out, dfa->accepts,
+      dfa->states_count * sizeof(uint32_t));
+    entry->accept_lists_offset = dfa_file_append(out, dfa->accept_lists,
+      dfa->accept_lists_size * sizeof(uint32_t));
+    if (dfa->counts) {
+      entry->counts_offset = dfa_file_append(out, dfa->counts,
+        dfa->states_count * sizeof(dfa_count_t));
+    }
+
+    uint64_t* labels = malloc(MAX(dfa->labels_count, 1) * sizeof(uint64_t));
+    for (uint32_t l = 0; l < dfa->labels_count; ++l) {
+      labels[l] = dfa_file_append(out, dfa->labels[l], strlen(dfa->labels[l]) + 1);
+    }
+    entry->labels_offset = dfa_file_append(out, labels, dfa->labels_count * sizeof(uint64_t));
+    free(labels);
+
+    entry->naming_offset = dfa_file_append(out, namings[i], strlen(namings[i]) + 1);
+    entry->expr_offset = dfa_file_append(out, exprs[i], strlen(exprs[i]) + 1);
+  }
+
+  header.size = out->len;
+  memcpy(out->str, &header, sizeof(dfa_file_header_t));
+  memcpy(out->str + header.entries_offset, entries, count * sizeof(dfa_file_entry_t));
+  free(entries);
+
+  FILE* f = fopen(path, "wb");
+  bool ok = (f != NULL);
+  if (f) {
+    ok = (fwrite(out->str, sizeof(char), out->len, f) == out->len);
+    ok &= (fclose(f) == 0);
+  }
+  g_string_free(out, true);
+  return ok;
+}
+
+/**
+ * Returns true if `count` items of `item_size` bytes at `offset` lie inside
+ * a mapped file of `size` bytes, aligned to 8 bytes like dfa_save writes them.
+ */
+static bool dfa_file_fits(uint64_t size, uint64_t offset, uint64_t count,
+  uint64_t item_size) {
+  return offset <= size
+    && offset % 8 == 0
+    && count <= (size - offset) / item_size;
+}
+
+/** Returns true if a NUL terminated string starts at `offset` in the file. */
+static bool dfa_file_string(const char* start, uint64_t size, uint64_t offset) {
+  return offset < size && memchr(start + offset, '\0', size - offset) != NULL;
+}
+
+/**
+ * Checks a DFA of a mapped file before it is used in place: all its tables
+ * and strings lie inside the file and every state, class, row, accept list
+ * and label index they hold is in range, so matching never reads outside.
+ */
+static bool dfa_file_entry_valid(const char* start, uint64_t size,
+  const dfa_file_entry_t* entry) {
+  uint64_t states = entry->states_count;
+  uint64_t classes = entry->classes_count;
+  uint64_t cells = states * classes;
+  uint64_t row_cells = (uint64_t)entry->rows_count * DFA_CATEGORIES;
+
+  if (states == 0 || classes == 0 || entry->start >= states
+      || entry->intervals_count == 0 || entry->accept_lists_size == 0
+      || entry->contexts_count > DFA_CONTEXTS || entry->contexts_count >= classes
+      || !dfa_file_fits(size, entry->interval_starts_offset, entry->intervals_count, sizeof(uint32_t))
+      || !dfa_file_fits(size, entry->interval_classes_offset, entry->intervals_count, sizeof(uint32_t))
+      || !dfa_file_fits(size, entry->rows_offset, row_cells, sizeof(uint16_t))
+      || !dfa_file_fits(size, entry->transitions_offset, cells, sizeof(uint32_t))
+      || !dfa_file_fits(size, entry->accepts_offset, states, sizeof(uint32_t))
+      || !dfa_file_fits(size, entry->accept_lists_offset, entry->accept_lists_size, sizeof(uint32_t))
+      || !dfa_file_fits(size, entry->labels_offset, entry->labels_count, sizeof(uint64_t))
+      || !dfa_file_string(start, size, entry->naming_offset)
+      || !dfa_file_string(start, size, entry->expr_offset)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < entry->contexts_count; ++i) {
+    if (entry->context_classes[i] >= classes) {
+      return false;
+    }
+  }
+  for (uint32_t c = 0; c < 128; ++c) {
+    if (entry->ascii_classes[c] >= classes) {
+      return false;
+    }
+  }
+
+  const uint32_t* interval_classes = (const uint32_t*)(start + entry->interval_classes_offset);
+  for (uint32_t i = 0; i < entry->intervals_count; ++i) {
+    uint32_t cls = interval_classes[i];
+    if ((cls & DFA_CLASS_CONSTANT)
+        ? (cls & ~DFA_CLASS_CONSTANT) >= classes
+        : cls >= entry->rows_count) {
+      return false;
+    }
+  }
+
+  const uint16_t* rows = (const uint16_t*)(start + entry->rows_offset);
+  for (uint64_t i = 0; i < row_cells; ++i) {
+    if (rows[i] >= classes) {
+      return false;
+    }
+  }
+
+  const uint32_t* transitions = (const uint32_t*)(start + entry->transitions_offset);
+  for (uint64_t i = 0; i < cells; ++i) {
+    if (transitions[i] >= states) {
+      return false;
+    }
+  }
+
+  const uint32_t* accepts = (const uint32_t*)(start + entry->accepts_offset);
+  const uint32_t* accept_lists = (const uint32_t*)(start + entry->accept_lists_offset);
+  for (uint32_t s = 0; s < states; ++s) {
+    uint32_t list = accepts[s];
+    if (list >= entry->accept_lists_size
+        || accept_lists[list] >= entry->accept_lists_size - list) {
+      return false;
+    }
+    for (uint32_t l = 1; l <= accept_lists[list]; ++l) {
+      if (accept_lists[list + l] >= entry->labels_count) {
+        return false;
+      }
+    }
+  }
+
+  const uint64_t* labels = (const uint64_t*)(start + entry->labels_offset);
+  for (uint32_t l = 0; l < entry->labels_count; ++l) {
+    if (!dfa_file_string(start, size, labels[l])) {
+      return false;
+    }
+  }
+
+  if (entry->counts_offset) {
+    if (!dfa_file_fits(size, entry->counts_offset, states, sizeof(dfa_count_t))) {
+      return false;
+    }
+    const dfa_count_t* counts = (const dfa_count_t*)(start + entry->counts_offset);
+    for (uint32_t s = 0; s < states; ++s) {
+      if (counts[s].op > DFA_COUNT_INCREMENT || counts[s].next >= states) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+dfa_file_c* dfa_file_c_from_file(const char* path) {
+  stream_file_c* file_stream = stream_file_c_new(path);
+
+  if (file_stream->stream.state_flags & STREAM_FAILED) {
+    DESTROY(file_stream);
+    return NULL;
+  }
+
+  char* start = file_stream->stream.start;
+  uint64_t size = (uint64_t)file_stream->stream.fsize;
+  dfa_file_header_t* header = (dfa_file_header_t*)start;
+
+  if (size < sizeof(dfa_file_header_t)
+      || memcmp(header->magic_str, DFA_FILE_MAGIC, sizeof(char) * 5) != 0
+      || header->version != DFA_FILE_VERSION
+      || header->byte_order != DFA_FILE_BYTE_ORDER
+      || header->size != size
+      || !dfa_file_fits(size, header->entries_offset, header->dfas_count, sizeof(dfa_file_entry_t))) {
+    DESTROY(file_stream);
+    return NULL;
+  }
+
+  dfa_file_entry_t* entries = (dfa_file_entry_t*)(start + header->entries_offset);
+  for (size_t i = 0; i < header->dfas_count; ++i) {
+    if (!dfa_file_entry_valid(start, size, &(entries[i]))) {
+      DESTROY(file_stream);
+      return NULL;
+    }
+  }
+
+  dfa_file_c* self = ALLOC(dfa_file_c);
+  self->mmap_binary = file_stream;
+  self->dfas_count = header->dfas_count;
+  self->dfas = malloc(MAX(self->dfas_count, 1) * sizeof(dfa_t*));
+  self->namings = malloc(MAX(self->dfas_count, 1) * sizeof(char*));
+  self->exprs = malloc(MAX(self->dfas_count, 1) * sizeof(char*));
+
+  for (size_t i = 0; i < self->dfas_count; ++i) {
+    dfa_file_entry_t* entry = &(entries[i]);
+    dfa_t* dfa = calloc(1, sizeof(dfa_t));
+    dfa->states_count = entry->states_count;
+    dfa->classes_count = entry->classes_count;
+    dfa->start = entry->start;
+    dfa->flags = entry->flags;
+    dfa->contexts_count = entry->contexts_count;
+    memcpy(dfa->context_classes, entry->context_classes, sizeof(dfa->context_classes));
+    memcpy(dfa->ascii_classes, entry->ascii_classes, sizeof(dfa->ascii_classes));
+    dfa->intervals_count = entry->intervals_count;
+    dfa->interval_starts = (uint32_t*)(start + entry->interval_starts_offset);
+    dfa->interval_classes = (uint32_t*)(start + entry->interval_classes_offset);
+    dfa->rows_count = entry->rows_count;
+    dfa->rows = (uint16_t*)(start + entry->rows_offset);
+    dfa->transitions = (uint32_t*)(start + entry->transitions_offset);
+    dfa->accepts = (uint32_t*)(start + entry->accepts_offset);
+    dfa->accept_lists_size = entry->accept_lists_size;
+    dfa->accept_lists = (uint32_t*)(start + entry->accept_lists_offset);
+    dfa->counts = entry->counts_offset ? (dfa_count_t*)(start + entry->counts_offset) : NULL;
+    dfa->labels_count = entry->labels_count;
+    dfa->labels = malloc(MAX(entry->labels_count, 1) * sizeof(char*));
+    uint64_t* labels = (uint64_t*)(start + entry->labels_offset);
+    for (uint32_t l = 0; l < entry->labels_count; ++l) {
+      dfa->labels[l] = start + labels[l];
+    }
+    dfa->borrowed = true;
+
+    self->dfas[i] = dfa;
+    self->namings[i] = start + entry->naming_offset;
+    self->exprs[i] = start + entry->expr_offset;
+  }
+
+  return self;
+}
+
+void dfa_file_c_destroy(dfa_file_c* self) {
+  for (size_t i = 0; i < self->dfas_count; ++i) {
+    dfa_destroy(self->dfas[i]);
+  }
+  free(self->dfas);
+  free(self->namings);
+  free(self->exprs);
+  DESTROY(self->mmap_binary);
+  free(self);
+}
@@ -0,0 +1,396 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <nativeextractor/dfa_miner.h>
+
+/**
+ * Runs the DFA from the current position and remembers the last accept. The
+ * counter of a counted repetition is per match.
+ */
+static occurrence_t *match_dfa(miner_c *m) {
+  dfa_t *dfa = ((dfa_miner_c *)m)->dfa;
+  stream_c *stream = m->stream;
+
+  if (!m->mark_start(m)) {
+    return NULL;
+  }
+
+  char *pos = stream->pos;
+  char *end = stream->end;
+  uint64_t offset = stream->unicode_offset;
+  uint32_t state = dfa->start;
+  uint32_t counter = 0;
+  uint32_t kind = dfa->contexts_count ? dfa_kind_before(stream->start, pos) : DFA_KIND_NONE;
+  dfa_assert(dfa, &state, &kind, pos, end);
+
+  mark_t accept = { NULL, 0, 0 };
+  if (dfa_is_accepting(dfa, state)) {
+    accept = (mark_t){ pos, offset, 0 };
+  }
+
+  while (pos < end) {
+    state = dfa_next(dfa, state, dfa_class(dfa, pos));
+    if (state == DFA_DEAD) {
+      break;
+    }
+    if (dfa->counts) {
+      state = dfa_count(dfa, state, &counter);
+    }
+
+    dfa_advance(&pos, &offset, end);
+    dfa_assert(dfa, &state, &kind, pos, end);
+
+    if (dfa_is_accepting(dfa, state)) {
+      accept = (mark_t){ pos, offset, 0 };
+    }
+  }
+
+  if (!accept.pos) {
+    return NULL;
+  }
+
+  m->reset_pos(m, &accept);
+  m->mark_end(m);
+  return m->make_occurrence(m, 1.0);
+}
+
+/** Moves a local copy of the stream position back by one character. */
+static inline char *dfa_miner_retreat(char *pos, char *lower) {
+  do {
+    --pos;
+  } while (pos > lower && ((uint8_t)*pos & 0xC0) == 0x80);
+  return pos;
+}
+
+/**
+ * Returns the end of the longest nonempty match of a DFA without anchors
+ * starting at `pos`, NULL if there is none.
+ */
+static char *dfa_miner_longest(const dfa_t *dfa, char *pos, uint64_t offset,
+  char *end, uint64_t *end_offset) {
+  uint32_t state = dfa->start;
+  char *accept = NULL;
+
+  while (pos < end) {
+    state = dfa_step(dfa, state, dfa_class(dfa, pos));
+    if (state == DFA_DEAD) {
+      break;
+    }
+    dfa_advance(&pos, &offset, end);
+    if (dfa_is_accepting(dfa, state)) {
+      accept = pos;
+      *end_offset = offset;
+    }
+  }
+
+  return accept;
+}
+
+/**
+ * Finds the leftmost-longest nonempty match starting at or after `from`.
+ * The unanchored DFA finds where the first match ends and where the last
+ * restart before it was, the reverse DFA finds the leftmost start of a
+ * match ending there. A match starting in between may still be longer, so
+ * the DFA is run from these positions only.
+ */
+static void dfa_miner_scan(dfa_miner_c *self, char *from, uint64_t offset, char *end) {
+  const dfa_t *unanchored = self->unanchored;
+  const dfa_t *reverse = self->reverse;
+  char *pos = from;
+  mark_t restart = { from, offset, 0 };
+  uint32_t state = unanchored->start;
+
+  self->scan_from = from;
+  self->next_end.pos = NULL;
+
+  while (pos < end && !dfa_is_accepting(unanchored, state)) {
+    if (state == unanchored->start) {
+      restart = (mark_t){ pos, offset, 0 };
+    }
+    state = dfa_step(unanchored, state, dfa_class(unanchored, pos));
+    dfa_advance(&pos, &offset, end);
+  }
+
+  if (!dfa_is_accepting(unanchored, state)) {
+    // No match up to the end of the stream
+    self->next_start = (mark_t){ pos, offset, 0 };
+    return;
+  }
+
+  char *first = NULL;
+  state = reverse->start;
+  for (char *p = pos; p > restart.pos && state != DFA_DEAD;) {
+    p = dfa_miner_retreat(p, restart.pos);
+    state = dfa_step(reverse, state, dfa_class(reverse, p));
+    if (dfa_is_accepting(reverse, state)) {
+      first = p;
+    }
+  }
+
+  // Without a start (invalid UTF-8 read backwards) all positions are tried
+  pos = restart.pos;
+  offset = restart.unicode_offset;
+  while (pos < end && (!first || pos <= first)) {
+    uint64_t end_offset = 0;
+    char *match_end = dfa_miner_longest(self->dfa, pos, offset, end, &end_offset);
+    if (match_end) {
+      self->next_start = (mark_t){ pos, offset, 0 };
+      self->next_end = (mark_t){ match_end, end_offset, 0 };
+      return;
+    }
+    dfa_advance(&pos, &offset, end);
+  }
+  self->next_start = (mark_t){ pos, offset, 0 };
+}
+
+/**
+ * Reports matches found by dfa_miner_scan. Positions before the next match
+ * are skipped at once by moving the stream to its start.
+ */
+static occurrence_t *match_dfa_scan(miner_c *m) {
+  dfa_miner_c *self = (dfa_miner_c *)m;
+  stream_c *stream = m->stream;
+
+  // Positions inside tokens are not run, so the miner cannot skip them
+  if (m->token_anchored) {
+    return match_dfa(m);
+  }
+
+  if (!m->mark_start(m)) {
+    return NULL;
+  }
+
+  char *pos = stream->pos;
+  if (!self->scan_from || pos < self->scan_from || pos > self->next_start.pos) {
+    dfa_miner_scan(self, pos, stream->unicode_offset, stream->end);
+  }
+
+  if (pos < self->next_start.pos) {
+    m->reset_pos(m, &(self->next_start));
+    return NULL;
+  }
+  if (!self->next_end.pos) {
+    return NULL;
+  }
+
+  self->scan_from = NULL;
+  m->reset_pos(m, &(self->next_end));
+  m->mark_end(m);
+  return m->make_occurrence(m, 1.0);
+}
+
+/**
+ * Records ends of labels accepted in a state. A label is skipped while the
+ * position is inside its previous occurrence, as separate miners would.
+ */
+static inline void dfa_miner_accept(dfa_miner_c *self, uint32_t state,
+  char *start, char *pos, uint64_t offset) {
+  const uint32_t *list = dfa_accepted(self->dfa, state);
+
+  for (uint32_t i = 1; i <= list[0] && pos > start; ++i) {
+    uint32_t label = list[i];
+    if (start < self->last_ends[label] && start != self->last_starts[label]) {
+      continue;
+    }
+    if (!self->accepts[label].pos) {
+      self->accepted[self->accepted_count++] = label;
+    }
+    self->accepts[label] = (mark_t){ pos, offset, 0 };
+  }
+}
+
+static int uint32_t_compare(const void *a, const void *b) {
+  return CMP(*(const uint32_t *)a, *(const uint32_t *)b);
+}
+
+/**
+ * Runs a union DFA from the current position and reports the longest match
+ * of every label. The stream is not moved, so the miner runs at every
+ * position and labels skip their own occurrences only.
+ */
+static occurrence_t *match_dfa_union(miner_c *m) {
+  dfa_miner_c *self = (dfa_miner_c *)m;
+  dfa_t *dfa = self->dfa;
+  stream_c *stream = m->stream;
+
+  char *start = stream->pos;
+  char *pos = stream->pos;
+  char *end = stream->end;
+  uint64_t offset = stream->unicode_offset;
+  uint32_t state = dfa->start;
+  uint32_t counter = 0;
+  uint32_t kind = dfa->contexts_count ? dfa_kind_before(stream->start, pos) : DFA_KIND_NONE;
+  dfa_assert(dfa, &state, &kind, pos, end);
+
+  self->accepted_count = 0;
+  if (dfa_is_accepting(dfa, state)) {
+    dfa_miner_accept(self, state, start, pos, offset);
+  }
+
+  while (pos < end) {
+    state = dfa_next(dfa, state, dfa_class(dfa, pos));
+    if (state == DFA_DEAD) {
+      break;
+    }
+    if (dfa->counts) {
+      state = dfa_count(dfa, state, &counter);
+    }
+
+    dfa_advance(&pos, &offset, end);
+    dfa_assert(dfa, &state, &kind, pos, end);
+
+    if (dfa_is_accepting(dfa, state)) {
+      dfa_miner_accept(self, state, start, pos, offset);
+    }
+  }
+
+  if (self->accepted_count == 0) {
+    return NULL;
+  }
+
+  qsort(self->accepted, self->accepted_count, sizeof(uint32_t), uint32_t_compare);
+
+  occurrence_t *first = NULL;
+  for (uint32_t i = 0; i < self->accepted_count; ++i) {
+    uint32_t label = self->accepted[i];
+    mark_t *accept = &(self->accepts[label]);
+
+    occurrence_t *o = (m->scratch ? &(m->scratch[i]) : ALLOC(occurrence_t));
+    *o = (occurrence_t) {
+      .str = start,
+      .pos = start - stream->start,
+      .upos = stream->unicode_offset,
+      .len = accept->pos - start,
+      .ulen = accept->unicode_offset - stream->unicode_offset,
+      .prob = 1.0,
+      .label = dfa->labels[label],
+    };
+
+    if (first) {
+      m->pending[m->pending_count++] = o;
+    } else {
+      first = o;
+    }
+
+    self->last_starts[label] = start;
+    self->last_ends[label] = accept->pos;
+    accept->pos = NULL;
+  }
+
+  return first;
+}
+
+static void dfa_miner_c_set_stream(dfa_miner_c *self, stream_c *stream) {
+  self->set_stream_super((miner_c *)self, stream);
+  self->scan_from = NULL;
+  if (self->dfa->labels_count > 1) {
+    memset(self->last_starts, 0, self->dfa->labels_count * sizeof(char *));
+    memset(self->last_ends, 0, self->dfa->labels_count * sizeof(char *));
+  }
+}
+
+/** Allocates per-label state of a union DFA miner. */
+static void dfa_miner_c_init_labels(dfa_miner_c *self) {
+  uint32_t count = self->dfa->labels_count;
+  self->last_starts = NULL;
+  self->last_ends = NULL;
+  self->accepts = NULL;
+  self->accepted = NULL;
+  self->accepted_count = 0;
+  if (count < 2) {
+    return;
+  }
+  self->last_starts = calloc(count, sizeof(char *));
+  self->last_ends = calloc(count, sizeof(char *));
+  self->accepts = calloc(count, sizeof(mark_t));
+  self->accepted = calloc(count, sizeof(uint32_t));
+  self->base.pending = calloc(count, sizeof(occurrence_t *));
+  self->base.pending_count = 0;
+}
+
+static void dfa_miner_c_free_labels(dfa_miner_c *self) {
+  free(self->last_starts);
+  free(self->last_ends);
+  free(self->accepts);
+  free(self->accepted);
+  free(self->base.pending);
+}
+
+/**
+ * Destroys a clone, the DFA is owned by the original miner unless it is
+ * lazy.
+ */
+static void dfa_miner_c_destroy_clone(dfa_miner_c *self) {
+  dfa_miner_c_free_labels(self);
+  if (self->dfa->lazy) {
+    dfa_destroy(self->dfa);
+  }
+  self->destroy_super((miner_c *)self);
+}
+
+dfa_miner_c *dfa_miner_c_clone(dfa_miner_c *self) {
+  dfa_miner_c *clone = ALLOC(dfa_miner_c);
+  miner_c_init_clone(&(clone->base), &(self->base), sizeof(dfa_miner_c));
+  clone->base.destroy = (void (*)(miner_c *self))dfa_miner_c_destroy_clone;
+  clone->scan_from = NULL;
+  if (self->dfa->lazy) {
+    // The state cache is written while matching
+    clone->dfa = dfa_copy(self->dfa);
+  }
+  dfa_miner_c_init_labels(clone);
+  return clone;
+}
+
+dfa_miner_c *dfa_miner_c_create(const char *name, dfa_t *dfa) {
+  dfa_miner_c *miner = ALLOC(dfa_miner_c);
+  bool is_union = (dfa->labels_count > 1);
+
+  miner->unanchored = dfa_create_unanchored(dfa);
+  miner->reverse = (miner->unanchored ? dfa_create_reverse(dfa) : NULL);
+  if (miner->unanchored && !miner->reverse) {
+    dfa_destroy(miner->unanchored);
+    miner->unanchored = NULL;
+  }
+  miner->scan_from = NULL;
+
+  matcher_t matcher = (is_union ? match_dfa_union : match_dfa);
+  if (miner->reverse) {
+    matcher = match_dfa_scan;
+  }
+  miner_c_init(&(miner->base), (name ? name : dfa->labels[0]), NULL, matcher);
+  miner->destroy_super = miner->base.destroy;
+  miner->set_stream_super = miner->base.set_stream;
+  miner->base.destroy = (void (*)(miner_c *self))dfa_miner_c_destroy;
+  miner->base.set_stream = (void (*)(miner_c *self, stream_c *stream))dfa_miner_c_set_stream;
+  miner->base.clone = (miner_c *(*)(miner_c *self))dfa_miner_c_clone;
+  miner->base.max_occurrences = MAX(dfa->labels_count, 1);
+  miner->dfa = dfa;
+  dfa_miner_c_init_labels(miner);
+  return miner;
+}
+
+void dfa_miner_c_destroy(dfa_miner_c *self) {
+  dfa_miner_c_free_labels(self);
+  if (self->reverse) {
+    dfa_destroy(self->unanchored);
+    dfa_destroy(self->reverse);
+  }
+  dfa_destroy(self->dfa);
+  self->destroy_super((miner_c *)self);
+}
@@ -149,8 +149,12 @@ static occurrence_t* match_email_naive_impl(miner_c* m) {
 
 /** Returns a miner which matches glob patterns. */
 miner_c* match_email_naive(const char* args) {
-  // instantiate new miner_c easily and return
-  return miner_c_create("Email", NULL, match_email_naive_impl);
+  // instantiate new miner_c easily
+  miner_c * m = miner_c_create("Email", NULL, match_email_naive_impl);
+  // the miner starts only at @, which is a delimiter, so positions inside
+  // tokens can be skipped using the token index of the extractor
+  m->token_anchored = true;
+  return m;
 }
 
 /* if not defined SO_MODULE define main entrypoint */
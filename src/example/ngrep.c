@@ -37,59 +37,249 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define FMT_PLAIN 0
 #define FMT_JSON 1
 #define FMT_CSV 2
 
+/** Size of the stdout buffer, outputs of files are written in large blocks. */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
 
 static gchar * a_expression = NULL;
 static gchar * a_format = "plain";
-static gchar * a_file = NULL; /* use g_free! */
+static gchar ** a_files = NULL; /* use g_strfreev! */
+static gboolean a_timing = FALSE;
+static gboolean a_count = FALSE;
+static gboolean a_files_with_matches = FALSE;
+static gint a_jobs = 0;
 
 static unsigned u_format = FMT_PLAIN;
+/* Prefix outputs with file names, set when more files may be searched. */
+static bool u_with_filename = false;
+
+/** A searched file and its output, written out in the order of inputs. */
+typedef struct grep_file_t {
+  gchar * path;
+  GString * out;
+  bool done;
+} grep_file_t;
+
+/** Files shared by the workers. */
+typedef struct grep_jobs_t {
+  grep_file_t * files;
+  size_t files_count;
+  /** Index of the next file to be taken by a worker. */
+  size_t next;
+  /** Extractor with the loaded module, workers run clones of its miners. */
+  extractor_c * shared;
+  pthread_mutex_t mutex;
+  /** Signalled when a file is done. */
+  pthread_cond_t done;
+} grep_jobs_t;
+
+
+/** Appends a string to a CSV field, doubling the quotes (RFC 4180). */
+void append_csv_escaped(GString * out, const char * str, unsigned len) {
+  const char * end = str + len;
+  const char * quote;
+
+  while( (quote = memchr(str, '\"', end - str)) ) {
+    g_string_append_len(out, str, quote - str + 1);
+    g_string_append_c(out, '\"');
+    str = quote + 1;
+  }
+  g_string_append_len(out, str, end - str);
+}
+
+/** Appends len bytes to a JSON string, escaping quotes, backslashes and control characters. */
+void append_json_escaped(GString * out, const char * str, size_t len) {
+  const char * end = str + len;
+  for( ; str < end; ++str ) {
+    if( *str == '\"' || *str == '\\' ) {
+      g_string_append_c(out, '\\');
+      g_string_append_c(out, *str);
+    }
+    else if( (unsigned char)*str < 0x20 ) {
+      g_string_append_printf(out, "\\u%04x", (unsigned char)*str);
+    }
+    else {
+      g_string_append_c(out, *str);
+    }
+  }
+}
+
+void format_pos(GString * out, const char * path, occurrence_t * o) {
+  if( u_format == FMT_PLAIN ) {
+    if( u_with_filename ) {
+      g_string_append_printf(out, "%s:", path);
+    }
+    g_string_append_len(out, o->str, o->len);
+    g_string_append_c(out, '\n');
+  }
+  else if( u_format == FMT_JSON ) {
+    g_string_append_c(out, '{');
+    if( u_with_filename ) {
+      g_string_append(out, "\"file\": \"");
+      append_json_escaped(out, path, strlen(path));
+      g_string_append(out, "\", ");
+    }
+    g_string_append_printf(out, "\"pos\": %lu, \"len\": %u, \"val\": \"", o->pos, o->len);
+    append_json_escaped(out, o->str, o->len);
+    g_string_append(out, "\"}\n");
+  }
+  else if( u_format == FMT_CSV ) {
+    if( u_with_filename ) {
+      g_string_append_c(out, '\"');
+      append_csv_escaped(out, path, strlen(path));
+      g_string_append(out, "\",");
+    }
+    g_string_append_printf(out, "\"%lu\",\"%u\",\"", o->pos, o->len);
+    append_csv_escaped(out, o->str, o->len);
+    g_string_append(out, "\"\n");
+  }
+}
 
+int compare_paths(const void * a, const void * b) {
+  return strcmp(*(gchar * const *)a, *(gchar * const *)b);
+}
 
-gchar * rfc_escape_csv(char * str, unsigned len) {
-  char * working_head = strdup(str);
-  char * working = working_head;
-  uint64_t offset = 0;
+bool is_directory(const gchar * path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
 
-  while( *working ) {
-    if( *working == '\"' ) {
-      working_head = realloc(working_head, ++len);
-      working = working_head + offset;
-      memmove(working+1, working, len-offset-1);
-      working++; // move twice xaxa"asdasd
-      offset++;
+/**
+ * Adds a path to the files, directories are searched recursively in name order.
+ * Symbolic links are followed only for the given path, not inside directories,
+ * so a link pointing up the tree cannot make the search loop.
+ */
+void collect_files(GPtrArray * files, const gchar * path) {
+  struct stat st;
+  if( !is_directory(path) ) {
+    // Missing files are reported when opened
+    g_ptr_array_add(files, g_strdup(path));
+    return;
+  }
+
+  GDir * dir = g_dir_open(path, 0, NULL);
+  if( !dir ) {
+    fprintf(stderr, "Cannot open directory %s.\n", path);
+    return;
+  }
+
+  GPtrArray * names = g_ptr_array_new();
+  const gchar * name;
+  while( (name = g_dir_read_name(dir)) ) {
+    g_ptr_array_add(names, g_build_filename(path, name, NULL));
+  }
+  g_dir_close(dir);
+
+  qsort(names->pdata, names->len, sizeof(gchar*), compare_paths);
+  for( guint i = 0; i < names->len; ++i ) {
+    gchar * child = g_ptr_array_index(names, i);
+    if( lstat(child, &st) == 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode)) ) {
+      collect_files(files, child);
     }
+    g_free(child);
+  }
+  g_ptr_array_free(names, TRUE);
+}
+
+/** Searches a file and writes the results to its output. */
+void grep_file(extractor_c * e, grep_file_t * file) {
+  stream_file_c * sfc = stream_file_c_new(file->path);
 
-    working++;
-    offset++;
+  // Stream setting should go after miners addition
+  if( !sfc || !e->set_stream(e, (stream_c*)sfc) ) {
+    fprintf(stderr, "Cannot open %s.\n", file->path);
+    if( sfc ) {
+      DESTROY(sfc);
+    }
+    return;
   }
 
-  return working_head;
+  uint64_t count = 0;
+
+  // With -l the first occurrence ends the search
+  while (!((e->stream->state_flags) & STREAM_EOF) && !e->first_found) {
+    occurrence_t ** res = e->next(e, 10000000);
+    occurrence_t ** pres = res;
+
+    while (*pres) {
+      format_pos(file->out, file->path, *pres);
+      free(*pres);
+      ++pres;
+      ++count;
+    }
+
+    free(res);
+  }
+
+  if( a_count || a_files_with_matches ) {
+    label_count_t * counts = e->get_counts(e);
+    for( label_count_t * c = counts; c->label; ++c ) {
+      count += c->count;
+    }
+    free(counts);
+
+    if( a_files_with_matches ) {
+      if( count ) {
+        g_string_append_printf(file->out, "%s\n", file->path);
+      }
+    }
+    else if( u_with_filename ) {
+      g_string_append_printf(file->out, "%s:%lu\n", file->path, count);
+    }
+    else {
+      g_string_append_printf(file->out, "%lu\n", count);
+    }
+  }
+
+  e->unset_stream(e);
+  DESTROY(sfc);
 }
 
-void format_pos(occurrence_t * o) {
-  char str[o->len + 1];
-  str[o->len] = '\0';
-  memcpy(str, o->str, sizeof(char) * o->len);
-  if( u_format == FMT_PLAIN ) {
-    printf("%s\n", str);
+void * grep_worker(void * args) {
+  grep_jobs_t * jobs = (grep_jobs_t*)args;
+
+  miner_c ** clones = calloc(jobs->shared->miners_count + 1, sizeof(miner_c*));
+  for( unsigned m = 0; m < jobs->shared->miners_count; ++m ) {
+    clones[m] = jobs->shared->miners[m]->clone(jobs->shared->miners[m]);
   }
-  else if( u_format == FMT_JSON ) {
-    printf("{\"pos\": %lu, \"len\": %u, \"val\": \"%s\"}\n", o->pos, o->len, str);
+  extractor_c * e = extractor_c_new(1, clones);
+
+  // Occurrences are only counted, -l stops at the first one
+  if( a_count || a_files_with_matches ) {
+    e->set_flags(e, E_COUNT_ONLY | (a_files_with_matches ? E_FIRST_MATCH : 0));
   }
-  else if( u_format == FMT_CSV ) {
-    gchar * esc = rfc_escape_csv(str, o->len+1);
-    printf("\"%lu\",\"%u\",\"%s\"\n", o->pos, o->len, esc);
-    free(esc);
+
+  while( true ) {
+    pthread_mutex_lock(&(jobs->mutex));
+    size_t i = jobs->next++;
+    pthread_mutex_unlock(&(jobs->mutex));
+
+    if( i >= jobs->files_count ) {
+      break;
+    }
+
+    grep_file(e, &(jobs->files[i]));
+
+    pthread_mutex_lock(&(jobs->mutex));
+    jobs->files[i].done = true;
+    pthread_cond_broadcast(&(jobs->done));
+    pthread_mutex_unlock(&(jobs->mutex));
   }
+
+  DESTROY(e);
+  return NULL;
 }
 
-void analyze() {
-  stream_file_c * sfc = stream_file_c_new(a_file);
+void analyze(GPtrArray * paths) {
   gchar * re_expr_enc = g_base64_encode(a_expression, strlen(a_expression));
   unsigned ree_len = strlen(re_expr_enc);
   while(re_expr_enc[ree_len-1] == '=') {
@@ -113,7 +303,6 @@ void analyze() {
   }
 
   so_module->add_regex(so_module, re);
-  so_module->build(so_module);
 
   if (!so_module->build(so_module)) {
     GList *err = (GList*)so_module->errors;
@@ -125,6 +314,11 @@ void analyze() {
     exit(1);
   }
 
+  if( a_timing ) {
+    regex_timing_print(&(so_module->timing), stderr);
+  }
+
+  // The module is loaded once, workers clone its miners
   miner_c ** miners = calloc(1, sizeof(miner_c*));
   extractor_c * e = extractor_c_new(1, miners);
 
@@ -140,32 +334,53 @@ void analyze() {
     exit(1);
   }
 
-  // Stream setting should go after miners addition
-  if( !sfc || !e->set_stream(e, (stream_c*)sfc) ) {
-    fprintf(stderr, "Stream set on Extractor failed.");
-    exit(1);
+  grep_jobs_t jobs = {
+    .files = calloc(paths->len, sizeof(grep_file_t)),
+    .files_count = paths->len,
+    .next = 0,
+    .shared = e,
+  };
+  for( guint i = 0; i < paths->len; ++i ) {
+    jobs.files[i].path = g_ptr_array_index(paths, i);
+    jobs.files[i].out = g_string_sized_new(4096);
+  }
+  pthread_mutex_init(&(jobs.mutex), NULL);
+  pthread_cond_init(&(jobs.done), NULL);
+
+  size_t workers_count = (a_jobs < 1 ? sysconf(_SC_NPROCESSORS_ONLN) : a_jobs);
+  workers_count = MAX(MIN(workers_count, jobs.files_count), 1);
+  pthread_t * workers = calloc(workers_count, sizeof(pthread_t));
+  for( size_t w = 0; w < workers_count; ++w ) {
+    pthread_create(&(workers[w]), NULL, grep_worker, &jobs);
   }
 
-  uint32_t count = 0;
-
-  while (!((e->stream->state_flags) & STREAM_EOF)) {
-    occurrence_t ** res = e->next(e, 10000000);
-    occurrence_t ** pres = res;
+  // Outputs are written in the order of inputs as soon as they are done
+  setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+  for( size_t i = 0; i < jobs.files_count; ++i ) {
+    grep_file_t * file = &(jobs.files[i]);
 
-    while (*pres) {
-      format_pos(*pres);
-      free(*pres);
-      ++pres;
-      ++count;
+    pthread_mutex_lock(&(jobs.mutex));
+    while( !file->done ) {
+      pthread_cond_wait(&(jobs.done), &(jobs.mutex));
     }
+    pthread_mutex_unlock(&(jobs.mutex));
 
-    free(res);
+    fwrite(file->out->str, 1, file->out->len, stdout);
+    g_string_free(file->out, TRUE);
   }
+  fflush(stdout);
+
+  for( size_t w = 0; w < workers_count; ++w ) {
+    pthread_join(workers[w], NULL);
+  }
+  free(workers);
+  pthread_cond_destroy(&(jobs.done));
+  pthread_mutex_destroy(&(jobs.mutex));
+  free(jobs.files);
 
-  e->unset_stream(e);
   so_module->destroy(so_module);
+  regex_destroy(re);
   DESTROY(e);
-  DESTROY(sfc);
 
   free(re_expr_enc);
 }
@@ -173,8 +388,12 @@ void analyze() {
 static GOptionEntry entries[] =
 {
   { "expression", 'e', 0, G_OPTION_ARG_STRING, &a_expression, "Regular Expression", "E" },
-  { "format", 't', 0, G_OPTION_ARG_STRING, &a_format, "Output format - one of plain (dafault), ndjson, csv", "T" },
-  { "file", 'f', 0, G_OPTION_ARG_FILENAME, &a_file, "Path to a file", "F" },
+  { "format", 't', 0, G_OPTION_ARG_STRING, &a_format, "Output format - one of plain (dafault), json, csv", "T" },
+  { "file", 'f', 0, G_OPTION_ARG_FILENAME_ARRAY, &a_files, "Path to a file or a directory, may be repeated", "F" },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &a_jobs, "Number of files searched concurrently, the number of processors by default", "J" },
+  { "timing", 0, 0, G_OPTION_ARG_NONE, &a_timing, "Print time spent in regex compilation stages to stderr", NULL },
+  { "count", 'c', 0, G_OPTION_ARG_NONE, &a_count, "Print only the number of matches", NULL },
+  { "files-with-matches", 'l', 0, G_OPTION_ARG_NONE, &a_files_with_matches, "Print only the file name if it matches, stop at the first match", NULL },
   { NULL }
 };
 
@@ -183,7 +402,7 @@ int main (int argc, char *argv[])
   GError *error = NULL;
   GOptionContext *context;
 
-  context = g_option_context_new ("CONTEXT");
+  context = g_option_context_new ("[FILE...]");
   g_option_context_add_main_entries (context, entries, NULL);
 
   if (!g_option_context_parse (context, &argc, &argv, &error)) {
@@ -205,7 +424,20 @@ int main (int argc, char *argv[])
     exit(1);
   }
 
-  if( !a_file ) {
+  // Files are given by --file or as the remaining arguments
+  GPtrArray * paths = g_ptr_array_new();
+  unsigned inputs = 0;
+  for( gchar ** f = a_files; f && *f; ++f, ++inputs ) {
+    collect_files(paths, *f);
+    u_with_filename |= is_directory(*f);
+  }
+  for( int i = 1; i < argc; ++i, ++inputs ) {
+    collect_files(paths, argv[i]);
+    u_with_filename |= is_directory(argv[i]);
+  }
+  u_with_filename |= (inputs > 1);
+
+  if( !inputs ) {
     fprintf(stderr, "No file given.\n");
     exit(1);
   }
@@ -215,9 +447,15 @@ int main (int argc, char *argv[])
     exit(1);
   }
 
-  analyze();
+  if( paths->len ) {
+    analyze(paths);
+  }
 
-  g_free(a_file);
+  for( guint i = 0; i < paths->len; ++i ) {
+    g_free(g_ptr_array_index(paths, i));
+  }
+  g_ptr_array_free(paths, TRUE);
+  g_strfreev(a_files);
   g_option_context_free(context);
   return 0;
 }
@@ -16,12 +16,14 @@
  */
 
 #include <nativeextractor/extractor.h>
+#include <glib-2.0/glib.h>
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <pthread.h>
 #include <string.h>
 #include <semaphore.h>
+#include <time.h>
 #include <unistd.h>
 
 /*! \mainpage NativeExtractor documentation
@@ -33,8 +35,213 @@
  * For full documentation please navigate through the menu on the left.
  */
 
-void* thread_fn(void* args) {
+static inline uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/** Number of bytes indexed behind the end of a batch. */
+#define TOKEN_INDEX_MARGIN 256
+
+/** Number of positions between two checks of the batch deadline. */
+#define BUDGET_CLOCK_INTERVAL 64
+
+/**
+ * Checks whether the budget of the current batch is exhausted or the first
+ * match was found with E_FIRST_MATCH. The flags are tested at every position,
+ * the clock only every BUDGET_CLOCK_INTERVAL positions.
+ *
+ * @param extractor the extractor running the batch
+ * @param ticks     positions counter of the calling miner
+ *
+ * @returns         true if mining should stop
+ */
+static inline bool budget_exhausted(extractor_c * extractor, unsigned * ticks) {
+  if (atomic_load_explicit(&(extractor->budget_exhausted), memory_order_relaxed)
+      || atomic_load_explicit(&(extractor->first_found), memory_order_relaxed)) {
+    return true;
+  }
+
+  if (extractor->budget_deadline
+      && (++(*ticks) % BUDGET_CLOCK_INTERVAL) == 0
+      && clock_ns(CLOCK_MONOTONIC) >= extractor->budget_deadline) {
+    atomic_store_explicit(&(extractor->budget_exhausted), true, memory_order_relaxed);
+  }
+
+  return atomic_load_explicit(&(extractor->budget_exhausted), memory_order_relaxed);
+}
+
+/**
+ * Adds an occurrence of a label to the counters of a miner. The items are kept
+ * sorted by the label pointer, union DFAs report a label per expression.
+ */
+static void miner_counts_t_add(miner_counts_t * counts, const char * label) {
+  unsigned lo = 0, hi = counts->count;
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if ((uintptr_t)counts->items[mid].label < (uintptr_t)label) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < counts->count && counts->items[lo].label == label) {
+    ++(counts->items[lo].count);
+    return;
+  }
+
+  if (counts->count == counts->capacity) {
+    counts->capacity = MAX(counts->capacity * 2, 4);
+    counts->items = realloc(counts->items, counts->capacity * sizeof(label_count_t));
+  }
+  memmove(&(counts->items[lo + 1]), &(counts->items[lo]),
+    (counts->count - lo) * sizeof(label_count_t));
+  counts->items[lo] = (label_count_t){ label, 1 };
+  ++(counts->count);
+}
+
+/**
+ * Runs a miner over the next `batch` characters of its stream. Stops earlier
+ * when the budget of the batch is exhausted. The position reached is stored
+ * in the progress of the miner.
+ *
+ * @param extractor the extractor owning the miner
+ * @param m         index of the miner to run
+ * @param pout      output array of occurrences
+ * @param batch     number of characters to analyze
+ *
+ * @returns         number of characters actually analyzed
+ */
+static int64_t mine_batch(extractor_c * extractor, unsigned m,
+  occurrence_t *** pout, int64_t batch) {
+  miner_c * miner = extractor->miners[m];
   mark_t mark;
+  unsigned ticks = 0;
+
+  // A miner resumed ahead of the extractor stream ends the batch with others
+  batch -= (int64_t)(miner->stream->unicode_offset - extractor->batch_offset);
+  int64_t batch_start = MAX(batch, 0);
+
+#ifdef NE_STATS
+  uint64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+  uint64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+  char* pos_start = miner->stream->pos;
+#endif
+
+  while (!(miner->stream->state_flags & STREAM_EOF) && batch > 0) {
+    // Check if:
+    //  * Current position in then stream farther than in the last run
+    //  * Current position in then stream farther than the last matched occurrence
+    if (budget_exhausted(extractor, &ticks)) {
+      break;
+    }
+
+    if (miner->stream->pos >= MAX(miner->pos_last, miner->end_last)
+        && !(miner->token_anchored
+          && token_index_t_covers(&(extractor->tokens), miner->stream->pos)
+          && token_index_t_is_inside(&(extractor->tokens), miner->stream->pos))) {
+      miner->mark_pos(miner, &mark);
+      MINER_STATS_ADD(miner, positions, 1);
+      char* pos_last = miner->pos_last;
+      char* end_last = miner->end_last;
+      occurrence_t* p = miner->run(miner);
+
+      if (p && (extractor->flags & E_COUNT_ONLY)) {
+        // Occurrences are in the scratch of the miner, nothing to free
+        unsigned found = 1 + miner->pending_count;
+        MINER_STATS_ADD(miner, occurrences, found);
+        for (unsigned i = 0; i < found; ++i) {
+          occurrence_t* o = (i == 0) ? p : miner->pending[i - 1];
+          miner_counts_t_add(&(extractor->counts[m]), o->label);
+        }
+        miner->pending_count = 0;
+        if (extractor->flags & E_FIRST_MATCH) {
+          atomic_store_explicit(&(extractor->first_found), true, memory_order_relaxed);
+        }
+      } else if (p) {
+        // The returned occurrence and the pending ones go out together
+        unsigned found = 1 + miner->pending_count;
+
+        pthread_mutex_lock(&(extractor->mutex_pout));
+
+        if (extractor->budget_occurrences && extractor->occurrences_count > 0
+            && extractor->occurrences_count + found > extractor->budget_occurrences) {
+          // Over budget; rewind so the occurrences are found again on resume
+          atomic_store_explicit(&(extractor->budget_exhausted), true, memory_order_relaxed);
+          pthread_mutex_unlock(&(extractor->mutex_pout));
+          free(p);
+          for (unsigned i = 0; i < miner->pending_count; ++i) {
+            free(miner->pending[i]);
+          }
+          miner->pending_count = 0;
+          miner->reset_pos(miner, &mark);
+          miner->pos_last = pos_last;
+          miner->end_last = end_last;
+          break;
+        }
+
+        MINER_STATS_ADD(miner, occurrences, found);
+
+        for (unsigned i = 0; i < found; ++i) {
+          occurrence_t* o = (i == 0) ? p : miner->pending[i - 1];
+          size_t last_pos = o->pos + o->len;
+
+          if ((extractor->flags & E_NO_ENCLOSED_OCCURRENCES)
+              && (extractor->last_max > 0)
+              && (last_pos <= extractor->last_max)) {
+            // skip enclosed occurrence
+            MINER_STATS_ADD(miner, dropped, 1);
+            free(o);
+            continue;
+          }
+
+          **pout = o;
+          ++(*pout);
+#ifdef NE_STATS
+          extractor->owners[extractor->occurrences_count] = m;
+#endif
+          ++(extractor->occurrences_count);
+          if (extractor->flags & E_FIRST_MATCH) {
+            atomic_store_explicit(&(extractor->first_found), true, memory_order_relaxed);
+          }
+        }
+        miner->pending_count = 0;
+
+        pthread_mutex_unlock(&(extractor->mutex_pout));
+      }
+
+      if (miner->stream->unicode_offset > mark.unicode_offset) {
+        batch -= (miner->stream->unicode_offset - mark.unicode_offset - 1);
+        miner->stream->move(miner->stream, -1);
+      } else {
+        miner->reset_pos(miner, &mark);
+      }
+    }
+    batch -= miner->stream->move(miner->stream, 1);
+  }
+
+#ifdef NE_STATS
+  miner->stats.wall_ns += clock_ns(CLOCK_MONOTONIC) - wall_start;
+  miner->stats.cpu_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+  miner->stats.bytes += miner->stream->pos - pos_start;
+#endif
+
+  miner->mark_pos(miner, &(extractor->progress[m]));
+
+  return batch_start - MAX(batch, 0);
+}
+
+/** Returns index of a miner in the miners array of the extractor. */
+static unsigned miner_index(extractor_c * extractor, miner_c * miner) {
+  unsigned m = 0;
+  while (extractor->miners[m] != miner) {
+    ++m;
+  }
+  return m;
+}
+
+void* thread_fn(void* args) {
   extractor_c * extractor = (extractor_c*)args;
 
   while (true) {
@@ -49,47 +256,17 @@ void* thread_fn(void* args) {
     thread_args_t* targs = extractor->targs[--(extractor->targs_count)];
     pthread_mutex_unlock(&(extractor->mutex_targs));
 
-    miner_c* miner = targs->miner;
-    int64_t batch = (int64_t)targs->batch;
-
-    while (!(miner->stream->state_flags & STREAM_EOF) && batch > 0) {
-      // Check if:
-      //  * Current position in then stream farther than in the last run
-      //  * Current position in then stream farther than the last matched occurrence
-      if (miner->stream->pos >= MAX(miner->pos_last, miner->end_last)) {
-        miner->mark_pos(miner, &mark);
-        occurrence_t* p = miner->run(miner);
-
-        if (p) {
-          // add occurrence
-          size_t last_pos = p->pos + p->len;
-
-          pthread_mutex_lock(&(extractor->mutex_pout));
-
-          if (extractor->flags & E_NO_ENCLOSED_OCCURRENCES) {
-            if ((extractor->last_max > 0)
-                && (last_pos <= extractor->last_max)) {
-              // skip enclosed occurrence
-              free(p);
-              goto exit_mutex;
-            }
-          }
-
-          **(targs->pout) = p;
-          ++(*(targs->pout));
-
-exit_mutex:
-          pthread_mutex_unlock(&(extractor->mutex_pout));
-        }
-
-        if (miner->stream->unicode_offset > mark.unicode_offset) {
-          batch -= (miner->stream->unicode_offset - mark.unicode_offset - 1);
-          miner->stream->move(miner->stream, -1);
-        } else {
-          miner->reset_pos(miner, &mark);
-        }
-      }
-      batch -= miner->stream->move(miner->stream, 1);
+    unsigned m = miner_index(extractor, targs->miner);
+    uint64_t start = clock_ns(CLOCK_MONOTONIC);
+    int64_t analyzed = mine_batch(extractor, m, targs->pout,
+      (int64_t)targs->batch);
+    uint64_t elapsed = clock_ns(CLOCK_MONOTONIC) - start;
+
+    if (analyzed > 0) {
+      // Exponential moving average of the cost per 1024 characters
+      uint64_t cost = (elapsed << 10) / (uint64_t)analyzed;
+      uint64_t prev = extractor->miners_cost[m];
+      extractor->miners_cost[m] = (prev ? (3 * prev + cost) / 4 : cost);
     }
 
     sem_post(&(extractor->sem_main));
@@ -139,10 +316,14 @@ void occurrence_t_sort(occurrence_t ** batch) {
  * </pre>
  *
  * @param occurrences the occurrences to filter
+ * @param owners      index of the miner of each occurrence or NULL; removed
+ *                    occurrences are counted as dropped by their miners
+ * @param miners      the miners indexed by `owners`
  *
  * @return filtered occurrences; use in place of passed array
  */
-occurrence_t **filter_longest_occurrences(occurrence_t **occurrences) {
+static occurrence_t **filter_enclosed_occurrences(occurrence_t **occurrences,
+  const unsigned * owners, miner_c ** miners) {
   occurrence_t **pa;
   occurrence_t **pb;
 
@@ -191,6 +372,14 @@ occurrence_t **filter_longest_occurrences(occurrence_t **occurrences) {
       ++found;
     } else {
       freed = true;
+#ifdef NE_STATS
+      if (owners) {
+        MINER_STATS_ADD(miners[owners[pb - occurrences]], dropped, 1);
+      }
+#else
+      (void)owners;
+      (void)miners;
+#endif
       free(occ);
     }
     ++pb;
@@ -202,7 +391,70 @@ occurrence_t **filter_longest_occurrences(occurrence_t **occurrences) {
       : occurrences;
 }
 
-occurrence_t** next(extractor_c * self, unsigned batch) {
+/**
+ * Destructively removes "enclosed" occurrences from passed array, see
+ * filter_enclosed_occurrences.
+ *
+ * @param occurrences the occurrences to filter
+ *
+ * @return filtered occurrences; use in place of passed array
+ */
+occurrence_t **filter_longest_occurrences(occurrence_t **occurrences) {
+  return filter_enclosed_occurrences(occurrences, NULL, NULL);
+}
+
+
+typedef struct miner_cost_t {
+  unsigned miner;
+  uint64_t cost;
+} miner_cost_t;
+
+static int miner_cost_t_compare(const void * a, const void * b) {
+  const miner_cost_t * ma = (const miner_cost_t*)a;
+  const miner_cost_t * mb = (const miner_cost_t*)b;
+  // Miners of equal cost keep their order
+  return (ma->cost != mb->cost) ? CMP(ma->cost, mb->cost) : CMP(mb->miner, ma->miner);
+}
+
+/**
+ * Enqueues one task per miner for the worker threads. Workers take tasks as
+ * they become free, most expensive miners by their measured cost first, so
+ * a long miner does not start last while cheap ones fill the other threads.
+ *
+ * @param self  an extractor_c instance
+ * @param batch number of characters to analyze
+ * @param pout  shared output array of occurrences
+ */
+static void schedule_tasks(extractor_c * self, unsigned batch, occurrence_t *** pout) {
+  if (self->miners_count == 0) {
+    return;
+  }
+
+  miner_cost_t order[self->miners_count];
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    order[m].miner = m;
+    order[m].cost = self->miners_cost[m];
+  }
+  qsort(order, self->miners_count, sizeof(miner_cost_t), miner_cost_t_compare);
+
+  // Workers pop tasks from the end, so the cheapest miners are pushed first
+  pthread_mutex_lock(&(self->mutex_targs));
+  for (unsigned i = 0; i < self->miners_count; ++i) {
+    thread_args_t* targs = ALLOC(thread_args_t);
+    targs->miner = self->miners[order[i].miner];
+    targs->batch = batch;
+    targs->pout = pout;
+    self->targs[self->targs_count++] = targs;
+  }
+  pthread_mutex_unlock(&(self->mutex_targs));
+
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    sem_post(&(self->sem_targs));
+  }
+}
+
+occurrence_t** next_budget(extractor_c * self, unsigned batch,
+  const batch_budget_t * budget) {
   pthread_mutex_lock(&(self->mutex_extractor));
   if (!self->threads_inited) {
     sem_init(&(self->sem_main), 0, 0);
@@ -211,26 +463,57 @@ occurrence_t** next(extractor_c * self, unsigned batch) {
     self->threads_inited = true;
   }
 
-  occurrence_t** out = malloc(((batch * self->miners_count) + 1) * sizeof(occurrence_t*));
+  if ((self->flags & E_FIRST_MATCH)
+      && atomic_load_explicit(&(self->first_found), memory_order_relaxed)) {
+    // The first match was already found in the stream, nothing is mined
+    pthread_mutex_unlock(&(self->mutex_extractor));
+    return calloc(1, sizeof(occurrence_t*));
+  }
+
+  bool count_only = (self->flags & E_COUNT_ONLY);
+  size_t capacity = 0;
+  for (unsigned m = 0; m < self->miners_count && !count_only; ++m) {
+    capacity += (size_t)batch * self->miners[m]->max_occurrences;
+  }
+  occurrence_t** out = malloc((capacity + 1) * sizeof(occurrence_t*));
   occurrence_t** pout = out;
+#ifdef NE_STATS
+  self->owners = realloc(self->owners, (capacity + 1) * sizeof(unsigned));
+#endif
+
+  bool resume_p = atomic_load_explicit(&(self->budget_exhausted), memory_order_relaxed);
 
   for (unsigned m = 0; m < self->miners_count; ++m) {
     miner_c * miner = self->miners[m];
     miner->stream->sync(miner->stream, self->stream);
-
-    thread_args_t* targs = ALLOC(thread_args_t);
-    targs->miner = miner;
-    targs->batch = batch;
-    targs->pout = &pout;
-
-    pthread_mutex_lock(&(self->mutex_targs));
-    self->targs[self->targs_count++] = targs;
-    pthread_mutex_unlock(&(self->mutex_targs));
-
-    sem_post(&(self->sem_targs));
+    miner->tokens = &(self->tokens);
+    if (count_only && !miner->scratch) {
+      miner->scratch = calloc(miner->max_occurrences, sizeof(occurrence_t));
+    } else if (!count_only && miner->scratch) {
+      free(miner->scratch);
+      miner->scratch = NULL;
+    }
+    // Miners which got farther in the interrupted batch continue from there
+    if (resume_p && self->progress[m].unicode_offset > self->stream->unicode_offset) {
+      miner->reset_pos(miner, &(self->progress[m]));
+    }
   }
 
+  self->batch_offset = self->stream->unicode_offset;
+  atomic_store_explicit(&(self->budget_exhausted), false, memory_order_relaxed);
+  atomic_store_explicit(&(self->first_found), false, memory_order_relaxed);
+  self->occurrences_count = 0;
+  self->budget_occurrences = (budget ? budget->max_occurrences : 0);
+  self->budget_deadline = ((budget && budget->time_limit_us)
+    ? clock_ns(CLOCK_MONOTONIC) + budget->time_limit_us * 1000 : 0);
+
+  // Token boundaries of the batch, with a margin for occurrences crossing it
+  char * batch_start = self->stream->pos;
   self->stream->move(self->stream, (int64_t)batch);
+  token_index_t_build(&(self->tokens), self->stream, batch_start,
+    MIN(self->stream->end, self->stream->pos + TOKEN_INDEX_MARGIN));
+
+  schedule_tasks(self, batch, &pout);
 
   PRINT_DEBUG("Waiting!\n");
   for (unsigned m = 0; m < self->miners_count; ++m) {
@@ -238,10 +521,30 @@ occurrence_t** next(extractor_c * self, unsigned batch) {
     sem_wait(&(self->sem_main));
   }
 
+  if (atomic_load_explicit(&(self->first_found), memory_order_relaxed)) {
+    // Nothing more is mined from the stream, see the check above
+    atomic_store_explicit(&(self->budget_exhausted), false, memory_order_relaxed);
+  }
+
+  if (atomic_load_explicit(&(self->budget_exhausted), memory_order_relaxed)) {
+    // Continue from the miner which got the least far
+    mark_t * slowest = NULL;
+    for (unsigned m = 0; m < self->miners_count; ++m) {
+      if (!slowest || self->progress[m].unicode_offset < slowest->unicode_offset) {
+        slowest = &(self->progress[m]);
+      }
+    }
+    if (slowest) {
+      self->stream->pos = slowest->pos;
+      self->stream->unicode_offset = slowest->unicode_offset;
+      self->stream->state_flags = slowest->state_flags;
+    }
+  }
+
   *pout = NULL;
 
   if (self->flags & E_NO_ENCLOSED_OCCURRENCES) {
-    out = filter_longest_occurrences(out);
+    out = filter_enclosed_occurrences(out, self->owners, self->miners);
     size_t max_pos = self->last_max;
     occurrence_t **occ = out;
     while (*occ != NULL) {
@@ -260,6 +563,17 @@ occurrence_t** next(extractor_c * self, unsigned batch) {
   return out;
 }
 
+occurrence_t** next(extractor_c * self, unsigned batch) {
+  return next_budget(self, batch, NULL);
+}
+
+uint64_t extractor_c_get_progress(extractor_c * self, unsigned miner) {
+  if (miner >= self->miners_count) {
+    return 0;
+  }
+  return self->progress[miner].unicode_offset;
+}
+
 bool extractor_c_set_stream(extractor_c * self, stream_c * stream){
   self->unset_stream(self);
 
@@ -280,6 +594,12 @@ bool extractor_c_set_stream(extractor_c * self, stream_c * stream){
   }
 
   self->last_max = 0;
+  atomic_store_explicit(&(self->budget_exhausted), false, memory_order_relaxed);
+  atomic_store_explicit(&(self->first_found), false, memory_order_relaxed);
+  memset(self->progress, 0, sizeof(mark_t) * self->miners_count);
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    self->counts[m].count = 0;
+  }
 
   pthread_mutex_unlock(&(self->mutex_extractor));
 
@@ -304,6 +624,40 @@ static inline void dl_symbol_t_print(dl_symbol_t* dls) {
     dls->ldpath, dls->ldsymb, dls->params, dls->ldptr);
 }
 
+/** Appends a miner to the miner array, must be called with mutex_extractor held. */
+static void extractor_c_append_miner(extractor_c * self, miner_c * miner){
+  ++self->miners_count;
+  self->miners = realloc(self->miners, sizeof(miner_c*) * (self->miners_count + 1));
+
+  self->miners[self->miners_count - 1] = miner;
+  self->miners[self->miners_count] = NULL;
+
+  self->miners_cost = realloc(self->miners_cost, sizeof(uint64_t) * self->miners_count);
+  self->miners_cost[self->miners_count - 1] = 0;
+
+  self->progress = realloc(self->progress, sizeof(mark_t) * self->miners_count);
+  memset(&(self->progress[self->miners_count - 1]), 0, sizeof(mark_t));
+
+  self->counts = realloc(self->counts, sizeof(miner_counts_t) * self->miners_count);
+  memset(&(self->counts[self->miners_count - 1]), 0, sizeof(miner_counts_t));
+
+  pthread_mutex_lock(&(self->mutex_targs));
+  self->targs = realloc(self->targs, sizeof(thread_args_t*)*self->miners_count);
+  pthread_mutex_unlock(&(self->mutex_targs));
+}
+
+bool extractor_c_add_miner(extractor_c * self, miner_c * miner){
+  pthread_mutex_lock(&(self->mutex_extractor));
+
+  if (self->stream) {
+    miner->set_stream(miner, self->stream);
+  }
+  extractor_c_append_miner(self, miner);
+
+  pthread_mutex_unlock(&(self->mutex_extractor));
+  return true;
+}
+
 bool extractor_c_add_miner_from_so(extractor_c * self,
   const char * miner_so_path, const char * miner_name, void * params ){
     pthread_mutex_lock(&(self->mutex_extractor));
@@ -377,18 +731,7 @@ bool extractor_c_add_miner_from_so(extractor_c * self,
       self->dlsymbols = realloc(self->dlsymbols, (dls_count +2) * sizeof(dl_symbol_t*));
       self->dlsymbols[dls_count+1] = NULL; // termination
 
-      /* realloc miners array */
-      miner_c* miner = miner_new(params);
-
-      ++self->miners_count;
-      self->miners = realloc(self->miners, sizeof(miner_c*) * (self->miners_count + 1));
-
-      self->miners[self->miners_count - 1] = miner;
-      self->miners[self->miners_count] = NULL;
-
-      pthread_mutex_lock(&(self->mutex_targs));
-      self->targs = realloc(self->targs, sizeof(thread_args_t*)*self->miners_count);
-      pthread_mutex_unlock(&(self->mutex_targs));
+      extractor_c_append_miner(self, miner_new(params));
 
       pthread_mutex_unlock(&(self->mutex_extractor));
 
@@ -418,9 +761,16 @@ void extractor_c_destroy(extractor_c * self){
 
   // Destroy miners
   for (unsigned m = 0; m < self->miners_count; ++m) {
+    free(self->miners[m]->scratch);
     DESTROY(self->miners[m]);
+    free(self->counts[m].items);
   }
   free(self->miners);
+  free(self->miners_cost);
+  free(self->progress);
+  free(self->counts);
+  free(self->owners);
+  token_index_t_clear(&(self->tokens));
 
   // Destroy loaded .so
   dl_symbol_t ** dls = self->dlsymbols;
@@ -493,19 +843,76 @@ void extractor_set_last_error(extractor_c * self, const char * err) {
  */
 bool _set_flags(extractor_c * self, unsigned flags, bool value) {
   // only allow defined flags
-  if (flags & ~(E_NO_ENCLOSED_OCCURRENCES | E_SORT_RESULTS)) {
+  if (flags & ~(E_NO_ENCLOSED_OCCURRENCES | E_SORT_RESULTS | E_COUNT_ONLY
+      | E_FIRST_MATCH)) {
     return false;
   }
 
-  // NOTE: check flag interference here
-
-  self->flags = value
+  unsigned result = value
       ? self->flags | flags
       : self->flags & ~flags;
 
+  // enclosed occurrences cannot be filtered without returning them
+  if ((result & E_COUNT_ONLY) && (result & E_NO_ENCLOSED_OCCURRENCES)) {
+    return false;
+  }
+
+  self->flags = result;
+
   return true;
 }
 
+miner_stats_t* extractor_c_get_stats(extractor_c * self) {
+#ifdef NE_STATS
+  pthread_mutex_lock(&(self->mutex_extractor));
+  miner_stats_t* stats = calloc(self->miners_count + 1, sizeof(miner_stats_t));
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    stats[m] = self->miners[m]->stats;
+    stats[m].name = self->miners[m]->name;
+  }
+  pthread_mutex_unlock(&(self->mutex_extractor));
+  return stats;
+#else
+  return NULL;
+#endif
+}
+
+label_count_t* extractor_c_get_counts(extractor_c * self) {
+  pthread_mutex_lock(&(self->mutex_extractor));
+  size_t capacity = 0;
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    capacity += self->counts[m].count;
+  }
+
+  label_count_t* counts = calloc(capacity + 1, sizeof(label_count_t));
+  size_t count = 0;
+  // Label -> its index in counts + 1, miners may share a label
+  GHashTable* index = g_hash_table_new(g_str_hash, g_str_equal);
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    for (unsigned i = 0; i < self->counts[m].count; ++i) {
+      label_count_t* item = &(self->counts[m].items[i]);
+      size_t c = GPOINTER_TO_UINT(g_hash_table_lookup(index, item->label));
+      if (c == 0) {
+        counts[count].label = item->label;
+        c = ++count;
+        g_hash_table_insert(index, (gpointer)item->label, GUINT_TO_POINTER(c));
+      }
+      counts[c - 1].count += item->count;
+    }
+  }
+  g_hash_table_destroy(index);
+  pthread_mutex_unlock(&(self->mutex_extractor));
+  return counts;
+}
+
+void extractor_c_reset_stats(extractor_c * self) {
+  pthread_mutex_lock(&(self->mutex_extractor));
+  for (unsigned m = 0; m < self->miners_count; ++m) {
+    memset(&(self->miners[m]->stats), 0, sizeof(miner_stats_t));
+  }
+  pthread_mutex_unlock(&(self->mutex_extractor));
+}
+
 bool extractor_set_flags(extractor_c * self, unsigned flags) {
   return _set_flags(self, flags, true);
 }
@@ -523,16 +930,25 @@ extractor_c * extractor_c_new(int threads, miner_c ** miners){
   while (miners && miners[miners_count] != NULL) { ++miners_count; }
 
   out->next = next;
+  out->next_budget = next_budget;
+  out->get_progress = extractor_c_get_progress;
   out->set_stream = extractor_c_set_stream;
   out->unset_stream = extractor_c_unset_stream;
   out->add_miner_so = extractor_c_add_miner_from_so;
+  out->add_miner = extractor_c_add_miner;
   out->miners_count = miners_count;
+  out->miners_cost = calloc(miners_count + 1, sizeof(uint64_t));
+  out->progress = calloc(miners_count + 1, sizeof(mark_t));
+  out->counts = calloc(miners_count + 1, sizeof(miner_counts_t));
   out->dlsymbols = calloc(1, sizeof(dl_symbol_t*)); /* NULL terminated array*/
   out->destroy = extractor_c_destroy;
   out->get_last_error = extractor_get_last_error;
   out->set_last_error = extractor_set_last_error;
   out->set_flags = extractor_set_flags;
   out->unset_flags = extractor_unset_flags;
+  out->get_stats = extractor_c_get_stats;
+  out->reset_stats = extractor_c_reset_stats;
+  out->get_counts = extractor_c_get_counts;
 
   out->stream = NULL;//stream_c_new();
   out->last_error = NULL;
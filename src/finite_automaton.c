@@ -20,19 +20,9 @@
 #include <glib-2.0/glib.h>
 #include <string.h>
 
+/** Initial capacity of node and edge arrays, which then grow geometrically. */
 #define BUCKET_SIZE 10
 
-/** Mapping of multiple nodes from NFA to one node of DFA. */
-typedef struct fa_mapping_t {
-  size_t count;
-  fa_id_t *from;
-  fa_id_t to;
-  struct fa_mapping_t *prev;
-  struct fa_mapping_t *next;
-} fa_mapping_t;
-
-static void fa_print_impl(fa_t *fa, fa_mapping_t *mapping);
-
 fa_t *fa_create() {
   fa_t *fa = ALLOC(fa_t);
   fa->next_node_id = 0;
@@ -91,33 +81,11 @@ static fa_edge_t *fa_edge_create(fa_id_t id, fa_node_t *from, const char *symbol
   return edge;
 }
 
-static bool fa_edge_cmp(fa_edge_t *edge, const char *symbol) {
-  if (symbol) {
-    if (edge->symbol) {
-      return (strcmp(edge->symbol, symbol) == 0);
-    }
-  } else if (!edge->symbol) {
-    return true;
-  }
-  return false;
-}
-
-static fa_edge_t *fa_node_find_edge(fa_node_t *node, const char *symbol) {
-  fa_edge_t *edge = node->edges;
-  while (edge) {
-    if (fa_edge_cmp(edge, symbol)) {
-      return edge;
-    }
-    edge = edge->next;
-  }
-  return NULL;
-}
-
 fa_id_t fa_add_node(fa_t *fa) {
   fa_id_t id = fa->next_node_id++;
 
   if (id >= fa->node_array_size) {
-    fa->node_array_size += BUCKET_SIZE;
+    fa->node_array_size *= 2;
     fa->nodes = (fa_node_t **)realloc(fa->nodes, sizeof(fa_node_t *) * fa->node_array_size);
   }
 
@@ -129,7 +97,7 @@ fa_id_t fa_add_edge(fa_t *fa, fa_id_t from, const char *symbol, fa_id_t to) {
   fa_id_t id = fa->next_edge_id++;
 
   if (id >= fa->edge_array_size) {
-    fa->edge_array_size += BUCKET_SIZE;
+    fa->edge_array_size *= 2;
     fa->edges = (fa_edge_t **)realloc(fa->edges, sizeof(fa_edge_t *) * fa->edge_array_size);
   }
 
@@ -144,229 +112,613 @@ fa_id_t fa_add_edge(fa_t *fa, fa_id_t from, const char *symbol, fa_id_t to) {
   return id;
 }
 
-static fa_mapping_t *fa_mapping_create(size_t count, fa_id_t *from, fa_id_t to) {
-  fa_mapping_t *mapping = ALLOC(fa_mapping_t);
-  mapping->count = count;
-  if (count > 0) {
-    mapping->from = (fa_id_t *)calloc(count, sizeof(fa_id_t));
-    memcpy(mapping->from, from, sizeof(fa_id_t) * count);
-  } else {
-    mapping->from = NULL;
-  }
-  mapping->to = to;
-  mapping->prev = NULL;
-  mapping->next = NULL;
-  return mapping;
-}
-
-static bool fa_mapping_extend(fa_mapping_t *mapping, size_t from_count, fa_id_t *from) {
-  bool extended = false;
-  for (size_t j = 0; j < from_count; ++j) {
-    size_t _from = from[j];
-    bool do_extend = true;
-    for (size_t i = 0; i < mapping->count; ++i) {
-      if (mapping->from[i] == _from) {
-        do_extend = false;
-        break;
-      }
+/** Interned symbol and target of an edge, sorted by fa_freeze. */
+typedef struct fa_frozen_edge_t {
+  uint32_t symbol;
+  fa_id_t to;
+  fa_id_t id;
+} fa_frozen_edge_t;
+
+static int fa_frozen_edge_cmp(const void *a, const void *b) {
+  const fa_frozen_edge_t *x = a;
+  const fa_frozen_edge_t *y = b;
+  if (x->symbol != y->symbol) {
+    return (x->symbol > y->symbol) - (x->symbol < y->symbol);
+  }
+  return (x->id > y->id) - (x->id < y->id);
+}
+
+/** Creates an empty frozen automaton over a copy of a symbol table. */
+static fa_frozen_t *fa_frozen_create(const char **symbols, size_t symbols_count) {
+  fa_frozen_t *frozen = ALLOC(fa_frozen_t);
+  frozen->nodes_count = 0;
+  frozen->edges_count = 0;
+  frozen->symbols_count = symbols_count;
+  frozen->symbols = malloc(MAX(symbols_count, 1) * sizeof(char *));
+  memcpy(frozen->symbols, symbols, symbols_count * sizeof(char *));
+  frozen->nodes_capacity = BUCKET_SIZE;
+  frozen->edges_capacity = BUCKET_SIZE;
+  frozen->offsets = malloc(frozen->nodes_capacity * sizeof(size_t));
+  frozen->offsets[0] = 0;
+  frozen->edge_symbols = malloc(frozen->edges_capacity * sizeof(uint32_t));
+  frozen->edge_targets = malloc(frozen->edges_capacity * sizeof(fa_id_t));
+  frozen->starting = calloc(frozen->nodes_capacity, sizeof(bool));
+  frozen->final = calloc(frozen->nodes_capacity, sizeof(bool));
+  return frozen;
+}
+
+/**
+ * Adds a node to a frozen automaton under construction. Edges are added to
+ * the nodes in the order of their ids, see fa_frozen_begin.
+ */
+static fa_id_t fa_frozen_add_node(fa_frozen_t *frozen) {
+  fa_id_t id = frozen->nodes_count++;
+  if (frozen->nodes_count + 1 > frozen->nodes_capacity) {
+    size_t old = frozen->nodes_capacity;
+    frozen->nodes_capacity *= 2;
+    frozen->offsets = realloc(frozen->offsets, frozen->nodes_capacity * sizeof(size_t));
+    frozen->starting = realloc(frozen->starting, frozen->nodes_capacity * sizeof(bool));
+    frozen->final = realloc(frozen->final, frozen->nodes_capacity * sizeof(bool));
+    memset(frozen->starting + old, 0, (frozen->nodes_capacity - old) * sizeof(bool));
+    memset(frozen->final + old, 0, (frozen->nodes_capacity - old) * sizeof(bool));
+  }
+  frozen->offsets[frozen->nodes_count] = frozen->edges_count;
+  return id;
+}
+
+/**
+ * Starts adding the edges of node `id`. Every node must be started once, in
+ * the order of ids.
+ */
+static void fa_frozen_begin(fa_frozen_t *frozen, fa_id_t id) {
+  frozen->offsets[id] = frozen->edges_count;
+}
+
+/** Adds an edge to the node given to fa_frozen_begin. */
+static void fa_frozen_add_edge(fa_frozen_t *frozen, uint32_t symbol, fa_id_t to) {
+  if (frozen->edges_count == frozen->edges_capacity) {
+    frozen->edges_capacity *= 2;
+    frozen->edge_symbols = realloc(frozen->edge_symbols, frozen->edges_capacity * sizeof(uint32_t));
+    frozen->edge_targets = realloc(frozen->edge_targets, frozen->edges_capacity * sizeof(fa_id_t));
+  }
+  frozen->edge_symbols[frozen->edges_count] = symbol;
+  frozen->edge_targets[frozen->edges_count] = to;
+  ++frozen->edges_count;
+}
+
+/** Closes the edges of the node given to fa_frozen_begin. */
+static void fa_frozen_end(fa_frozen_t *frozen) {
+  frozen->offsets[frozen->nodes_count] = frozen->edges_count;
+}
+
+fa_frozen_t *fa_freeze(const fa_t *fa) {
+  size_t n = fa->next_node_id;
+
+  // Intern symbols, equal strings are one symbol
+  GHashTable *symbol_ids = g_hash_table_new(g_str_hash, g_str_equal);
+  const char **symbols = malloc(MAX(fa->next_edge_id, 1) * sizeof(char *));
+  size_t symbols_count = 0;
+  fa_frozen_edge_t *edges = malloc(MAX(fa->next_edge_id, 1) * sizeof(fa_frozen_edge_t));
+  size_t *first = calloc(n + 1, sizeof(size_t));
+
+  for (fa_id_t e = 0; e < fa->next_edge_id; ++e) {
+    const fa_edge_t *edge = fa->edges[e];
+    uint32_t id = FA_EPSILON;
+    gpointer found;
+    if (edge->symbol && g_hash_table_lookup_extended(symbol_ids, edge->symbol, NULL, &found)) {
+      id = GPOINTER_TO_UINT(found);
+    } else if (edge->symbol) {
+      id = (uint32_t)symbols_count;
+      g_hash_table_insert(symbol_ids, (gpointer)edge->symbol, GUINT_TO_POINTER(id));
+      symbols[symbols_count++] = edge->symbol;
     }
-    if (do_extend) {
-      mapping->from = (fa_id_t *)realloc(mapping->from, sizeof(fa_id_t) * (mapping->count + 1));
-      mapping->from[mapping->count] = _from;
-      ++mapping->count;
+    edges[e] = (fa_frozen_edge_t){ id, edge->to->id, e };
+    ++first[edge->from->id + 1];
+  }
+  g_hash_table_destroy(symbol_ids);
+
+  fa_frozen_t *frozen = fa_frozen_create(symbols, symbols_count);
+  free(symbols);
+  for (fa_id_t q = 0; q < n; ++q) {
+    fa_frozen_add_node(frozen);
+    frozen->starting[q] = fa->nodes[q]->is_starting;
+    frozen->final[q] = fa->nodes[q]->is_final;
+  }
+
+  // Counting sort by the source node, then by symbol within a node
+  for (fa_id_t q = 0; q < n; ++q) {
+    first[q + 1] += first[q];
+  }
+  size_t *next = malloc((n + 1) * sizeof(size_t));
+  memcpy(next, first, (n + 1) * sizeof(size_t));
+  fa_frozen_edge_t *sorted = malloc(MAX(fa->next_edge_id, 1) * sizeof(fa_frozen_edge_t));
+  for (fa_id_t e = 0; e < fa->next_edge_id; ++e) {
+    sorted[next[fa->edges[e]->from->id]++] = edges[e];
+  }
+  free(next);
+
+  for (fa_id_t q = 0; q < n; ++q) {
+    qsort(&(sorted[first[q]]), first[q + 1] - first[q], sizeof(fa_frozen_edge_t),
+      fa_frozen_edge_cmp);
+    fa_frozen_begin(frozen, q);
+    for (size_t i = first[q]; i < first[q + 1]; ++i) {
+      fa_frozen_add_edge(frozen, sorted[i].symbol, sorted[i].to);
     }
   }
-  return extended;
+  fa_frozen_end(frozen);
+
+  free(sorted);
+  free(first);
+  free(edges);
+  return frozen;
 }
 
-static fa_mapping_t *fa_mapping_find_from(fa_mapping_t *mapping, size_t count, fa_id_t *from) {
-  while (mapping) {
-    if (mapping->count == count) {
-      size_t found = 0;
-      for (size_t i = 0; i < count; ++i) {
-        for (size_t j = 0; j < count; ++j) {
-          if (from[i] == mapping->from[j]) {
-            ++found;
-            break;
-          }
-        }
-      }
-      if (found == count) {
-        return mapping;
-      }
+fa_t *fa_thaw(const fa_frozen_t *frozen) {
+  fa_t *fa = fa_create();
+  for (fa_id_t q = 0; q < frozen->nodes_count; ++q) {
+    fa_node_t *node = fa_get_node(fa, fa_add_node(fa));
+    node->is_starting = frozen->starting[q];
+    node->is_final = frozen->final[q];
+  }
+  for (fa_id_t q = 0; q < frozen->nodes_count; ++q) {
+    // Edges are prepended to their node, so they are added backwards
+    for (size_t e = frozen->offsets[q + 1]; e-- > frozen->offsets[q]; ) {
+      uint32_t symbol = frozen->edge_symbols[e];
+      fa_add_edge(fa, q, (symbol == FA_EPSILON) ? NULL : frozen->symbols[symbol],
+        frozen->edge_targets[e]);
     }
-    mapping = mapping->next;
   }
-  return NULL;
+  return fa;
 }
 
-static fa_mapping_t *fa_mapping_find_to(fa_mapping_t *mapping, fa_id_t to) {
-  while (mapping) {
-    if (mapping->to == to) {
-      return mapping;
-    }
-    mapping = mapping->next;
+void fa_frozen_destroy(fa_frozen_t *frozen) {
+  free(frozen->symbols);
+  free(frozen->offsets);
+  free(frozen->edge_symbols);
+  free(frozen->edge_targets);
+  free(frozen->starting);
+  free(frozen->final);
+  free(frozen);
+}
+
+/** A sorted set of NFA nodes forming one DFA node, see fa_frozen_powerset. */
+typedef struct fa_state_set_t {
+  /** The DFA node. */
+  fa_id_t to;
+  size_t count;
+  fa_id_t from[];
+} fa_state_set_t;
+
+static guint fa_state_set_hash(gconstpointer key) {
+  const fa_state_set_t *set = key;
+  guint hash = (guint)set->count;
+  for (size_t i = 0; i < set->count; ++i) {
+    hash = hash * 31 + (guint)set->from[i];
   }
-  return NULL;
+  return hash;
+}
+
+static gboolean fa_state_set_equal(gconstpointer a, gconstpointer b) {
+  const fa_state_set_t *x = a;
+  const fa_state_set_t *y = b;
+  return x->count == y->count
+    && memcmp(x->from, y->from, x->count * sizeof(fa_id_t)) == 0;
+}
+
+static int fa_id_cmp(const void *a, const void *b) {
+  fa_id_t x = *(const fa_id_t *)a;
+  fa_id_t y = *(const fa_id_t *)b;
+  return (x > y) - (x < y);
 }
 
-static void fa_mapping_add(fa_mapping_t *mapping, fa_mapping_t *next) {
-  fa_mapping_t *next_orig = mapping->next;
-  mapping->next = next;
-  next->prev = mapping;
-  next->next = next_orig;
-  if (next_orig) {
-    next_orig->prev = next;
+/** Growable list of NFA nodes used by fa_frozen_powerset. */
+typedef struct fa_id_list_t {
+  fa_id_t *ids;
+  size_t count;
+  size_t size;
+} fa_id_list_t;
+
+static void fa_id_list_push(fa_id_list_t *list, fa_id_t id) {
+  if (list->count == list->size) {
+    list->size = MAX(list->size * 2, BUCKET_SIZE);
+    list->ids = (fa_id_t *)realloc(list->ids, list->size * sizeof(fa_id_t));
   }
+  list->ids[list->count++] = id;
 }
 
-static void fa_mapping_destroy(fa_mapping_t *mapping) {
-  while (mapping) {
-    fa_mapping_t *next = mapping->next;
-    if (mapping->from) {
-      free(mapping->from);
+/**
+ * Extends `set` (holding `count` nodes) by nodes reachable by epsilon edges.
+ * Nodes stamped with `stamp` in `seen` are already in the set.
+ *
+ * @return The new number of nodes in the set.
+ */
+static size_t fa_closure(const fa_frozen_t *fa, fa_id_t *set, size_t count, size_t *seen, size_t stamp) {
+  // The set itself serves as the stack of nodes to visit
+  for (size_t i = 0; i < count; ++i) {
+    // Epsilon edges are the last ones of a node
+    size_t first = fa->offsets[set[i]];
+    for (size_t e = fa->offsets[set[i] + 1]; e > first && fa->edge_symbols[e - 1] == FA_EPSILON; --e) {
+      fa_id_t to = fa->edge_targets[e - 1];
+      if (seen[to] != stamp) {
+        seen[to] = stamp;
+        set[count++] = to;
+      }
     }
-    free(mapping);
-    mapping = next;
   }
+  return count;
 }
 
-/** Creates a list of unique edge symbols from node mapping. Don't forget
- * to destroy the list when it's no longer necessary! */
-static GSList *fa_mapping_get_edge_symbols(fa_mapping_t *mapping, fa_t *fa) {
-  GSList *symbols = NULL;
-  for (size_t i = 0; i < mapping->count; ++i) {
-    fa_node_t *node_fa = fa_get_node(fa, mapping->from[i]);
-    fa_edge_t *edge = node_fa->edges;
-    while (edge) {
-      if (edge->symbol) {
-        if (!g_slist_find(symbols, (gpointer)edge->symbol)) {
-          symbols = g_slist_append(symbols, (gpointer)edge->symbol);
-        }
-      }
-      edge = edge->next;
+/**
+ * Finds the DFA node of a set of NFA nodes or creates a new one.
+ *
+ * @param sets Hash-consed sets, extended by the new set
+ * @param queue DFA nodes by id, extended by the new set
+ */
+static fa_id_t fa_powerset_node(const fa_frozen_t *fa, fa_frozen_t *powerset, GHashTable *sets,
+  GPtrArray *queue, fa_id_t *from, size_t count) {
+  qsort(from, count, sizeof(fa_id_t), fa_id_cmp);
+
+  fa_state_set_t *set = malloc(sizeof(fa_state_set_t) + count * sizeof(fa_id_t));
+  set->count = count;
+  memcpy(set->from, from, count * sizeof(fa_id_t));
+
+  fa_state_set_t *found = g_hash_table_lookup(sets, set);
+  if (found) {
+    free(set);
+    return found->to;
+  }
+
+  set->to = fa_frozen_add_node(powerset);
+  for (size_t i = 0; i < count; ++i) {
+    if (fa->final[from[i]]) {
+      powerset->final[set->to] = true;
+      break;
     }
   }
-  return symbols;
+  g_hash_table_insert(sets, set, set);
+  g_ptr_array_add(queue, set);
+  return set->to;
 }
 
-static void fa_gather_transition_nodes(fa_node_t *node, const char *symbol, size_t *temp_count, fa_id_t *temp) {
-  fa_edge_t *edge = node->edges;
-  while (edge) {
-    if (fa_edge_cmp(edge, symbol)) {
-      fa_node_t *node_to = edge->to;
-      bool added = false;
-      for (size_t i = 0; i < *temp_count; ++i) {
-        if (temp[i] == node_to->id) {
-          // Node already in temp
-          added = true;
-          break;
+fa_t *fa_create_powerset(fa_t *fa) {
+  return fa_create_powerset_bounded(fa, SIZE_MAX);
+}
+
+fa_t *fa_create_powerset_bounded(fa_t *fa, size_t max_nodes) {
+  fa_frozen_t *frozen = fa_freeze(fa);
+  fa_frozen_t *powerset = fa_frozen_powerset(frozen, max_nodes);
+  fa_frozen_destroy(frozen);
+  if (!powerset) {
+    return NULL;
+  }
+  fa_t *thawed = fa_thaw(powerset);
+  fa_frozen_destroy(powerset);
+  return thawed;
+}
+
+fa_frozen_t *fa_frozen_powerset(const fa_frozen_t *fa, size_t max_nodes) {
+  size_t n = fa->nodes_count;
+  size_t m = fa->symbols_count;
+
+  GHashTable *sets = g_hash_table_new_full(fa_state_set_hash, fa_state_set_equal, free, NULL);
+  GPtrArray *queue = g_ptr_array_new();
+  fa_frozen_t *powerset = fa_frozen_create(fa->symbols, m);
+
+  // A set never holds more than n nodes
+  fa_id_t *temp = malloc(MAX(n, 1) * sizeof(fa_id_t));
+  size_t *seen = calloc(MAX(n, 1), sizeof(size_t));
+  size_t stamp = 0;
+
+  // Targets of the current DFA node grouped by symbol, visited in symbol order
+  fa_id_list_t *moves = calloc(MAX(m, 1), sizeof(fa_id_list_t));
+  uint8_t *used = calloc(MAX(m, 1), sizeof(uint8_t));
+  size_t *used_list = malloc(MAX(m, 1) * sizeof(size_t));
+
+  ++stamp;
+  size_t count = 0;
+  for (fa_id_t i = 0; i < n; ++i) {
+    if (fa->starting[i]) {
+      seen[i] = stamp;
+      temp[count++] = i;
+    }
+  }
+  count = fa_closure(fa, temp, count, seen, stamp);
+  fa_id_t start = fa_powerset_node(fa, powerset, sets, queue, temp, count);
+  powerset->starting[start] = true;
+
+  // Worklist of DFA nodes in order of creation, which is the order their
+  // edges are added in
+  for (size_t head = 0; head < queue->len && powerset; ++head) {
+    fa_state_set_t *set = g_ptr_array_index(queue, head);
+    size_t used_count = 0;
+
+    for (size_t i = 0; i < set->count; ++i) {
+      fa_id_t q = set->from[i];
+      for (size_t e = fa->offsets[q]; e < fa->offsets[q + 1] && fa->edge_symbols[e] != FA_EPSILON; ++e) {
+        size_t a = fa->edge_symbols[e];
+        if (!used[a]) {
+          used[a] = 1;
+          used_list[used_count++] = a;
         }
+        fa_id_list_push(&(moves[a]), fa->edge_targets[e]);
       }
-      if (!added) {
-        temp[(*temp_count)++] = node_to->id;
+    }
+    qsort(used_list, used_count, sizeof(size_t), fa_id_cmp);
+
+    fa_frozen_begin(powerset, set->to);
+    for (size_t u = 0; u < used_count; ++u) {
+      size_t a = used_list[u];
+      ++stamp;
+      count = 0;
+      for (size_t i = 0; i < moves[a].count; ++i) {
+        fa_id_t id = moves[a].ids[i];
+        if (seen[id] != stamp) {
+          seen[id] = stamp;
+          temp[count++] = id;
+        }
       }
-      fa_gather_transition_nodes(node_to, NULL, temp_count, temp);
+      moves[a].count = 0;
+      used[a] = 0;
+      count = fa_closure(fa, temp, count, seen, stamp);
+
+      fa_id_t to = fa_powerset_node(fa, powerset, sets, queue, temp, count);
+      fa_frozen_add_edge(powerset, (uint32_t)a, to);
+    }
+    fa_frozen_end(powerset);
+
+    if (powerset->nodes_count > max_nodes) {
+      fa_frozen_destroy(powerset);
+      powerset = NULL;
     }
-    edge = edge->next;
   }
+
+  for (size_t a = 0; a < m; ++a) {
+    free(moves[a].ids);
+  }
+  free(moves);
+  free(used);
+  free(used_list);
+  free(seen);
+  free(temp);
+  g_ptr_array_free(queue, TRUE);
+  g_hash_table_destroy(sets);
+
+  return powerset;
+}
+
+/** Partition of DFA states into blocks, see fa_minimize. */
+typedef struct fa_partition_t {
+  /** States ordered by blocks; marked states lead each block. */
+  fa_id_t *elems;
+  /** Index of each state in elems. */
+  size_t *loc;
+  /** Block of each state. */
+  size_t *block;
+  size_t *first;
+  size_t *end;
+  size_t *marked;
+  size_t count;
+} fa_partition_t;
+
+static void fa_partition_mark(fa_partition_t *p, fa_id_t q, size_t *touched, size_t *touched_count) {
+  size_t b = p->block[q];
+  size_t i = p->loc[q];
+  size_t m = p->first[b] + p->marked[b];
+
+  if (i < m) {
+    return;
+  }
+  if (p->marked[b] == 0) {
+    touched[(*touched_count)++] = b;
+  }
+
+  fa_id_t other = p->elems[m];
+  p->elems[m] = q;
+  p->loc[q] = m;
+  p->elems[i] = other;
+  p->loc[other] = i;
+  ++p->marked[b];
 }
 
 /**
- * @param fa NFA
- * @param powerset DFA
- * @param mapping From NFA to DFA
- * @param node DFA node
- * @return True if something was modified
+ * Hopcroft's partition refinement. Missing transitions lead to an implicit
+ * dead state, which is dropped from the result together with all states
+ * equivalent to it.
  */
-static bool fa_create_powerset_impl(fa_t *fa, fa_t *powerset, fa_mapping_t *mapping, fa_id_t node) {
-  fa_node_t *node_impl = fa_get_node(powerset, node);
-  fa_mapping_t *node_mapping = fa_mapping_find_to(mapping, node);
-  GSList *unique_symbols = fa_mapping_get_edge_symbols(node_mapping, fa);
-  GSList *current_symbol = unique_symbols;
-
-  for (size_t j = 0; j < node_mapping->count; ++j) {
-    fa_node_t *node_fa = fa_get_node(fa, node_mapping->from[j]);
-    if (node_fa->is_final) {
-      node_impl->is_final = true;
+fa_frozen_t *fa_frozen_minimize(const fa_frozen_t *fa) {
+  size_t n = fa->nodes_count + 1;
+  fa_id_t dead = fa->nodes_count;
+  size_t m = fa->symbols_count;
+
+  // Complete transition function and its inverse in CSR form
+  fa_id_t *delta = malloc(n * MAX(m, 1) * sizeof(fa_id_t));
+  for (size_t i = 0; i < n * m; ++i) {
+    delta[i] = dead;
+  }
+  for (fa_id_t q = 0; q < dead; ++q) {
+    for (size_t e = fa->offsets[q]; e < fa->offsets[q + 1]; ++e) {
+      if (fa->edge_symbols[e] != FA_EPSILON) {
+        delta[q * m + fa->edge_symbols[e]] = fa->edge_targets[e];
+      }
     }
   }
 
-  for (size_t i = 0; i < g_slist_length(unique_symbols); ++i) {
-    const char *symbol = (const char *)current_symbol->data;
-    current_symbol = current_symbol->next;
+  size_t *inv_first = calloc(n * m + 1, sizeof(size_t));
+  fa_id_t *inv = malloc(MAX(n * m, 1) * sizeof(fa_id_t));
+  for (size_t i = 0; i < n * m; ++i) {
+    ++inv_first[delta[i] * m + (i % m) + 1];
+  }
+  for (size_t i = 0; i < n * m; ++i) {
+    inv_first[i + 1] += inv_first[i];
+  }
+  size_t *inv_next = malloc((n * m + 1) * sizeof(size_t));
+  memcpy(inv_next, inv_first, (n * m + 1) * sizeof(size_t));
+  for (size_t i = 0; i < n * m; ++i) {
+    inv[inv_next[delta[i] * m + (i % m)]++] = i / m;
+  }
+  free(inv_next);
+
+  // Initial partition: final and other states
+  fa_partition_t p = {
+    .elems = malloc(n * sizeof(fa_id_t)),
+    .loc = malloc(n * sizeof(size_t)),
+    .block = malloc(n * sizeof(size_t)),
+    .first = malloc(n * sizeof(size_t)),
+    .end = malloc(n * sizeof(size_t)),
+    .marked = calloc(n, sizeof(size_t)),
+    .count = 0,
+  };
+
+  size_t finals = 0;
+  for (fa_id_t q = 0; q < dead; ++q) {
+    finals += fa->final[q];
+  }
+  size_t next_final = 0;
+  size_t next_other = finals;
+  for (fa_id_t q = 0; q < n; ++q) {
+    bool final = (q != dead && fa->final[q]);
+    size_t i = final ? next_final++ : next_other++;
+    p.elems[i] = q;
+    p.loc[q] = i;
+    p.block[q] = (final ? 0 : (finals > 0));
+  }
+  if (finals > 0) {
+    p.first[p.count] = 0;
+    p.end[p.count++] = finals;
+  }
+  p.first[p.count] = finals;
+  p.end[p.count++] = n;
+
+  // Worklist of (block, symbol) splitters
+  uint8_t *in_work = calloc(n * MAX(m, 1), sizeof(uint8_t));
+  size_t *work = malloc(n * MAX(m, 1) * sizeof(size_t));
+  size_t work_count = 0;
+  size_t smaller = (p.count == 2 && p.end[1] - p.first[1] < p.end[0]) ? 1 : 0;
+  for (size_t a = 0; a < m; ++a) {
+    work[work_count++] = smaller * m + a;
+    in_work[smaller * m + a] = 1;
+  }
 
-    if (fa_node_find_edge(node_impl, symbol)) {
-      continue;
-    }
+  fa_id_t *splitter = malloc(n * sizeof(fa_id_t));
+  size_t *touched = malloc(n * sizeof(size_t));
+
+  while (work_count > 0) {
+    size_t item = work[--work_count];
+    size_t s_block = item / m;
+    size_t a = item % m;
+    in_work[item] = 0;
 
-    fa_id_t temp[fa->next_node_id];
-    fa_id_t temp_count = 0;
+    // Copy the splitter, marking reorders the blocks
+    size_t splitter_count = p.end[s_block] - p.first[s_block];
+    memcpy(splitter, &(p.elems[p.first[s_block]]), splitter_count * sizeof(fa_id_t));
 
-    for (size_t j = 0; j < node_mapping->count; ++j) {
-      fa_node_t *node_fa = fa_get_node(fa, node_mapping->from[j]);
-      fa_gather_transition_nodes(node_fa, symbol, &temp_count, temp);
+    size_t touched_count = 0;
+    for (size_t i = 0; i < splitter_count; ++i) {
+      size_t key = splitter[i] * m + a;
+      for (size_t j = inv_first[key]; j < inv_first[key + 1]; ++j) {
+        fa_partition_mark(&p, inv[j], touched, &touched_count);
+      }
     }
 
-    if (temp_count > 0) {
-      fa_mapping_t *m = fa_mapping_find_from(mapping, temp_count, temp);
-      fa_id_t node_to;
+    for (size_t t = 0; t < touched_count; ++t) {
+      size_t b = touched[t];
+      size_t marked = p.marked[b];
+      p.marked[b] = 0;
 
-      if (m) {
-        node_to = m->to;
-        fa_add_edge(powerset, node, symbol, node_to);
-      } else {
-        node_to = fa_add_node(powerset);
-        fa_add_edge(powerset, node, symbol, node_to);
+      if (marked == p.end[b] - p.first[b]) {
+        continue;
+      }
 
-        m = fa_mapping_create(temp_count, temp, node_to);
-        fa_mapping_add(mapping, m);
+      // Marked states form a new block
+      size_t nb = p.count++;
+      p.first[nb] = p.first[b];
+      p.end[nb] = p.first[b] + marked;
+      p.first[b] = p.end[nb];
+      for (size_t i = p.first[nb]; i < p.end[nb]; ++i) {
+        p.block[p.elems[i]] = nb;
       }
 
-      fa_create_powerset_impl(fa, powerset, mapping, node_to);
+      size_t add = (marked <= p.end[b] - p.first[b]) ? nb : b;
+      for (size_t c = 0; c < m; ++c) {
+        size_t target = in_work[b * m + c] ? nb : add;
+        if (!in_work[target * m + c]) {
+          in_work[target * m + c] = 1;
+          work[work_count++] = target * m + c;
+        }
+      }
     }
   }
 
-  g_slist_free(unique_symbols);
-}
-
-fa_t *fa_create_powerset(fa_t *fa) {
-  fa_id_t temp[fa->next_node_id];
-  fa_id_t temp_count = 0;
-
-  fa_t *powerset = fa_create();
-  fa_node_t *start = fa_get_node(powerset, fa_add_node(powerset));
-  start->is_starting = true;
-
-  for (size_t i = 0; i < fa->next_node_id; ++i) {
-    fa_node_t *node = fa_get_node(fa, i);
-    if (node->is_starting) {
-      temp[temp_count++] = node->id;
+  // One node per block, numbered in BFS order from the start
+  size_t *node_of = malloc(p.count * sizeof(size_t));
+  for (size_t b = 0; b < p.count; ++b) {
+    node_of[b] = SIZE_MAX;
+  }
+  size_t dead_block = p.block[dead];
+  fa_frozen_t *minimal = fa_frozen_create(fa->symbols, m);
+  size_t *queue = malloc(p.count * sizeof(size_t));
+  size_t head = 0;
+  size_t tail = 0;
+
+  for (fa_id_t q = 0; q < dead; ++q) {
+    size_t b = p.block[q];
+    if (fa->starting[q] && b != dead_block && node_of[b] == SIZE_MAX) {
+      node_of[b] = fa_frozen_add_node(minimal);
+      minimal->starting[node_of[b]] = true;
+      queue[tail++] = b;
     }
   }
 
-  for (size_t i = 0; i < fa->next_node_id; ++i) {
-    fa_node_t *node = fa_get_node(fa, i);
-    if (node->is_starting) {
-      fa_gather_transition_nodes(node, NULL, &temp_count, temp);
+  // Nodes are dequeued in the order of their ids
+  while (head < tail) {
+    size_t b = queue[head++];
+    fa_id_t q = p.elems[p.first[b]];
+    minimal->final[node_of[b]] = fa->final[q];
+    fa_frozen_begin(minimal, node_of[b]);
+
+    for (size_t a = 0; a < m; ++a) {
+      size_t to = p.block[delta[q * m + a]];
+      if (to == dead_block) {
+        continue;
+      }
+      if (node_of[to] == SIZE_MAX) {
+        node_of[to] = fa_frozen_add_node(minimal);
+        queue[tail++] = to;
+      }
+      fa_frozen_add_edge(minimal, (uint32_t)a, node_of[to]);
     }
+    fa_frozen_end(minimal);
   }
 
-  fa_mapping_t *mapping = fa_mapping_create(temp_count, temp, start->id);
-
-  fa_create_powerset_impl(fa, powerset, mapping, start->id);
-// #ifdef DEBUG
-//   fa_print_impl(powerset, mapping);
-// #endif
-  fa_mapping_destroy(mapping);
-
-  return powerset;
+  free(queue);
+  free(node_of);
+  free(splitter);
+  free(touched);
+  free(work);
+  free(in_work);
+  free(p.elems);
+  free(p.loc);
+  free(p.block);
+  free(p.first);
+  free(p.end);
+  free(p.marked);
+  free(inv);
+  free(inv_first);
+  free(delta);
+
+  return minimal;
 }
 
-static void fa_print_node(fa_node_t *node, fa_mapping_t *mapping, bool show_starting) {
-  fa_mapping_t *node_mapping =
-      mapping ? fa_mapping_find_to(mapping, node->id) : NULL;
+fa_t *fa_minimize(fa_t *fa) {
+  fa_frozen_t *frozen = fa_freeze(fa);
+  fa_frozen_t *minimal = fa_frozen_minimize(frozen);
+  fa_frozen_destroy(frozen);
+  fa_t *thawed = fa_thaw(minimal);
+  fa_frozen_destroy(minimal);
+  return thawed;
+}
 
+static void fa_print_node(fa_node_t *node, bool show_starting) {
   if (show_starting && node->is_starting) {
     printf("-->");
   }
@@ -376,15 +728,7 @@ static void fa_print_node(fa_node_t *node, fa_mapping_t *mapping, bool show_star
     putchar('(');
   }
 
-  if (node_mapping) {
-    putchar('{');
-    for (size_t i = 0; i < node_mapping->count; ++i) {
-      printf("q%lu,", node_mapping->from[i]);
-    }
-    putchar('}');
-  } else {
-    printf("q%lu", node->id);
-  }
+  printf("q%lu", node->id);
 
   if (node->is_final) {
     putchar(')');
@@ -396,27 +740,23 @@ static void fa_print_edge(fa_edge_t *edge) {
   printf("--%s-->", edge->symbol ? edge->symbol : "ε");
 }
 
-static void fa_print_impl(fa_t *fa, fa_mapping_t *mapping) {
+void fa_print(fa_t *fa) {
   for (size_t i = 0; i < fa->next_node_id; ++i) {
     fa_node_t *node = fa->nodes[i];
     fa_edge_t *edge = node->edges;
 
     if (!edge) {
-      fa_print_node(node, mapping, true);
+      fa_print_node(node, true);
       printf("\n");
       continue;
     }
 
     while (edge) {
-      fa_print_node(node, mapping, true);
+      fa_print_node(node, true);
       fa_print_edge(edge);
-      fa_print_node(edge->to, mapping, false);
+      fa_print_node(edge->to, false);
       printf("\n");
       edge = edge->next;
     }
   }
 }
-
-void fa_print(fa_t *fa) {
-  fa_print_impl(fa, NULL);
-}
@@ -58,6 +58,7 @@ bool miner_c_mark_pos(miner_c* self, mark_t* mark) {
 }
 
 bool miner_c_reset_pos(miner_c* self, mark_t* mark) {
+  MINER_STATS_ADD(self, backtracks, (mark->pos < self->stream->pos));
   self->stream->pos = mark->pos;
   self->stream->unicode_offset = mark->unicode_offset;
   stream_c_normalize_position(self->stream);
@@ -211,6 +212,19 @@ bool is_delimiter(char* c) {
 }
 
 bool miner_c_match_delimiter(miner_c* self, dir_e move) {
+  const token_index_t* tokens = self->tokens;
+  char* pos = self->stream->pos;
+
+  if (tokens && token_index_t_covers(tokens, pos)) {
+    if (!(self->can_move(self, move)
+      && token_index_t_is_delimiter(tokens, pos)
+      && self->move(self, move))) {
+      return false;
+    }
+    self->match_last = pos;
+    return true;
+  }
+
   return self->match_fn(self, is_delimiter, move);
 }
 
@@ -280,7 +294,7 @@ occurrence_t* miner_c_make_occurrence(miner_c* self, float prob) {
     .label = self->name,
   };
 
-  occurrence_t* retval = ALLOC(occurrence_t);
+  occurrence_t* retval = (self->scratch ? self->scratch : ALLOC(occurrence_t));
   memcpy(retval, &o, sizeof(occurrence_t));
   return retval;
 }
@@ -298,6 +312,48 @@ void miner_c_set_stream(miner_c* self, stream_c* stream) {
   self->end = NULL;
   self->end_last = NULL;
   self->pos_last = NULL;
+  self->tokens = NULL;
+  self->literal_search = (literal_search_t){ NULL, NULL };
+}
+
+void miner_c_init_clone(miner_c* self, const miner_c* original, size_t size) {
+  memcpy(self, original, size);
+  self->stream = calloc(1, sizeof(stream_c));
+  self->match_last = NULL;
+  self->start = NULL;
+  self->start_unicode = 0;
+  self->end = NULL;
+  self->end_unicode = 0;
+  self->end_last = NULL;
+  self->pos_last = NULL;
+  self->tokens = NULL;
+  self->pending = NULL;
+  self->pending_count = 0;
+  self->scratch = NULL;
+  self->literal_search = (literal_search_t){ NULL, NULL };
+  memset(&(self->stats), 0, sizeof(miner_stats_t));
+}
+
+miner_c* miner_c_clone(miner_c* self) {
+  miner_c* clone = ALLOC(miner_c);
+  miner_c_init_clone(clone, self, sizeof(miner_c));
+  return clone;
+}
+
+char* miner_c_find_literal(miner_c* self, const char* literal, size_t len) {
+  literal_search_t* search = &(self->literal_search);
+  char* pos = self->stream->pos;
+
+  if (search->from && search->from <= pos && (!search->found || search->found >= pos)) {
+    return search->found;
+  }
+
+  size_t rest = self->stream->end - pos;
+  search->from = pos;
+  search->found = (len == 1)
+    ? memchr(pos, *literal, rest)
+    : memmem(pos, rest, literal, len);
+  return search->found;
 }
 
 void miner_c_destroy(miner_c* self) {
@@ -315,9 +371,18 @@ void miner_c_init(miner_c* self, const char* name, void* params, matcher_t match
   self->pos_last = NULL;
   self->allow_empty = false;
   self->matcher = matcher;
+  memset(&(self->stats), 0, sizeof(miner_stats_t));
+  self->tokens = NULL;
+  self->token_anchored = false;
+  self->max_occurrences = 1;
+  self->pending = NULL;
+  self->pending_count = 0;
+  self->scratch = NULL;
+  self->literal_search = (literal_search_t){ NULL, NULL };
 
   self->destroy = miner_c_destroy;
   self->set_stream = miner_c_set_stream;
+  self->clone = miner_c_clone;
   self->run = miner_c_run;
   self->mark_start = miner_c_mark_start;
   self->mark_end = miner_c_mark_end;
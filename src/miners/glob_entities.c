@@ -313,7 +313,10 @@ miner_c* match_glob(const char* glob) {
     fprintf(stderr, "'%s' is not a syntactically correct glob!\n", glob);
     return NULL;
   }
-  return miner_c_create("Glob", (void*)glob, match_glob_impl);
+  miner_c* m = miner_c_create("Glob", (void*)glob, match_glob_impl);
+  // Globs match whole tokens, unless they start with a delimiter
+  m->token_anchored = !starts_with_delimiter(glob);
+  return m;
 }
 
 const char* meta[] = {
@@ -40,6 +40,12 @@ void ner_c_destroy(ner_c* self) {
   miner_c_destroy((miner_c*)self);
 }
 
+ner_c* ner_c_clone(ner_c* self) {
+  ner_c* clone = ALLOC(ner_c);
+  miner_c_init_clone((miner_c*)clone, (miner_c*)self, sizeof(ner_c));
+  return clone;
+}
+
 ner_c* ner_c_create(const char* name, patricia_c* index) {
   ner_c* ner = ALLOC(ner_c);
   ner_c_init(ner, name, index);
@@ -49,5 +55,7 @@ ner_c* ner_c_create(const char* name, patricia_c* index) {
 void ner_c_init(ner_c* self, const char* name, patricia_c* index) {
   miner_c_init((miner_c*)self, name, NULL, match_named_entity);
   self->index = index;
+  self->token_anchored = true;
   self->destroy = (void(*)(miner_c*))ner_c_destroy;
+  self->clone = (miner_c*(*)(miner_c*))ner_c_clone;
 }
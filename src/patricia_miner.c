@@ -17,11 +17,26 @@
 
 #include <nativeextractor/patricia_miner.h>
 
+/**
+ * Destroys a clone, the trie is owned by the original miner.
+ */
+static void patricia_miner_c_destroy_clone(patricia_miner_c *self) {
+  self->destroy_super((miner_c *)self);
+}
+
+patricia_miner_c *patricia_miner_c_clone(patricia_miner_c *self) {
+  patricia_miner_c *clone = ALLOC(patricia_miner_c);
+  miner_c_init_clone(&(clone->base), &(self->base), sizeof(patricia_miner_c));
+  clone->base.destroy = (void (*)(miner_c *self))patricia_miner_c_destroy_clone;
+  return clone;
+}
+
 patricia_miner_c *patricia_miner_c_create(const char* name, void* params, matcher_t matcher) {
   patricia_miner_c *miner = ALLOC(patricia_miner_c);
   miner_c_init(&(miner->base), name, NULL, matcher);
   miner->destroy_super = miner->base.destroy;
   miner->base.destroy = (void (*)(miner_c *self))patricia_miner_c_destroy;
+  miner->base.clone = (miner_c *(*)(miner_c *self))patricia_miner_c_clone;
   miner->patricia = (patricia_c *)params;
   return miner;
 }
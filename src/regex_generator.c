@@ -18,8 +18,19 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
 #include <glib-2.0/glib.h>
 #include <nativeextractor/regex_generator.h>
+#include <nativeextractor/dfa_miner.h>
+#include <nativeextractor/shift_and_miner.h>
 #include <nativeextractor/extractor.h>
 #include <nativeextractor/unicode.h>
 #include <nativeextractor/terminal.h>
@@ -631,6 +642,111 @@ static GNode *transform_closures(GNode *root) {
   return root;
 }
 
+/** Marks symbols of caseless regexes. */
+#define REGEX_CASELESS_PREFIX "(?i)"
+
+/**
+ * Marks the symbols of a caseless regex by REGEX_CASELESS_PREFIX. Such
+ * symbols are other NFA edge symbols than the case-sensitive ones, so they
+ * get their own predicates in a union DFA.
+ */
+static void re_op_fold_case(GNode *tree) {
+  re_op_t *op = (re_op_t *)tree->data;
+  if (op->type == OP_IDENTITY) {
+    char *symbol = g_strconcat(REGEX_CASELESS_PREFIX, op->symbol, NULL);
+    free(op->symbol);
+    op->symbol = symbol;
+  }
+  for (GNode *child = tree->children; child; child = child->next) {
+    re_op_fold_case(child);
+  }
+}
+
+/** Marks the symbols of line anchors of a multiline regex. */
+#define REGEX_MULTILINE_PREFIX "(?m)"
+
+/**
+ * Marks the ^ and $ symbols of a multiline regex by REGEX_MULTILINE_PREFIX,
+ * they become line anchors instead of stream anchors.
+ */
+static void re_op_mark_multiline(GNode *tree) {
+  re_op_t *op = (re_op_t *)tree->data;
+  if (op->type == OP_IDENTITY && (strcmp(op->symbol, "^") == 0 || strcmp(op->symbol, "$") == 0)) {
+    char *symbol = g_strconcat(REGEX_MULTILINE_PREFIX, op->symbol, NULL);
+    free(op->symbol);
+    op->symbol = symbol;
+  }
+  for (GNode *child = tree->children; child; child = child->next) {
+    re_op_mark_multiline(child);
+  }
+}
+
+/** Marks a repetition of a character set counted by the DFA. */
+#define REGEX_COUNTED_PREFIX "(?{"
+
+/** Least count of a repetition counted instead of expanded. */
+#define REGEX_COUNTED_MIN 16
+
+/** Returns true if a symbol is an assertion (^, $, \b or \B). */
+static bool re_symbol_is_assertion(const char *symbol) {
+  for (;;) {
+    if (g_str_has_prefix(symbol, REGEX_CASELESS_PREFIX)) {
+      symbol += strlen(REGEX_CASELESS_PREFIX);
+    } else if (g_str_has_prefix(symbol, REGEX_MULTILINE_PREFIX)) {
+      symbol += strlen(REGEX_MULTILINE_PREFIX);
+    } else {
+      break;
+    }
+  }
+  return strcmp(symbol, "^") == 0 || strcmp(symbol, "$") == 0
+    || strcmp(symbol, "\\b") == 0 || strcmp(symbol, "\\B") == 0;
+}
+
+/**
+ * Marks long repetitions of a single character set by REGEX_COUNTED_PREFIX,
+ * e.g. "(?{1,500})[a-z]". Such a repetition is one NFA edge the DFA counts,
+ * see DFA_PREDICATE_REPEAT, instead of a copy of the set per count.
+ */
+static void re_op_mark_counted(GNode *tree) {
+  re_op_t *op = (re_op_t *)tree->data;
+  if (op->type == OP_RANGE && tree->children && !tree->children->next) {
+    range_t *range = (range_t *)op->data;
+    re_op_t *child = (re_op_t *)tree->children->data;
+    int count = (range->h == -1) ? range->l : range->h;
+    if (child->type == OP_IDENTITY && count >= REGEX_COUNTED_MIN
+        && !re_symbol_is_assertion(child->symbol)) {
+      char *symbol = (range->h == -1)
+        ? g_strdup_printf(REGEX_COUNTED_PREFIX "%d,})%s", range->l, child->symbol)
+        : g_strdup_printf(REGEX_COUNTED_PREFIX "%d,%d})%s", range->l, range->h, child->symbol);
+      free(op->symbol);
+      op->symbol = symbol;
+    }
+  }
+  for (GNode *child = tree->children; child; child = child->next) {
+    re_op_mark_counted(child);
+  }
+}
+
+/**
+ * Skips leading inline flags of an expression, e.g. "(?i)" or "(?im)", and
+ * adds them to `flags`.
+ */
+static const char *regex_inline_flags(const char *expr, int *flags) {
+  if (!g_str_has_prefix(expr, "(?")) {
+    return expr;
+  }
+  int found = 0;
+  const char *c = expr + 2;
+  for (; *c == 'i' || *c == 'm'; ++c) {
+    found |= (*c == 'i') ? REGEX_CASELESS : REGEX_MULTILINE;
+  }
+  if (*c != ')' || !found) {
+    return expr;
+  }
+  *flags |= found;
+  return c + 1;
+}
+
 static GNode *lex_to_op(GNode *root) {
   GNode *form = lex_to_partial_op(root);
 
@@ -649,25 +765,6 @@ static GNode *lex_to_op(GNode *root) {
   return form;
 }
 
-static gchar *join_str(GList *lst_str, const char *delimiter) {
-  if (!lst_str) {
-    return g_strdup("");
-  }
-
-  gchar *accum = g_strdup((const gchar *)lst_str->data);
-
-  lst_str = lst_str->next;
-
-  while (lst_str) {
-    gchar *tmp = accum;
-    accum = g_strdup_printf("%s%s%s", accum, delimiter, (const gchar *)lst_str->data);
-    free(tmp);
-    lst_str = lst_str->next;
-  }
-
-  return accum;
-}
-
 /** A pair of finite automata nodes. Used to return starting and final nodes
  * from functions. */
 typedef struct fa_pair_t {
@@ -724,47 +821,39 @@ static fa_pair_t alternation_to_nfa(GNode *tree, fa_t *nfa) {
   return (fa_pair_t){from, to};
 }
 
-static fa_pair_t closure_to_nfa(GNode *tree, fa_t *nfa) {
-  re_op_t *op = (re_op_t *)tree->data;
+/** Builds `child` once, optionally skipped (* and ?) and repeated (+ and *). */
+static fa_pair_t repeat_to_nfa(GNode *child, fa_t *nfa, bool skip, bool loop) {
   fa_id_t from = fa_add_node(nfa);
   fa_id_t to = fa_add_node(nfa);
 
-  // Can skip in * and ?
-  if (*op->symbol != '+') {
+  if (skip) {
     fa_add_edge(nfa, from, NULL, to);
   }
 
-  fa_pair_t pair = re_op_to_nfa(tree->children, nfa);
+  fa_pair_t pair = re_op_to_nfa(child, nfa);
   fa_add_edge(nfa, from,  NULL, pair.a);
   fa_add_edge(nfa, pair.b,  NULL, to);
 
-  // Can loop in + and *
-  if (*op->symbol != '?') {
+  if (loop) {
     fa_add_edge(nfa, pair.b,  NULL, pair.a);
   }
 
   return (fa_pair_t){from, to};
 }
 
-static GNode *tree_clone_create(GNode *tree) {
-  GNode *clone = g_node_new(tree->data);
-  GNode *child = tree->children;
-  while (child) {
-    g_node_append(clone, tree_clone_create(child));
-    child = child->next;
-  }
-  return clone;
-}
-
-static void tree_clone_destroy(GNode *tree) {
-  GNode *child = tree->children;
-  while (child) {
-    g_node_destroy(child);
-    child = child->next;
-  }
-  g_node_destroy(tree);
+static fa_pair_t closure_to_nfa(GNode *tree, fa_t *nfa) {
+  re_op_t *op = (re_op_t *)tree->data;
+  return repeat_to_nfa(tree->children, nfa, *op->symbol != '+', *op->symbol != '?');
 }
 
+/**
+ * Builds the child `l` times followed by `h - l` optional copies nested as
+ * (x(x(x)?)?)?, so each copy can only be reached from the previous one and
+ * the DFA construction stays linear in the repeat count. A counted
+ * repetition is a single edge instead, see re_op_mark_counted. Generated
+ * code folds chains of states left by the copies into a counter, see
+ * re_chains_find.
+ */
 static fa_pair_t range_to_nfa(GNode *tree, fa_t *nfa) {
   re_op_t *op = (re_op_t *)tree->data;
   range_t *range = (range_t *)op->data;
@@ -772,6 +861,11 @@ static fa_pair_t range_to_nfa(GNode *tree, fa_t *nfa) {
   fa_id_t to = fa_add_node(nfa);
   fa_id_t node = from;
 
+  if (g_str_has_prefix(op->symbol, REGEX_COUNTED_PREFIX)) {
+    fa_add_edge(nfa, from, op->symbol, to);
+    return (fa_pair_t){from, to};
+  }
+
   // Lower
   for (int i = 0; i < range->l; ++i) {
     fa_pair_t pair = re_op_to_nfa(tree->children, nfa);
@@ -780,24 +874,18 @@ static fa_pair_t range_to_nfa(GNode *tree, fa_t *nfa) {
   }
 
   // Upper
-  re_op_t clone_op = (re_op_t){OP_CLOSURE, NULL, NULL};
-  GNode *clone_root = g_node_new(&clone_op);
-  GNode *clone_children = tree_clone_create(tree->children);
-  g_node_append(clone_root, clone_children);
   if (range->h == -1) {
-    clone_op.symbol = "*";
-    fa_pair_t pair = re_op_to_nfa(clone_root, nfa);
+    fa_pair_t pair = repeat_to_nfa(tree->children, nfa, true, true);
     fa_add_edge(nfa, node, NULL, pair.a);
     node = pair.b;
   } else {
-    clone_op.symbol = "?";
     for (int i = range->l; i < range->h; ++i) {
-      fa_pair_t pair = re_op_to_nfa(clone_root, nfa);
+      fa_pair_t pair = re_op_to_nfa(tree->children, nfa);
+      fa_add_edge(nfa, node, NULL, to);
       fa_add_edge(nfa, node, NULL, pair.a);
       node = pair.b;
     }
   }
-  g_node_destroy(clone_root);
 
   fa_add_edge(nfa, node, NULL, to);
   return (fa_pair_t){from, to};
@@ -843,6 +931,217 @@ static fa_t *regex_to_nfa(regex_t *regex) {
   return nfa;
 }
 
+/** Adds sizes in bytes, SIZE_MAX stands for unbounded. */
+static size_t size_add(size_t a, size_t b) {
+  return (a > SIZE_MAX - b) ? SIZE_MAX : a + b;
+}
+
+/** Multiplies sizes in bytes, SIZE_MAX stands for unbounded. */
+static size_t size_mul(size_t a, size_t b) {
+  return (b != 0 && a > SIZE_MAX / b) ? SIZE_MAX : a * b;
+}
+
+/** Literals required by a node of the op tree, see re_op_factor. */
+typedef struct re_factor_t {
+  /** The node always matches exactly this string, NULL if it does not. */
+  GString *fixed;
+  /** The longest literal contained in every match of the node, NULL if none. */
+  GString *literal;
+  /** Maximal distance in bytes from the start of the node to .literal. */
+  size_t offset;
+  /** Maximal length of a match of the node in bytes. */
+  size_t max_len;
+} re_factor_t;
+
+/** Takes over a literal at given offset if it is better than the current one. */
+static void re_factor_offer(re_factor_t *factor, GString *literal, size_t offset) {
+  if (literal->len == 0 || (factor->literal
+      && (literal->len < factor->literal->len
+        || (literal->len == factor->literal->len && offset >= factor->offset)))) {
+    g_string_free(literal, true);
+    return;
+  }
+  if (factor->literal) {
+    g_string_free(factor->literal, true);
+  }
+  factor->literal = literal;
+  factor->offset = offset;
+}
+
+static void re_factor_clear(re_factor_t *factor) {
+  if (factor->fixed) {
+    g_string_free(factor->fixed, true);
+  }
+  if (factor->literal) {
+    g_string_free(factor->literal, true);
+  }
+}
+
+static bool symbol_to_predicate(regex_t *re, const char *symbol, dfa_predicate_t *out);
+
+static void identity_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  re_op_t *op = (re_op_t *)tree->data;
+  dfa_predicate_t predicate;
+
+  out->max_len = 4;
+  if (!symbol_to_predicate(re, op->symbol, &predicate)) {
+    free(predicate.items);
+    return;
+  }
+
+  if (predicate.type != DFA_PREDICATE_SET) {
+    // Anchors are zero-width
+    out->fixed = g_string_new("");
+    out->max_len = 0;
+  } else if (!predicate.negated && predicate.items_count == 1
+      && predicate.items[0].type != DFA_ITEM_FUNCTION
+      && predicate.items[0].from == predicate.items[0].to) {
+    char c[6];
+    int len = g_unichar_to_utf8(predicate.items[0].from, c);
+    out->fixed = g_string_new_len(c, len);
+    out->literal = g_string_new_len(c, len);
+    out->offset = 0;
+    out->max_len = len;
+  } else if (!predicate.negated) {
+    // Sets of ASCII characters match a single byte
+    bool ascii = true;
+    for (size_t i = 0; i < predicate.items_count; ++i) {
+      ascii &= (predicate.items[i].type != DFA_ITEM_FUNCTION && predicate.items[i].to < 0x80);
+    }
+    out->max_len = ascii ? 1 : 4;
+  }
+
+  free(predicate.items);
+}
+
+static void re_op_factor(regex_t *re, GNode *tree, re_factor_t *out);
+
+static void concat_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  size_t prefix = 0;
+  GString *run = NULL;
+  size_t run_offset = 0;
+  out->fixed = g_string_new("");
+
+  for (GNode *child = tree->children; child; child = child->next) {
+    re_factor_t factor = { NULL, NULL, 0, 0 };
+    re_op_factor(re, child, &factor);
+
+    // Adjacent fixed strings form one literal
+    if (factor.fixed) {
+      if (!run) {
+        run = g_string_new("");
+        run_offset = prefix;
+      }
+      g_string_append_len(run, factor.fixed->str, factor.fixed->len);
+      if (out->fixed) {
+        g_string_append_len(out->fixed, factor.fixed->str, factor.fixed->len);
+      }
+    } else {
+      if (run) {
+        re_factor_offer(out, run, run_offset);
+        run = NULL;
+      }
+      if (out->fixed) {
+        g_string_free(out->fixed, true);
+        out->fixed = NULL;
+      }
+    }
+
+    if (factor.literal) {
+      re_factor_offer(out, factor.literal, size_add(prefix, factor.offset));
+      factor.literal = NULL;
+    }
+    prefix = size_add(prefix, factor.max_len);
+    re_factor_clear(&factor);
+  }
+
+  if (run) {
+    re_factor_offer(out, run, run_offset);
+  }
+  out->max_len = prefix;
+}
+
+static void alternation_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  out->max_len = 0;
+  for (GNode *child = tree->children; child; child = child->next) {
+    re_factor_t factor = { NULL, NULL, 0, 0 };
+    re_op_factor(re, child, &factor);
+    out->max_len = MAX(out->max_len, factor.max_len);
+    re_factor_clear(&factor);
+  }
+}
+
+static void closure_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  re_op_t *op = (re_op_t *)tree->data;
+  re_factor_t factor = { NULL, NULL, 0, 0 };
+  re_op_factor(re, tree->children, &factor);
+
+  if (*op->symbol == '+') {
+    // The first iteration starts with the closure
+    out->literal = g_steal_pointer(&(factor.literal));
+    out->offset = factor.offset;
+  }
+  out->max_len = (*op->symbol == '?') ? factor.max_len : SIZE_MAX;
+  re_factor_clear(&factor);
+}
+
+static void range_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  range_t *range = (range_t *)((re_op_t *)tree->data)->data;
+  re_factor_t factor = { NULL, NULL, 0, 0 };
+  re_op_factor(re, tree->children, &factor);
+
+  if (range->l > 0) {
+    if (factor.fixed) {
+      GString *repeated = g_string_new("");
+      for (int i = 0; i < range->l; ++i) {
+        g_string_append_len(repeated, factor.fixed->str, factor.fixed->len);
+      }
+      if (range->h == range->l) {
+        out->fixed = g_string_new_len(repeated->str, repeated->len);
+      }
+      re_factor_offer(out, repeated, 0);
+    } else if (factor.literal) {
+      re_factor_offer(out, g_steal_pointer(&(factor.literal)), factor.offset);
+    }
+  }
+  out->max_len = (range->h == -1) ? SIZE_MAX : size_mul(factor.max_len, range->h);
+  re_factor_clear(&factor);
+}
+
+/**
+ * Finds literals required by an op tree. Every match of the tree contains
+ * out->literal starting at most out->offset bytes after the match start.
+ */
+static void re_op_factor(regex_t *re, GNode *tree, re_factor_t *out) {
+  re_op_t *op = (re_op_t *)tree->data;
+
+  switch (op->type) {
+    case OP_IDENTITY:
+      identity_factor(re, tree, out);
+      break;
+
+    case OP_CONCAT:
+      concat_factor(re, tree, out);
+      break;
+
+    case OP_ALTERNATION:
+      alternation_factor(re, tree, out);
+      break;
+
+    case OP_CLOSURE:
+      closure_factor(re, tree, out);
+      break;
+
+    case OP_RANGE:
+      range_factor(re, tree, out);
+      break;
+
+    default:
+      out->max_len = SIZE_MAX;
+      break;
+  }
+}
+
 static void free_string_list(GList **list) {
   GList *current = *list;
   while (current) {
@@ -852,17 +1151,13 @@ static void free_string_list(GList **list) {
   g_list_free(g_steal_pointer(list));
 }
 
-static gchar *join_str_and_free(GList **code, const char *delimiter) {
-  gchar *str = join_str(*code, "");
-  free_string_list(code);
-  return str;
-}
-
 #define TYPE_STRING 0
 #define TYPE_FUNCTION 1
 #define TYPE_RANGE 2
 #define TYPE_LINEBEGIN 3
 #define TYPE_LINEEND 4
+#define TYPE_WORDBOUNDARY 5
+#define TYPE_NOTWORDBOUNDARY 6
 
 typedef struct someshit_t {
   int type;
@@ -973,10 +1268,16 @@ static bool str_to_match_fn(regex_t *re, char **str, bool is_group, someshit_t *
           out->str = g_strdup("\\v");
           return true;
 
-        // Word boundary
+        // Word boundary, escaped letters in groups
         case 'b':
-          // TODO: Implement word boundary matching!
-          break;
+        case 'B':
+          if (!is_group) {
+            out->type = (*(*str + 1) == 'b') ? TYPE_WORDBOUNDARY : TYPE_NOTWORDBOUNDARY;
+            out->str = NULL;
+            *str += 2;
+            return true;
+          }
+          // fall through
 
         // Escaped chars
         default: {
@@ -1040,184 +1341,847 @@ static bool str_to_match_fn(regex_t *re, char **str, bool is_group, someshit_t *
   return false;
 }
 
-static gchar *edges_to_code(regex_t *re, fa_node_t *node, GList **code_global) {
-  GList *code = NULL;
-  fa_edge_t *edge = node->edges;
+/** Class functions the regex syntax maps to, by their generated names. */
+static const struct {
+  const char *name;
+  match_fn_t fn;
+} class_functions[] = {
+  { "unicode_not_islinebreak", unicode_not_islinebreak },
+  { "unicode_isspace", unicode_isspace },
+  { "unicode_not_isspace", unicode_not_isspace },
+  { "unicode_isw", unicode_isw },
+  { "unicode_not_isw", unicode_not_isw },
+  { "unicode_isalpha", unicode_isalpha },
+  { "unicode_not_isalpha", unicode_not_isalpha },
+};
+
+/** Converts unicode_to_int value back to a code point. */
+static uint32_t packed_to_codepoint(uint32_t packed) {
+  char c[5] = { 0 };
+  int size = (packed > 0xFFFFFF) ? 4 : (packed > 0xFFFF) ? 3 : (packed > 0xFF) ? 2 : 1;
+  for (int i = size - 1; i >= 0; --i) {
+    c[i] = (char)(packed & 0xFF);
+    packed >>= 8;
+  }
+  return g_utf8_get_char(c);
+}
+
+/** Converts one item parsed by str_to_match_fn to a DFA item. */
+static bool someshit_to_item(someshit_t *someshit, dfa_item_t *item) {
+  if (someshit->type == TYPE_STRING) {
+    // Strings are escaped for the generated C code
+    char *str = (someshit->str[0] == '\\' && someshit->str[1])
+      ? g_strcompress(someshit->str) : g_strdup(someshit->str);
+    item->type = DFA_ITEM_CHAR;
+    item->from = item->to = g_utf8_get_char(str);
+    free(str);
+    free(someshit->str);
+    return true;
+  }
+
+  if (someshit->type == TYPE_RANGE) {
+    item->type = DFA_ITEM_RANGE;
+    item->from = packed_to_codepoint(someshit->from);
+    item->to = packed_to_codepoint(someshit->to);
+    return true;
+  }
+
+  if (someshit->type == TYPE_FUNCTION) {
+    for (size_t i = 0; i < sizeof(class_functions) / sizeof(class_functions[0]); ++i) {
+      if (strcmp(class_functions[i].name, someshit->str) == 0) {
+        item->type = DFA_ITEM_FUNCTION;
+        item->fn = class_functions[i].fn;
+        free(someshit->str);
+        return true;
+      }
+    }
+    free(someshit->str);
+  }
+
+  return false;
+}
+
+static int gunichar_compare(const void *a, const void *b) {
+  gunichar x = *(const gunichar *)a;
+  gunichar y = *(const gunichar *)b;
+  return (x > y) - (x < y);
+}
 
+/**
+ * Adds the other cases of the characters of a predicate as items, so the
+ * character classes of the DFA fold case and nothing is converted when
+ * matching. Class functions are left as they are, they do not tell case.
+ */
+static void predicate_fold_case(dfa_predicate_t *predicate) {
+  size_t capacity = 16;
+  size_t count = 0;
+  gunichar *folded = malloc(capacity * sizeof(gunichar));
+
+  for (size_t i = 0; i < predicate->items_count; ++i) {
+    const dfa_item_t *item = &(predicate->items[i]);
+    if (item->type == DFA_ITEM_FUNCTION) {
+      continue;
+    }
+    for (gunichar c = item->from; c <= item->to; ++c) {
+      gunichar cases[3] = { g_unichar_tolower(c), g_unichar_toupper(c), g_unichar_totitle(c) };
+      for (int k = 0; k < 3; ++k) {
+        if (cases[k] == c) {
+          continue;
+        }
+        if (count == capacity) {
+          capacity *= 2;
+          folded = realloc(folded, capacity * sizeof(gunichar));
+        }
+        folded[count++] = cases[k];
+      }
+    }
+  }
+  qsort(folded, count, sizeof(gunichar), gunichar_compare);
+
+  // Runs of consecutive characters become ranges
+  for (size_t i = 0; i < count; ) {
+    gunichar from = folded[i];
+    gunichar to = from;
+    while (++i < count && folded[i] <= to + 1) {
+      to = folded[i];
+    }
+    predicate->items = realloc(predicate->items, (predicate->items_count + 1) * sizeof(dfa_item_t));
+    predicate->items[predicate->items_count++] = (dfa_item_t){
+      .type = (from == to) ? DFA_ITEM_CHAR : DFA_ITEM_RANGE,
+      .from = from,
+      .to = to,
+    };
+  }
+
+  free(folded);
+}
+
+/** Parses a NFA edge symbol without a prefix to a DFA predicate. */
+static bool symbol_parse_predicate(regex_t *re, const char *symbol, dfa_predicate_t *out) {
+  char *str = (char *)symbol;
+  bool is_group = (*str == '[');
   someshit_t someshit;
 
-  while (edge) {
-    code = g_list_append(code, g_strdup("  if (false"));
+  out->type = DFA_PREDICATE_SET;
+  out->negated = false;
+  out->items_count = 0;
+  out->items = NULL;
+
+  if (!is_group) {
+    if (!str_to_match_fn(re, &str, false, &someshit)) {
+      return false;
+    }
+    if (someshit.type == TYPE_LINEBEGIN) {
+      out->type = DFA_PREDICATE_LINEBEGIN;
+      return true;
+    }
+    if (someshit.type == TYPE_LINEEND) {
+      out->type = DFA_PREDICATE_LINEEND;
+      return true;
+    }
+    if (someshit.type == TYPE_WORDBOUNDARY) {
+      out->type = DFA_PREDICATE_WORD_BOUNDARY;
+      return true;
+    }
+    if (someshit.type == TYPE_NOTWORDBOUNDARY) {
+      out->type = DFA_PREDICATE_NOT_WORD_BOUNDARY;
+      return true;
+    }
+    out->items = ALLOC(dfa_item_t);
+    out->items_count = 1;
+    return someshit_to_item(&someshit, out->items);
+  }
+
+  ++str;
+  out->negated = (*str == '^');
+  if (out->negated) {
+    ++str;
+  }
 
-    char *str = (char *)edge->symbol;
-    bool is_group = (*str == '[');
-    bool is_negation = false;
+  size_t capacity = 4;
+  out->items = malloc(capacity * sizeof(dfa_item_t));
 
-    if (is_group) {
-      // Handle [] groups
-      ++str;
+  while (*str != ']') {
+    if (!str_to_match_fn(re, &str, true, &someshit)) {
+      return false;
+    }
+    if (out->items_count == capacity) {
+      capacity *= 2;
+      out->items = realloc(out->items, capacity * sizeof(dfa_item_t));
+    }
+    if (!someshit_to_item(&someshit, &(out->items[out->items_count++]))) {
+      return false;
+    }
+  }
 
-      code = g_list_append(code, g_strdup_printf("\n    || e->match_fn(e, unicode_isgroup_%s_%lu, Right)", re->naming, edge->id));
-      *code_global = g_list_append(*code_global, g_strdup_printf("// %s\nstatic bool unicode_isgroup_%s_%lu(char *c) {\n  return (false", edge->symbol, re->naming, edge->id));
+  return true;
+}
+
+/**
+ * Parses a NFA edge symbol to a DFA predicate. Symbols of caseless regexes
+ * start with REGEX_CASELESS_PREFIX, see re_op_fold_case, anchors of
+ * multiline ones with REGEX_MULTILINE_PREFIX, see re_op_mark_multiline.
+ */
+static bool symbol_to_predicate(regex_t *re, const char *symbol, dfa_predicate_t *out) {
+  if (g_str_has_prefix(symbol, REGEX_COUNTED_PREFIX)) {
+    // "(?{l,h})" or "(?{l,})" followed by the symbol of the set
+    char *end;
+    unsigned long l = strtoul(symbol + strlen(REGEX_COUNTED_PREFIX), &end, 10);
+    unsigned long h = (end[1] == '}') ? DFA_REPEAT_UNBOUNDED : strtoul(end + 1, &end, 10);
+    const char *set = strstr(symbol, "})") + 2;
+    if (!symbol_to_predicate(re, set, out) || out->type != DFA_PREDICATE_SET) {
+      return false;
+    }
+    out->type = DFA_PREDICATE_REPEAT;
+    out->min = (uint32_t)l;
+    out->max = (uint32_t)h;
+    return true;
+  }
+
+  bool caseless = false;
+  bool multiline = false;
+  for (;;) {
+    if (g_str_has_prefix(symbol, REGEX_CASELESS_PREFIX)) {
+      caseless = true;
+      symbol += strlen(REGEX_CASELESS_PREFIX);
+    } else if (g_str_has_prefix(symbol, REGEX_MULTILINE_PREFIX)) {
+      multiline = true;
+      symbol += strlen(REGEX_MULTILINE_PREFIX);
+    } else {
+      break;
+    }
+  }
+
+  if (!symbol_parse_predicate(re, symbol, out)) {
+    return false;
+  }
+  if (caseless && out->type == DFA_PREDICATE_SET) {
+    predicate_fold_case(out);
+  }
+  if (multiline && out->type == DFA_PREDICATE_LINEBEGIN) {
+    out->type = DFA_PREDICATE_MULTILINE_BEGIN;
+  }
+  if (multiline && out->type == DFA_PREDICATE_LINEEND) {
+    out->type = DFA_PREDICATE_MULTILINE_END;
+  }
+  return true;
+}
 
-      is_negation = (*str == '^');
-      if (is_negation) {
-        ++str;
-        *code_global = g_list_append(*code_global, g_strdup(" || !(false"));
+/** Creates a table DFA matching any of the NFAs, labeled by regex expressions. */
+static dfa_t *regex_nfas_to_dfa(regex_t **res, fa_t **nfas, size_t nfas_count) {
+  GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+  size_t count = 0;
+  size_t capacity = 16;
+  const char **symbols = malloc(capacity * sizeof(char *));
+  size_t *owners = malloc(capacity * sizeof(size_t));
+
+  for (size_t i = 0; i < nfas_count; ++i) {
+    for (fa_id_t id = 0; id < nfas[i]->next_edge_id; ++id) {
+      const char *symbol = fa_get_edge(nfas[i], id)->symbol;
+      if (!symbol || g_hash_table_contains(seen, symbol)) {
+        continue;
       }
+      if (count == capacity) {
+        capacity *= 2;
+        symbols = realloc(symbols, capacity * sizeof(char *));
+        owners = realloc(owners, capacity * sizeof(size_t));
+      }
+      g_hash_table_insert(seen, (gpointer)symbol, (gpointer)symbol);
+      owners[count] = i;
+      symbols[count++] = symbol;
+    }
+  }
+  g_hash_table_destroy(seen);
 
-      while (*str != ']') {
-        if (!str_to_match_fn(re, &str, is_group, &someshit)) {
-          free_string_list(&code);
-          return NULL;
-        }
+  dfa_predicate_t *predicates = calloc(MAX(count, 1), sizeof(dfa_predicate_t));
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; ++i) {
+    ok = symbol_to_predicate(res[owners[i]], symbols[i], &(predicates[i]));
+  }
 
-        if (someshit.type == TYPE_STRING) {
-          *code_global = g_list_append(*code_global, g_strdup_printf("\n    || cmp_unicode(c, \"%s\")", someshit.str));
-          free(someshit.str);
-        } else if (someshit.type == TYPE_FUNCTION) {
-          *code_global = g_list_append(*code_global, g_strdup_printf("\n    || %s(c)", someshit.str));
-          free(someshit.str);
-        } else if (someshit.type == TYPE_RANGE) {
-          *code_global = g_list_append(*code_global, g_strdup_printf("\n    || (unicode_to_int(c) >= %d && unicode_to_int(c) <= %d)", someshit.from, someshit.to));
-        } else {
-          re->errors = g_list_append(re->errors, g_strdup("An unexpected error has occurred!"));
-          free_string_list(&code);
-          return NULL;
-        }
+  dfa_t *dfa = NULL;
+  if (ok) {
+    const char **labels = malloc(MAX(nfas_count, 1) * sizeof(char *));
+    for (size_t i = 0; i < nfas_count; ++i) {
+      labels[i] = res[i]->re_expr;
+    }
+    dfa = dfa_create_union(nfas, labels, nfas_count, symbols, predicates, count);
+    free(labels);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    free(predicates[i].items);
+  }
+  free(predicates);
+  free(owners);
+  free(symbols);
+
+  return dfa;
+}
+
+/** Creates the table DFA of a regex from its NFA. */
+static dfa_t *regex_nfa_to_dfa(regex_t *re, fa_t *nfa) {
+  return regex_nfas_to_dfa(&re, &nfa, 1);
+}
+
+/** Appends a C array initializer. */
+static void array_to_code(GString *code, const char *type, const char *name,
+  const char *naming, const void *data, size_t count, size_t item_size) {
+  g_string_append_printf(code, "static %s %s_%s[] = {", type, name, naming);
+  for (size_t i = 0; i < MAX(count, 1); ++i) {
+    uint32_t value = 0;
+    if (count > 0) {
+      value = (item_size == sizeof(uint16_t))
+        ? ((const uint16_t *)data)[i] : ((const uint32_t *)data)[i];
+    }
+    g_string_append_printf(code, "%s%s%u", (i ? "," : ""), ((i % 16) ? " " : "\n  "), value);
+  }
+  g_string_append(code, "\n};\n\n");
+}
+
+/** Minimal number of states folded into a counter by the generated code. */
+#define REGEX_CHAIN_MIN 4
+
+/**
+ * Counted repetition builds runs of DFA states doing the same work once per
+ * repeat. Such runs are found as tracks T[1] .. T[m]: on every class the
+ * member T[i], i < m, either moves to the same state for all i, or to the
+ * member i + d of some track for a fixed d. Generated code keeps each track
+ * in a single state and the index in a counter shared by the tracks, only
+ * the last members are handled separately.
+ */
+typedef struct re_chains_t {
+  /** Per state the first member of its track, the state itself if none. */
+  uint32_t *head;
+  /** Per state its 1-based index in its track, 0 if none. */
+  uint32_t *index;
+  /** Per head the number of members of its track. */
+  uint32_t *length;
+  /** Per head the second member of its track. */
+  uint32_t *second;
+  /** Per head the last member of its track. */
+  uint32_t *last;
+  /** True if any track was found. */
+  bool any;
+} re_chains_t;
+
+/**
+ * Proposes tracks with `s` followed by `t`: if T[i] is followed by T[i + 1],
+ * their targets by any class follow each other too. Fills `follow` (DFA_DEAD
+ * for last members) and `touched` with the states it was set for.
+ *
+ * @return false if the states do not line up.
+ */
+static bool re_chains_propose(const dfa_t *dfa, const re_chains_t *chains,
+  uint32_t s, uint32_t t, uint32_t *follow, uint32_t *touched,
+  uint32_t *touched_count, size_t *budget) {
+  follow[s] = t;
+  touched[(*touched_count)++] = s;
+
+  for (uint32_t q = 0; q < *touched_count; ++q) {
+    uint32_t x = touched[q];
+    uint32_t y = follow[x];
+    if (y == DFA_DEAD) {
+      continue;
+    }
+    for (uint32_t c = 0; c < dfa->classes_count; ++c) {
+      uint32_t a = dfa_step(dfa, x, c);
+      uint32_t b = dfa_step(dfa, y, c);
+      if (a == b || a == DFA_DEAD) {
+        continue;
+      }
+      if (*budget == 0) {
+        return false;
       }
+      --(*budget);
 
-      if (is_negation) {
-        *code_global = g_list_append(*code_global, g_strdup(")"));
+      // Targets which cannot follow each other are last members
+      bool last = (b == DFA_DEAD || chains->index[a] || chains->index[b]
+        || dfa_is_accepting(dfa, a) != dfa_is_accepting(dfa, b));
+      for (uint32_t d = 0; d < dfa->classes_count && !last; ++d) {
+        last = ((dfa_step(dfa, a, d) == DFA_DEAD) != (dfa_step(dfa, b, d) == DFA_DEAD));
       }
-      *code_global = g_list_append(*code_global, g_strdup(");\n}\n\n"));
+      uint32_t want = (last ? DFA_DEAD : b);
+      if (follow[a] == DFA_UNKNOWN) {
+        follow[a] = want;
+        touched[(*touched_count)++] = a;
+      } else if (follow[a] != want) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
-    } else {
-      // Single character
-      if (!str_to_match_fn(re, &str, is_group, &someshit)) {
-        free_string_list(&code);
-        return NULL;
+/** Checks the tracks listed one after another in `members`. */
+static bool re_chains_verify(const dfa_t *dfa, const re_chains_t *chains,
+  const uint32_t *members, uint32_t count) {
+  uint32_t longest = 0;
+  for (uint32_t k = 0; k < count; k += chains->length[members[k]]) {
+    const uint32_t *track = &(members[k]);
+    uint32_t length = chains->length[track[0]];
+    longest = MAX(longest, length);
+
+    bool accepting = dfa_is_accepting(dfa, track[0]);
+    for (uint32_t i = 0; i < length; ++i) {
+      if (dfa_is_accepting(dfa, track[i]) != accepting
+          || (dfa->counts && dfa->counts[track[i]].op != DFA_COUNT_KEEP)) {
+        return false;
       }
+    }
+    if (length < 2) {
+      continue;
+    }
 
-      if (someshit.type == TYPE_STRING) {
-        code = g_list_append(code, g_strdup_printf("\n    || e->match(e, \"%s\", Right)", someshit.str));
-        free(someshit.str);
-      } else if (someshit.type == TYPE_FUNCTION) {
-        code = g_list_append(code, g_strdup_printf("\n    || e->match_fn(e, %s, Right)", someshit.str));
-        free(someshit.str);
-      } else if (someshit.type == TYPE_LINEBEGIN) {
-        // TODO: Add support for multiline matching.
-        code = g_list_append(code, g_strdup("\n    || !e->can_move(e, Left)"));
-      } else if (someshit.type == TYPE_LINEEND) {
-        // TODO: Add support for multiline matching.
-        code = g_list_append(code, g_strdup("\n    || !e->can_move(e, Right)"));
-      } else {
-        re->errors = g_list_append(re->errors, g_strdup("An unexpected error has occurred!"));
-        free_string_list(&code);
-        return NULL;
+    // All but the last member move to one state, or along one track
+    for (uint32_t c = 0; c < dfa->classes_count; ++c) {
+      uint32_t first = dfa_step(dfa, track[0], c);
+      bool constant = (first == dfa_step(dfa, track[1], c));
+      uint32_t to = chains->head[first];
+      uint32_t shift = chains->index[first];
+      if (!constant && (shift == 0 || length - 2 + shift > chains->length[to])) {
+        return false;
+      }
+      for (uint32_t i = 0; i + 1 < length; ++i) {
+        uint32_t target = dfa_step(dfa, track[i], c);
+        if (constant ? (target != first)
+            : (chains->head[target] != to || chains->index[target] != i + shift)) {
+          return false;
+        }
       }
     }
+  }
+  return longest >= REGEX_CHAIN_MIN;
+}
+
+static void re_chains_find(const dfa_t *dfa, re_chains_t *chains) {
+  uint32_t n = dfa->states_count;
+  chains->head = malloc(n * sizeof(uint32_t));
+  chains->index = calloc(n, sizeof(uint32_t));
+  chains->length = calloc(n, sizeof(uint32_t));
+  chains->second = calloc(n, sizeof(uint32_t));
+  chains->last = calloc(n, sizeof(uint32_t));
+  chains->any = false;
+
+  uint32_t *follow = malloc(n * sizeof(uint32_t));
+  uint32_t *touched = malloc(n * sizeof(uint32_t));
+  uint32_t *members = malloc(n * sizeof(uint32_t));
+  bool *preceded = calloc(n, sizeof(bool));
+  for (uint32_t st = 0; st < n; ++st) {
+    chains->head[st] = st;
+    follow[st] = DFA_UNKNOWN;
+  }
+  // Failed proposals may not make code generation quadratic
+  size_t budget = (size_t)64 * n * dfa->classes_count;
+
+  for (uint32_t s = 1; s < n; ++s) {
+    for (uint32_t c = 0; c < dfa->classes_count && !chains->index[s]; ++c) {
+      uint32_t t = dfa_step(dfa, s, c);
+      if (t == s || t == DFA_DEAD || chains->index[t]
+          || dfa_is_accepting(dfa, s) != dfa_is_accepting(dfa, t)) {
+        continue;
+      }
 
-    code = g_list_append(code, g_strdup_printf(
-      ") {\n"
-      "    return state_%s_%lu(e);\n"
-      "  }\n",
-      re->naming, edge->to->id
-    ));
+      uint32_t touched_count = 0;
+      uint32_t count = 0;
+      bool ok = re_chains_propose(dfa, chains, s, t, follow, touched, &touched_count, &budget);
 
-    edge = edge->next;
+      // Each state follows at most one other
+      for (uint32_t k = 0; k < touched_count && ok; ++k) {
+        uint32_t y = follow[touched[k]];
+        if (y != DFA_DEAD) {
+          ok = !preceded[y];
+          preceded[y] = true;
+        }
+      }
+
+      // Tracks start by states following no other one, cycles have no start
+      for (uint32_t k = 0; k < touched_count && ok; ++k) {
+        uint32_t h = touched[k];
+        if (preceded[h]) {
+          continue;
+        }
+        uint32_t x = h;
+        uint32_t i = 0;
+        while (ok) {
+          ok = (chains->index[x] == 0);
+          chains->head[x] = h;
+          chains->index[x] = ++i;
+          members[count++] = x;
+          if (follow[x] == DFA_DEAD || follow[x] == DFA_UNKNOWN) {
+            break;
+          }
+          x = follow[x];
+        }
+        chains->length[h] = i;
+        chains->second[h] = (i > 1 ? follow[h] : DFA_DEAD);
+        chains->last[h] = x;
+      }
+      for (uint32_t k = 0; k < touched_count && ok; ++k) {
+        ok = (chains->index[touched[k]] != 0);
+      }
+      ok = ok && count > 0 && re_chains_verify(dfa, chains, members, count);
+
+      for (uint32_t k = 0; k < touched_count; ++k) {
+        uint32_t x = touched[k];
+        if (follow[x] != DFA_DEAD) {
+          preceded[follow[x]] = false;
+        }
+        follow[x] = DFA_UNKNOWN;
+      }
+      if (!ok) {
+        for (uint32_t k = 0; k < count; ++k) {
+          uint32_t x = members[k];
+          chains->head[x] = x;
+          chains->index[x] = 0;
+        }
+      }
+      chains->any |= ok;
+    }
   }
 
-  return join_str_and_free(&code, "\n");
+  free(preceded);
+  free(members);
+  free(touched);
+  free(follow);
 }
 
-static gchar *starting_nodes_to_code(regex_t * re, fa_t *dfa) {
-  const char *format =
-      "  e->reset_pos(e, &mark);\n"
-      "  if (state_%s_%lu(e)) {\n"
-      "    e->mark_end(e);\n"
-      "    return e->make_occurrence(e, 1.0);\n"
-      "  }\n";
+static void re_chains_clear(re_chains_t *chains) {
+  free(chains->head);
+  free(chains->index);
+  free(chains->length);
+  free(chains->second);
+  free(chains->last);
+}
 
-  GList *code = NULL;
+/**
+ * Generates entering a state, which sets the counter of a track member or
+ * applies the counter action of the state, see dfa_count. Pass NULL for
+ * `dfa` to enter the state without its action.
+ */
+static void re_chains_goto(GString *code, const dfa_t *dfa, const re_chains_t *chains,
+  uint32_t to) {
+  const dfa_count_t *count = ((dfa && dfa->counts) ? &(dfa->counts[to]) : NULL);
+  if (count && count->op == DFA_COUNT_RESET) {
+    g_string_append_printf(code, "state = %u; repeats = 1;", to);
+  } else if (count && count->op == DFA_COUNT_INCREMENT) {
+    g_string_append_printf(code, "if (++repeats == %u) { ", count->limit);
+    re_chains_goto(code, NULL, chains, count->next);
+    g_string_append_printf(code, " } else { state = %u; }", to);
+  } else if (chains->index[to]) {
+    g_string_append_printf(code, "state = %u; count = %u;", chains->head[to], chains->index[to]);
+  } else {
+    g_string_append_printf(code, "state = %u;", to);
+  }
+}
 
-  for (fa_id_t id = 0; id < dfa->next_node_id; ++id) {
-    fa_node_t *node = dfa->nodes[id];
-    if (!node->is_starting) {
+/**
+ * Generates the switch over classes [first, last) of a state, classes with
+ * the same action share a case. For a track head `inside` selects its
+ * members but the last. Context classes keep other states as they are.
+ */
+static void re_chains_switch(GString *code, const dfa_t *dfa,
+  const re_chains_t *chains, uint32_t st, bool inside, uint32_t first,
+  uint32_t last, const char *indent) {
+  bool contexts = (first >= dfa_chars_count(dfa));
+  GString **actions = calloc(last, sizeof(GString *));
+  uint32_t from = (chains->index[st] && !inside) ? chains->last[st] : st;
+
+  for (uint32_t c = first; c < last; ++c) {
+    uint32_t to = dfa_step(dfa, from, c);
+    if (to == DFA_DEAD || (contexts && to == st && !chains->index[st])) {
       continue;
     }
-    gchar *node_code = g_strdup_printf(format, re->naming, id);
-    code = g_list_append(code, node_code);
+    actions[c] = g_string_new("");
+    if (inside && to != dfa_step(dfa, chains->second[st], c)) {
+      // Moves along a track, the counter is shared
+      uint32_t shift = chains->index[to] - 1;
+      g_string_append_printf(actions[c], "state = %u;", chains->head[to]);
+      if (shift == 1) {
+        g_string_append(actions[c], " ++count;");
+      } else if (shift > 1) {
+        g_string_append_printf(actions[c], " count += %u;", shift);
+      }
+    } else {
+      re_chains_goto(actions[c], dfa, chains, to);
+    }
   }
 
-  return join_str_and_free(&code, "\n");
+  g_string_append_printf(code, "%sswitch (c) {\n", indent);
+  for (uint32_t c = first; c < last; ++c) {
+    if (!actions[c]) {
+      continue;
+    }
+    g_string_append_printf(code, "%s  case %u: ", indent, c);
+    for (uint32_t k = c + 1; k < last; ++k) {
+      if (actions[k] && g_string_equal(actions[k], actions[c])) {
+        g_string_append_printf(code, "case %u: ", k);
+        g_string_free(actions[k], true);
+        actions[k] = NULL;
+      }
+    }
+    g_string_append_printf(code, "%s break;\n", actions[c]->str);
+    g_string_free(actions[c], true);
+  }
+  g_string_append_printf(code, "%s  default: %s\n%s}\n", indent,
+    (contexts ? "break;" : "goto done;"), indent);
+  free(actions);
 }
 
-static gchar *regex_dfa_to_code(regex_t *re, fa_t *dfa) {
-  const char *format = "";
-  GList *code = g_list_append(NULL, g_strdup((gpointer)format));
+/**
+ * Generates the cases of the switch over states for classes [first, last),
+ * a track is one case. States no context class moves are left out.
+ */
+static void re_chains_cases(GString *code, const dfa_t *dfa,
+  const re_chains_t *chains, uint32_t first, uint32_t last) {
+  for (uint32_t st = 1; st < dfa->states_count; ++st) {
+    if (chains->head[st] != st) {
+      continue;
+    }
+    bool moves = (first < dfa_chars_count(dfa) || chains->index[st]);
+    for (uint32_t c = first; c < last && !moves; ++c) {
+      moves = (dfa_step(dfa, st, c) != st);
+    }
+    if (!moves) {
+      continue;
+    }
+    g_string_append_printf(code, "      case %u:\n", st);
+    if (chains->index[st]) {
+      g_string_append_printf(code, "        if (count < %u) {\n", chains->length[st]);
+      re_chains_switch(code, dfa, chains, st, true, first, last, "          ");
+      g_string_append(code, "        } else {\n");
+      re_chains_switch(code, dfa, chains, st, false, first, last, "          ");
+      g_string_append(code, "        }\n");
+    } else {
+      re_chains_switch(code, dfa, chains, st, false, first, last, "        ");
+    }
+    g_string_append(code, "        break;\n");
+  }
+}
 
-  // State declarations
-  format = "static inline bool state_%s_%lu(miner_c *e);\n";
-  for (fa_id_t id = 0; id < dfa->next_node_id; ++id) {
-    code = g_list_append(code, g_strdup_printf(format, re->naming, id));
+/**
+ * Generates feeding the context class at `pos` to the state, see
+ * dfa_assert. Nothing is generated if the DFA uses no assertions.
+ */
+static void re_contexts_to_code(GString *code, const dfa_t *dfa,
+  const re_chains_t *chains, const char *n) {
+  if (!dfa->contexts_count) {
+    return;
   }
-  code = g_list_append(code, g_strdup("\n"));
+  g_string_append_printf(code,
+    "    c = dfa_context_class(&classes_%s, &kind, pos, end);\n"
+    "    switch (c ? state : 0) {\n",
+    n);
+  re_chains_cases(code, dfa, chains, dfa_chars_count(dfa), dfa->classes_count);
+  g_string_append(code, "    }\n\n");
+}
 
-  // State definitions
-  format =
-      "static inline bool state_%s_%lu(miner_c *e) {\n"
-      "%s"
-      "  return %s;\n"
-      "}\n\n";
-  for (fa_id_t id = 0; id < dfa->next_node_id; ++id) {
-    fa_node_t *node = dfa->nodes[id];
-    gchar *edges_code = edges_to_code(re, node, &code);
+/**
+ * Generates a miner running the table DFA as a flat loop with a switch over
+ * character classes per state. The stream is read directly and the last
+ * accepting position is kept, giving leftmost-longest matches.
+ */
+static void regex_dfa_to_code(GString *code, regex_t *re, const dfa_t *dfa) {
+  const char *n = re->naming;
+  re_chains_t chains;
+  re_chains_find(dfa, &chains);
+
+  // Character classes, the transitions are compiled into the switch below
+  array_to_code(code, "uint32_t", "interval_starts", n, dfa->interval_starts, dfa->intervals_count, sizeof(uint32_t));
+  array_to_code(code, "uint32_t", "interval_classes", n, dfa->interval_classes, dfa->intervals_count, sizeof(uint32_t));
+  array_to_code(code, "uint16_t", "rows", n, dfa->rows, (size_t)dfa->rows_count * DFA_CATEGORIES, sizeof(uint16_t));
+
+  g_string_append_printf(code,
+    "static const dfa_t classes_%s = {\n"
+    "  .classes_count = %u,\n"
+    "  .contexts_count = %u,\n"
+    "  .intervals_count = %u,\n"
+    "  .interval_starts = interval_starts_%s,\n"
+    "  .interval_classes = interval_classes_%s,\n"
+    "  .rows_count = %u,\n"
+    "  .rows = rows_%s,\n"
+    "  .ascii_classes = {",
+    n, dfa->classes_count, dfa->contexts_count, dfa->intervals_count, n, n, dfa->rows_count, n);
+  for (unsigned c = 0; c < 128; ++c) {
+    g_string_append_printf(code, "%s%s%u", (c ? "," : ""), ((c % 16) ? " " : "\n    "), dfa->ascii_classes[c]);
+  }
+  g_string_append(code, "\n  },\n  .context_classes = {");
+  for (unsigned k = 0; k < DFA_CONTEXTS; ++k) {
+    g_string_append_printf(code, "%s%u", (k ? ", " : ""), dfa->context_classes[k]);
+  }
+  g_string_append(code, "},\n};\n\n");
+
+  g_string_append_printf(code,
+    "static occurrence_t *match_regex_%s_impl(miner_c *e) {\n"
+    "  if (!e->mark_start(e)) {\n"
+    "    return NULL;\n"
+    "  }\n\n"
+    "  stream_c *s = e->stream;\n"
+    "  char *pos = s->pos;\n"
+    "  char *end = s->end;\n"
+    "  uint64_t offset = s->unicode_offset;\n"
+    "  char *accept = NULL;\n"
+    "  uint64_t accept_offset = 0;\n"
+    "  uint32_t state = %u;\n"
+    "  uint32_t c;\n",
+    n, chains.head[dfa->start]);
+  if (dfa->contexts_count) {
+    // Kind of the character before the position, see dfa_context_class
+    g_string_append(code, "  uint32_t kind = dfa_kind_before(s->start, pos);\n");
+  }
+  if (chains.any) {
+    // Index of the current state in its chain
+    g_string_append_printf(code, "  uint32_t count = %u;\n", chains.index[dfa->start]);
+  }
+  if (dfa->counts) {
+    // Counter of the counted repetition, see dfa_count
+    g_string_append(code, "  uint32_t repeats = 0;\n");
+  }
+  g_string_append(code, "\n");
 
-    if (edges_code == NULL) {
-      free_string_list(&code);
-      return NULL;
+  if (re->literal) {
+    // Every match contains the literal, at most literal_offset bytes ahead
+    g_string_append(code, "  char *literal = miner_c_find_literal(e, \"");
+    for (gsize i = 0; i < re->literal->len; ++i) {
+      g_string_append_printf(code, "\\%03o", (uint8_t)re->literal->str[i]);
     }
-
-    gchar *node_code = g_strdup_printf(
-      format, re->naming, id, edges_code, node->is_final ? "true" : "false");
-    free(edges_code);
-    code = g_list_append(code, node_code);
+    g_string_append_printf(code, "\", %zu);\n", re->literal->len);
+    if (re->literal_offset == SIZE_MAX) {
+      g_string_append(code, "  if (!literal) {\n");
+    } else {
+      g_string_append_printf(code, "  if (!literal || (size_t)(literal - pos) > %zu) {\n", re->literal_offset);
+    }
+    g_string_append(code,
+      "    return NULL;\n"
+      "  }\n\n");
   }
 
-  // Main
-  format =
-      "static occurrence_t *match_regex_%s_impl(miner_c *e) {\n"
-      "  mark_t mark;\n"
-      "  e->mark_pos(e, &mark);\n"
-      "  e->mark_start(e);\n\n"
-      "%s\n"
-      "  e->reset_pos(e, &mark);\n"
-      "  return NULL;\n"
-      "}\n\n"
-      "miner_c* %s() {\n"
-      "  return miner_c_create(\"%s\", NULL, match_regex_%s_impl);\n"
-      "}\n";
-  gchar *starting_nodes = starting_nodes_to_code(re, dfa);
+  re_contexts_to_code(code, dfa, &chains, n);
+
+  // Accepting states are listed as cases of a switch
+  g_string_append(code, "  switch (state) {\n");
+  bool any_accepting = false;
+  for (uint32_t st = 1; st < dfa->states_count; ++st) {
+    if (chains.head[st] == st && dfa_is_accepting(dfa, st)) {
+      g_string_append_printf(code, "    case %u:\n", st);
+      any_accepting = true;
+    }
+  }
+  if (any_accepting) {
+    g_string_append(code,
+      "      accept = pos;\n"
+      "      accept_offset = offset;\n"
+      "      break;\n");
+  }
+  g_string_append(code, "  }\n\n");
+
+  g_string_append_printf(code,
+    "  while (pos < end) {\n"
+    "    c = dfa_class(&classes_%s, pos);\n\n"
+    "    switch (state) {\n",
+    n);
+
+  // Per state: classes grouped by their action, a track is one case
+  re_chains_cases(code, dfa, &chains, 0, dfa_chars_count(dfa));
+
+  g_string_append(code,
+    "      default:\n"
+    "        goto done;\n"
+    "    }\n\n"
+    "    char *next = pos + unicode_getbytesize(pos);\n"
+    "    if (next > end) {\n"
+    "      pos = end;\n"
+    "    } else {\n"
+    "      pos = next;\n"
+    "      ++offset;\n"
+    "    }\n\n");
+  re_contexts_to_code(code, dfa, &chains, n);
+  g_string_append(code, "    switch (state) {\n");
+  for (uint32_t st = 1; st < dfa->states_count; ++st) {
+    if (chains.head[st] == st && dfa_is_accepting(dfa, st)) {
+      g_string_append_printf(code, "      case %u:\n", st);
+    }
+  }
+  if (any_accepting) {
+    g_string_append(code,
+      "        accept = pos;\n"
+      "        accept_offset = offset;\n"
+      "        break;\n");
+  }
+  g_string_append(code, "    }\n  }\n\n");
 
   gchar *re_expr_escaped = g_strescape(re->re_expr, NULL);
-  code = g_list_append(code, g_strdup_printf(format, re->naming, starting_nodes, re->naming, re_expr_escaped, re->naming));
+  g_string_append_printf(code,
+    "done:\n"
+    "  if (!accept) {\n"
+    "    return NULL;\n"
+    "  }\n\n"
+    "  mark_t mark = { accept, accept_offset, 0 };\n"
+    "  e->reset_pos(e, &mark);\n"
+    "  e->mark_end(e);\n"
+    "  return e->make_occurrence(e, 1.0);\n"
+    "}\n\n"
+    "miner_c* %s() {\n"
+    "  return miner_c_create(\"%s\", NULL, match_regex_%s_impl);\n"
+    "}\n",
+    n, re_expr_escaped, n);
   free(re_expr_escaped);
+  re_chains_clear(&chains);
+}
+
+/** Returns seconds elapsed since `*since` and moves it to now. */
+static double regex_timing_lap(gint64 *since) {
+  gint64 now = g_get_monotonic_time();
+  double elapsed = (now - *since) / (double)G_USEC_PER_SEC;
+  *since = now;
+  return elapsed;
+}
 
-  free(starting_nodes);
+static void regex_timing_add(regex_timing_t *to, const regex_timing_t *from) {
+  to->lex += from->lex;
+  to->op_tree += from->op_tree;
+  to->nfa += from->nfa;
+  to->dfa += from->dfa;
+  to->codegen += from->codegen;
+  to->cc += from->cc;
+}
 
-  return join_str_and_free(&code, "\n");
+void regex_timing_print(const regex_timing_t *timing, FILE *out) {
+  fprintf(out,
+    "lex: %.3f ms\n"
+    "op tree: %.3f ms\n"
+    "NFA: %.3f ms\n"
+    "DFA: %.3f ms\n"
+    "codegen: %.3f ms\n"
+    "cc: %.3f ms\n",
+    timing->lex * 1e3, timing->op_tree * 1e3, timing->nfa * 1e3,
+    timing->dfa * 1e3, timing->codegen * 1e3, timing->cc * 1e3);
 }
 
 regex_t *regex_compile(const char *re_expr, const char *naming, const char *label) {
+  return regex_compile_flags(re_expr, naming, label, 0);
+}
+
+regex_t *regex_compile_flags(const char *re_expr, const char *naming, const char *label, int flags) {
   regex_t *out = ALLOC(regex_t);
   out->errors = NULL;
   out->re_expr = g_strdup(re_expr);
+  out->flags = flags;
   out->naming = g_strdup(naming);
   out->label = g_strdup(label);
+  out->internal_form = NULL;
+  out->code = NULL;
+  out->dfa = NULL;
+  out->literal = NULL;
+  out->literal_offset = SIZE_MAX;
   out->state = 0;
+  out->timing = (regex_timing_t){ 0 };
 
-  GNode *tree = lex_tree_create(out->re_expr);
+  const char *expr = regex_inline_flags(out->re_expr, &(out->flags));
+
+  gint64 lap = g_get_monotonic_time();
+  GNode *tree = lex_tree_create(expr);
+  out->timing.lex = regex_timing_lap(&lap);
   if (!tree) {
     out->errors = g_list_append(out->errors, g_strdup("Basic parsing failed."));
     return out;
@@ -1233,25 +2197,48 @@ regex_t *regex_compile(const char *re_expr, const char *naming, const char *labe
   lex_tree_destroy(tree);
 
   form = op_tree_collapse_concats(form);
+  if (out->flags & REGEX_MULTILINE) {
+    re_op_mark_multiline(form);
+  }
+  if (out->flags & REGEX_CASELESS) {
+    re_op_fold_case(form);
+  }
+  re_op_mark_counted(form);
   // op_print_tree(form, 0);
   out->internal_form = form;
+  out->timing.op_tree = regex_timing_lap(&lap);
 
   fa_t *nfa = regex_to_nfa(out);
   // fa_print(nfa);
+  out->timing.nfa = regex_timing_lap(&lap);
 
-  fa_t *dfa = fa_create_powerset(nfa);
+  out->dfa = regex_nfa_to_dfa(out, nfa);
   fa_destroy(nfa);
-  // fa_print(dfa);
+  out->timing.dfa = regex_timing_lap(&lap);
 
-  gchar* code = regex_dfa_to_code(out, dfa);
-  out->code = code;
-  fa_destroy(dfa);
+  if (!out->dfa) {
+    // Generated code is built from the table as well, no backend can run it
+    out->errors = g_list_append(out->errors, g_strdup("Table DFA construction failed!"));
+    return out;
+  }
 
-  if (!code) {
-    out->errors = g_list_append(out->errors, g_strdup("Code generation failed!"));
+  if (out->dfa->lazy) {
+    // No code for automata over the state budget, modules run them as tables
+    out->state = 1;
     return out;
   }
 
+  re_factor_t factor = { NULL, NULL, 0, 0 };
+  re_op_factor(out, form, &factor);
+  out->literal = g_steal_pointer(&(factor.literal));
+  out->literal_offset = factor.offset;
+  re_factor_clear(&factor);
+
+  GString *code = g_string_new(NULL);
+  regex_dfa_to_code(code, out, out->dfa);
+  out->code = g_string_free(code, false);
+  out->timing.codegen = regex_timing_lap(&lap);
+
   out->state = 1;
 
   return out;
@@ -1270,6 +2257,12 @@ void regex_destroy(regex_t *regex) {
   if (regex->code) {
     free(regex->code);
   }
+  if (regex->dfa) {
+    dfa_destroy(regex->dfa);
+  }
+  if (regex->literal) {
+    g_string_free(regex->literal, true);
+  }
   free(regex);
 }
 
@@ -1281,95 +2274,444 @@ int regex_module_c_add_regex(regex_module_c *self, regex_t * compiled_regex){
   }
 
   self->exprs = g_list_append(self->exprs, compiled_regex);
+  regex_timing_add(&(self->timing), &(compiled_regex->timing));
   return 1;
 }
 
-int regex_module_c_build(regex_module_c *self){
-  char * user_env_cc = getenv("CC");
-  if( !user_env_cc ){
-    g_setenv("CC", "gcc", false);
+static int string_ptr_compare(const void *a, const void *b) {
+  return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/** Adds contents of a file to a checksum, nothing if it cannot be read. */
+static void checksum_update_file(GChecksum *checksum, const char *path) {
+  gchar *contents = NULL;
+  gsize length = 0;
+  if (g_file_get_contents(path, &contents, &length, NULL)) {
+    g_checksum_update(checksum, (const guchar *)path, -1);
+    g_checksum_update(checksum, (const guchar *)contents, length);
+    g_free(contents);
   }
+}
 
-   const char * header =
-    "#include <nativeextractor/miner.h>\n"
-    "#include <nativeextractor/extractor.h>\n"
-    "#include <nativeextractor/unicode.h>\n\n";
+/** Adds contents of the headers in a directory to a checksum, in name order. */
+static void checksum_update_headers(GChecksum *checksum, const char *dir_path) {
+  GDir *dir = g_dir_open(dir_path, 0, NULL);
+  if (!dir) {
+    return;
+  }
 
-  free(self->code);
-  self->code = g_strdup(header);
+  GPtrArray *names = g_ptr_array_new_with_free_func(free);
+  const gchar *name;
+  while ((name = g_dir_read_name(dir))) {
+    if (g_str_has_suffix(name, ".h")) {
+      g_ptr_array_add(names, g_build_filename(dir_path, name, NULL));
+    }
+  }
+  g_dir_close(dir);
 
-  size_t metalen = 2;
-  size_t metacount = 0;
-  char ** meta = malloc(sizeof(char *) * metalen);
+  qsort(names->pdata, names->len, sizeof(gpointer), string_ptr_compare);
+  for (guint i = 0; i < names->len; ++i) {
+    checksum_update_file(checksum, g_ptr_array_index(names, i));
+  }
+  g_ptr_array_free(names, true);
+}
 
-  GList * node = self->exprs;
-  while( node ){
-    char * prev_code = self->code;
-    regex_t * re = (regex_t*)node->data;
+/**
+ * Adds the headers a module is compiled against to a checksum, from the
+ * include directories of REGEX_BUILD_CMD.
+ */
+static void checksum_update_build_headers(GChecksum *checksum) {
+#ifdef NE_PRODUCTION
+  FILE *pc = popen(REGEX_INCLUDE_DIR_CMD, "r");
+  if (pc) {
+    char dir[PATH_MAX];
+    if (fgets(dir, sizeof(dir), pc)) {
+      gchar *headers = g_build_filename(g_strchomp(dir), "nativeextractor", NULL);
+      checksum_update_headers(checksum, headers);
+      free(headers);
+    }
+    pclose(pc);
+  }
+#endif
+  // -Iinclude/ is relative to the working directory the compiler runs in
+  checksum_update_headers(checksum, "include/nativeextractor");
+}
+
+/**
+ * Key of a module in the cache: hash of the generated code, the build command
+ * with the environment it expands, the headers the code is compiled against
+ * and the library its symbols are resolved from.
+ */
+static gchar *regex_cache_key(regex_module_c *self) {
+  const char *env[] = { getenv("CC"), getenv("flags") };
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+  g_checksum_update(checksum, (const guchar *)self->code, -1);
+  g_checksum_update(checksum, (const guchar *)REGEX_BUILD_CMD, -1);
+  for (size_t i = 0; i < sizeof(env) / sizeof(env[0]); ++i) {
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)(env[i] ? env[i] : ""), -1);
+  }
+  g_checksum_update(checksum, (const guchar *)"\n" NE_VERSION "\n", -1);
+
+  checksum_update_build_headers(checksum);
+  Dl_info info;
+  if (dladdr((void *)regex_cache_key, &info) && info.dli_fname) {
+    checksum_update_file(checksum, info.dli_fname);
+  }
+
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return key;
+}
 
-    self->code = g_strdup_printf("%s%s\n\n", prev_code, re->code);
-    //printf("CODE: %s\n", self->code);
-    free(prev_code);
+/**
+ * Returns true if a cache directory or library can be trusted: it belongs to
+ * the current user and nobody else can write to it, so no other user could
+ * have planted a library there.
+ */
+static bool regex_cache_trusted(const struct stat *st) {
+  return st->st_uid == getuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+/** Creates the cache directory if needed, returns true if it can be used. */
+static bool regex_cache_open(regex_module_c *self) {
+  struct stat st;
+  return self->cache_path
+    && g_mkdir_with_parents(self->cache_path, S_IRWXU) == 0
+    && stat(self->cache_path, &st) == 0
+    && S_ISDIR(st.st_mode)
+    && regex_cache_trusted(&st);
+}
+
+/** Returns true if a cached library exists and can be trusted. */
+static bool regex_cache_hit(const char *path) {
+  int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  bool ret = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && regex_cache_trusted(&st));
+  close(fd);
+  return ret;
+}
+
+typedef struct regex_cache_entry_t {
+  char *path;
+  time_t mtime;
+  off_t size;
+} regex_cache_entry_t;
+
+static int regex_cache_entry_t_compare(const void *a, const void *b) {
+  return CMP(((const regex_cache_entry_t *)a)->mtime, ((const regex_cache_entry_t *)b)->mtime);
+}
+
+/** Removes least recently used libraries until the cache fits its size limit. */
+static void regex_cache_evict(regex_module_c *self, const char *keep) {
+  DIR *dir = opendir(self->cache_path);
+  if (!dir) {
+    return;
+  }
+
+  size_t count = 0;
+  size_t capacity = 16;
+  regex_cache_entry_t *entries = malloc(capacity * sizeof(regex_cache_entry_t));
+  size_t total = 0;
+  struct dirent *dirent;
 
-    if (metacount == metalen) {
-      metalen += 2;
-      meta = realloc(meta, sizeof(char *) * metalen);
+  while ((dirent = readdir(dir))) {
+    if (!g_str_has_suffix(dirent->d_name, ".so")) {
+      continue;
+    }
+
+    char *path = g_build_filename(self->cache_path, dirent->d_name, NULL);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+      free(path);
+      continue;
     }
-    meta[metacount++] = g_strdup(re->naming);
-    meta[metacount++] = g_strdup(g_strescape(re->re_expr, NULL));
 
-    node = node->next;
+    if (count == capacity) {
+      capacity *= 2;
+      entries = realloc(entries, capacity * sizeof(regex_cache_entry_t));
+    }
+    entries[count++] = (regex_cache_entry_t){ path, st.st_mtime, st.st_size };
+    total += st.st_size;
   }
+  closedir(dir);
 
-  {
-    char * prev_code = self->code;
-    self->code = g_strdup_printf("\n%s%s\n", prev_code, "const char *meta[] = {");
-    free(prev_code);
+  qsort(entries, count, sizeof(regex_cache_entry_t), regex_cache_entry_t_compare);
 
-    for (size_t i = 0; i < metacount; i += 2) {
-      const char * fnname = meta[i];
-      const char * label = meta[i + 1];
-      prev_code = self->code;
-      self->code = g_strdup_printf(
-        "%s  \"%s\", \"%s\",\n",
-        prev_code,
-        fnname,
-        label
-      );
-      free(prev_code);
+  for (size_t i = 0; i < count; ++i) {
+    if (total > self->cache_size && strcmp(entries[i].path, keep) != 0
+        && unlink(entries[i].path) == 0) {
+      total -= entries[i].size;
     }
+    free(entries[i].path);
+  }
+  free(entries);
+}
 
-    prev_code = self->code;
-    self->code = g_strdup_printf(
-      "%s  NULL\n"
-      "};\n",
-      prev_code
-    );
-    free(prev_code);
+/** Builds one union DFA of all regexes of the module. */
+static int regex_module_c_build_merged(regex_module_c *self) {
+  size_t count = g_list_length(self->exprs);
+  regex_t **res = malloc(MAX(count, 1) * sizeof(regex_t *));
+  fa_t **nfas = malloc(MAX(count, 1) * sizeof(fa_t *));
+
+  gint64 lap = g_get_monotonic_time();
+  size_t i = 0;
+  for (GList *node = self->exprs; node; node = node->next, ++i) {
+    res[i] = (regex_t *)node->data;
+    nfas[i] = regex_to_nfa(res[i]);
   }
+  self->timing.nfa += regex_timing_lap(&lap);
 
-  for (size_t i = 0; i < metacount; ++i) {
-    free(meta[i]);
+  if (self->dfa) {
+    dfa_destroy(self->dfa);
   }
-  free(meta);
+  self->dfa = regex_nfas_to_dfa(res, nfas, count);
+  self->timing.dfa += regex_timing_lap(&lap);
 
-  gchar * cname = g_strdup_printf("%s%lu_%s.c", self->build_path,
-    (unsigned long)time(NULL), self->naming);
-  gchar * soname = g_strdup_printf("%s%s.so", self->build_path, self->naming);
+  for (i = 0; i < count; ++i) {
+    fa_destroy(nfas[i]);
+  }
+  free(nfas);
+  free(res);
+
+  if (!self->dfa) {
+    self->errors = g_list_append(self->errors, g_strdup("Union DFA construction failed!"));
+    self->state = 0;
+    return 0;
+  }
+
+  return self->state;
+}
+
+/** Includes of the generated code of a module. */
+#define REGEX_MODULE_PRELUDE \
+  "#include <nativeextractor/dfa.h>\n" \
+  "#include <nativeextractor/miner.h>\n" \
+  "#include <nativeextractor/extractor.h>\n" \
+  "#include <nativeextractor/unicode.h>\n\n"
+
+/** Appends the table of namings and expressions the loader reads. */
+static void regex_module_meta(GString *code, GList *exprs) {
+  g_string_append(code, "const char *meta[] = {\n");
+  for (GList * node = exprs; node; node = node->next) {
+    regex_t * re = (regex_t*)node->data;
+    if (!re->code) {
+      continue;
+    }
+    gchar * re_expr_escaped = g_strescape(re->re_expr, NULL);
+    g_string_append_printf(code, "  \"%s\", \"%s\",\n", re->naming, re_expr_escaped);
+    free(re_expr_escaped);
+  }
+  g_string_append(code,
+    "  NULL\n"
+    "};\n");
+}
+
+static int regex_code_length_compare(const void *a, const void *b) {
+  size_t x = strlen((*(regex_t * const *)a)->code);
+  size_t y = strlen((*(regex_t * const *)b)->code);
+  return CMP(y, x);
+}
+
+/**
+ * Compiles the regexes of a module as `units` translation units at once, one
+ * compiler process each, and links them into `soname`. Regexes are spread
+ * longest first to the unit with the least code.
+ *
+ * @param stem Path of the sources without the ".c" suffix.
+ * @param cmd Set to the link command.
+ *
+ * @return Exit status of the first failed command, 0 on success.
+ */
+static int regex_module_c_build_units(regex_module_c *self, size_t units,
+  const char *stem, const char *soname, gchar **cmd) {
+  size_t count = 0;
+  regex_t **res = malloc(MAX(g_list_length(self->exprs), 1) * sizeof(regex_t *));
+  for (GList * node = self->exprs; node; node = node->next) {
+    regex_t * re = (regex_t*)node->data;
+    if (re->code) {
+      res[count++] = re;
+    }
+  }
+  qsort(res, count, sizeof(regex_t *), regex_code_length_compare);
+
+  GString **codes = malloc(units * sizeof(GString *));
+  for (size_t u = 0; u < units; ++u) {
+    codes[u] = g_string_new(REGEX_MODULE_PRELUDE);
+  }
+  regex_module_meta(codes[0], self->exprs);
+  for (size_t i = 0; i < count; ++i) {
+    size_t least = 0;
+    for (size_t u = 1; u < units; ++u) {
+      if (codes[u]->len < codes[least]->len) {
+        least = u;
+      }
+    }
+    g_string_append(codes[least], res[i]->code);
+    g_string_append(codes[least], "\n\n");
+  }
+  free(res);
+
+  GString * link = g_string_new(REGEX_BUILD_CMD);
+  pid_t * pids = malloc(units * sizeof(pid_t));
+  for (size_t u = 0; u < units; ++u) {
+    gchar * cname = g_strdup_printf("%s_%zu.c", stem, u);
+    gchar * oname = g_strdup_printf("%s_%zu.o", stem, u);
+    FILE * fc = fopen(cname, "w+");
+    fwrite(codes[u]->str, codes[u]->len, 1, fc);
+    fclose(fc);
+    g_string_free(codes[u], true);
+
+    gchar * compile = g_strdup_printf("%s -c %s -o %s", REGEX_BUILD_CMD, cname, oname);
+    pids[u] = fork();
+    if (pids[u] == 0) {
+      execl("/bin/sh", "sh", "-c", compile, (char *)NULL);
+      _exit(127);
+    }
+    g_string_append_printf(link, " %s", oname);
+    free(compile);
+    free(oname);
+    free(cname);
+  }
+  free(codes);
+
+  int ret = 0;
+  for (size_t u = 0; u < units; ++u) {
+    int status = -1;
+    if (pids[u] < 0 || waitpid(pids[u], &status, 0) < 0) {
+      status = -1;
+    }
+    if (status != 0 && ret == 0) {
+      ret = status;
+    }
+  }
+  free(pids);
+
+  g_string_append_printf(link, " -o %s", soname);
+  if (ret == 0) {
+    ret = system(link->str);
+  }
+  for (size_t u = 0; u < units; ++u) {
+    gchar * oname = g_strdup_printf("%s_%zu.o", stem, u);
+    unlink(oname);
+    free(oname);
+  }
+
+  *cmd = g_string_free(link, false);
+  return ret;
+}
+
+int regex_module_c_build(regex_module_c *self){
+  if (self->merge) {
+    return regex_module_c_build_merged(self);
+  }
+
+  if (self->backend != REGEX_BACKEND_SO) {
+    return self->state;
+  }
+
+  char * user_env_cc = getenv("CC");
+  if( !user_env_cc ){
+    g_setenv("CC", "gcc", false);
+  }
 
-  FILE * fc = fopen(cname, "w+");
-  fwrite(self->code, strlen(self->code), 1, fc);
-  fclose(fc);
+  gint64 lap = g_get_monotonic_time();
+  GString * code = g_string_new(REGEX_MODULE_PRELUDE);
 
-  gchar * cmd = g_strdup_printf("%s %s -o %s", REGEX_BUILD_CMD, cname, soname);
-  //printf("CMD: %s\n", cmd);
+  size_t count = 0;
+  for (GList * node = self->exprs; node; node = node->next) {
+    regex_t * re = (regex_t*)node->data;
+    if (!re->code) {
+      continue;
+    }
+    g_string_append(code, re->code);
+    g_string_append(code, "\n\n");
+    ++count;
+  }
+  regex_module_meta(code, self->exprs);
 
-  self->build_cmd = cmd;
+  free(self->code);
+  self->code = g_string_free(code, false);
+  self->timing.codegen += regex_timing_lap(&lap);
+
+  free(self->so_path);
+  free(self->build_cmd);
+  self->so_path = NULL;
+  self->build_cmd = NULL;
+
+  gchar * cached = NULL;
+  if (regex_cache_open(self)) {
+    gchar * key = regex_cache_key(self);
+    gchar * file = g_strdup_printf("%s.so", key);
+    cached = g_build_filename(self->cache_path, file, NULL);
+    free(file);
+    free(key);
+
+    if (regex_cache_hit(cached)) {
+      // Hit, refresh the entry for LRU eviction
+      utime(cached, NULL);
+      self->so_path = cached;
+      if( !user_env_cc ){
+        g_unsetenv("CC");
+      }
+      return 1;
+    }
+  }
+
+  gchar * stem = g_strdup_printf("%s%lu_%s", self->build_path,
+    (unsigned long)time(NULL), self->naming);
+  gchar * soname = (cached
+    ? g_strdup_printf("%s.%d.tmp", cached, (int)getpid())
+    : g_strdup_printf("%s%s.so", self->build_path, self->naming));
   self->so_path = soname;
 
-  int ret = system(cmd);
+  size_t units = (self->build_jobs < 1 ? sysconf(_SC_NPROCESSORS_ONLN) : self->build_jobs);
+  units = MAX(MIN(units, count), 1);
 
-  free(cname);
+  int ret;
+  lap = g_get_monotonic_time();
+  if (units > 1) {
+    ret = regex_module_c_build_units(self, units, stem, soname, &(self->build_cmd));
+  } else {
+    gchar * cname = g_strdup_printf("%s.c", stem);
+    FILE * fc = fopen(cname, "w+");
+    fwrite(self->code, strlen(self->code), 1, fc);
+    fclose(fc);
+
+    self->build_cmd = g_strdup_printf("%s %s -o %s", REGEX_BUILD_CMD, cname, soname);
+    //printf("CMD: %s\n", self->build_cmd);
+    ret = system(self->build_cmd);
+    free(cname);
+  }
+  self->timing.cc += regex_timing_lap(&lap);
+  free(stem);
+
+  bool installed = true;
+  if (cached) {
+    if (ret != 0) {
+      unlink(soname);
+      free(cached);
+    } else if (chmod(soname, S_IRWXU) == 0 && rename(soname, cached) == 0) {
+      // Atomic install, concurrent builds of the same module are harmless
+      free(soname);
+      self->so_path = cached;
+      regex_cache_evict(self, cached);
+    } else {
+      char * err_str = g_strdup_printf("Can not install %s: %s.", cached, strerror(errno));
+      fprintf(stderr, "%s", err_str);
+      self->errors = g_list_append(self->errors, err_str);
+      unlink(soname);
+      free(soname);
+      free(cached);
+      self->so_path = NULL;
+      installed = false;
+    }
+  }
 
   if( !user_env_cc ){
     g_unsetenv("CC"); /* Reset environment for sure */
@@ -1383,6 +2725,11 @@ int regex_module_c_build(regex_module_c *self){
     return 0;
   }
 
+  if (!installed) {
+    self->state = 0;
+    return 0;
+  }
+
   return 1;
 }
 
@@ -1390,9 +2737,38 @@ int regex_module_c_load(regex_module_c * self, extractor_c *extractor){
   GList * regexes = self->exprs;
   bool ret = 1;
 
+  if (self->file) {
+    for (size_t i = 0; i < self->file->dfas_count; ++i) {
+      // A union DFA has no expression and is named after its module
+      const char *name = (*self->file->exprs[i] ? NULL : self->file->namings[i]);
+      ret &= extractor->add_miner(extractor,
+        (miner_c *)dfa_miner_c_create(name, dfa_borrow(self->file->dfas[i])));
+    }
+    return ret;
+  }
+
+  if (self->merge) {
+    return extractor->add_miner(extractor,
+      (miner_c *)dfa_miner_c_create(self->naming, dfa_copy(self->dfa)));
+  }
+
   while(regexes){
     regex_t * symb = regexes->data;
 
+    // Lazy DFAs have no generated code, position sets beat their cache
+    miner_c * miner = NULL;
+    if (symb->dfa->shift_and
+        && (self->backend == REGEX_BACKEND_SHIFT_AND || symb->dfa->lazy)) {
+      miner = (miner_c *)shift_and_miner_c_create(NULL, dfa_copy(symb->dfa));
+    } else if (self->backend != REGEX_BACKEND_SO || !symb->code) {
+      miner = (miner_c *)dfa_miner_c_create(NULL, dfa_copy(symb->dfa));
+    }
+    if (miner) {
+      ret &= extractor->add_miner(extractor, miner);
+      regexes = regexes->next;
+      continue;
+    }
+
     ret &= extractor->add_miner_so(extractor, self->so_path,
       symb->naming, NULL);
     /* TODO: error handling*/
@@ -1409,13 +2785,51 @@ int regex_module_c_load(regex_module_c * self, extractor_c *extractor){
   return ret;
 }
 
+int regex_module_c_save(regex_module_c * self, const char *path){
+  if (self->merge) {
+    const char *expr = "";
+    return self->dfa && dfa_save(path, &(self->dfa),
+      (const char **)&(self->naming), &expr, 1);
+  }
+
+  size_t count = g_list_length(self->exprs);
+  dfa_t **dfas = malloc(MAX(count, 1) * sizeof(dfa_t *));
+  const char **namings = malloc(MAX(count, 1) * sizeof(char *));
+  const char **exprs = malloc(MAX(count, 1) * sizeof(char *));
+
+  size_t i = 0;
+  for (GList *node = self->exprs; node; node = node->next, ++i) {
+    regex_t *regex = (regex_t *)node->data;
+    dfas[i] = regex->dfa;
+    namings[i] = regex->naming;
+    exprs[i] = regex->re_expr;
+  }
+
+  int ret = dfa_save(path, dfas, namings, exprs, count);
+  if (!ret) {
+    self->errors = g_list_append(self->errors, g_strdup_printf("Can not save: %s\n", path));
+  }
+
+  free(exprs);
+  free(namings);
+  free(dfas);
+  return ret;
+}
+
 void regex_module_c_destroy(struct regex_module_c * self){
   g_list_free_full(self->errors, free);
   g_list_free(self->exprs);
 
+  if (self->dfa) {
+    dfa_destroy(self->dfa);
+  }
+  if (self->file) {
+    dfa_file_c_destroy(self->file);
+  }
   free(self->naming);
   free(self->build_cmd);
   free(self->so_path);
+  free(self->cache_path);
   free(self->code);
   free(self);
 }
@@ -1427,12 +2841,41 @@ regex_module_c * regex_module_c_new(const char * naming, const char * path) {
   out->headers_path = (headers ? headers : REGEX_HEADER_FILES);
   char * build = getenv("REGEX_BUILD_PATH");
   out->build_path = (char *)(path ? path : (build ? build : REGEX_BUILD_PATH));
+  char * cache = getenv("REGEX_CACHE_PATH");
+  out->cache_path = (cache
+    ? (*cache ? g_strdup(cache) : NULL)
+    : g_build_filename(g_get_user_cache_dir(), REGEX_CACHE_DIR, NULL));
+  char * cache_size = getenv("REGEX_CACHE_SIZE");
+  out->cache_size = (cache_size ? strtoul(cache_size, NULL, 10) : REGEX_CACHE_SIZE);
+  char * jobs = getenv("REGEX_BUILD_JOBS");
+  // Splitting pays off only for large modules, one process is faster otherwise
+  out->build_jobs = (jobs ? atoi(jobs) : 1);
   out->state = 1;
+  char * backend = getenv("REGEX_BACKEND");
+  out->backend = REGEX_BACKEND_SO;
+  if (backend && strcmp(backend, "table") == 0) {
+    out->backend = REGEX_BACKEND_TABLE;
+  } else if (backend && strcmp(backend, "shift-and") == 0) {
+    out->backend = REGEX_BACKEND_SHIFT_AND;
+  }
 
   out->add_regex = regex_module_c_add_regex;
   out->build = regex_module_c_build;
   out->load = regex_module_c_load;
+  out->save = regex_module_c_save;
   out->destroy = regex_module_c_destroy;
 
   return out;
 }
+
+regex_module_c * regex_module_c_from_file(const char * naming, const char * path) {
+  dfa_file_c * file = dfa_file_c_from_file(path);
+  if (!file) {
+    return NULL;
+  }
+
+  regex_module_c * out = regex_module_c_new(naming, NULL);
+  out->backend = REGEX_BACKEND_TABLE;
+  out->file = file;
+  return out;
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nativeextractor/shift_and_miner.h>
+
+/** Runs the position sets from the current position and remembers the last accept. */
+static occurrence_t *match_shift_and(miner_c *m) {
+  const dfa_t *dfa = ((shift_and_miner_c *)m)->dfa;
+  const dfa_shift_and_t *sa = dfa->shift_and;
+  stream_c *stream = m->stream;
+
+  if (!m->mark_start(m)) {
+    return NULL;
+  }
+
+  char *pos = stream->pos;
+  char *end = stream->end;
+  uint64_t offset = stream->unicode_offset;
+  uint64_t positions = 1;
+
+  mark_t accept = { NULL, 0, 0 };
+  if (positions & sa->finals) {
+    accept = (mark_t){ pos, offset, 0 };
+  }
+
+  while (pos < end) {
+    positions = dfa_shift_and_step(sa, positions, dfa_class(dfa, pos));
+    if (!positions) {
+      break;
+    }
+
+    dfa_advance(&pos, &offset, end);
+
+    if (positions & sa->finals) {
+      accept = (mark_t){ pos, offset, 0 };
+    }
+  }
+
+  if (!accept.pos) {
+    return NULL;
+  }
+
+  m->reset_pos(m, &accept);
+  m->mark_end(m);
+  return m->make_occurrence(m, 1.0);
+}
+
+/**
+ * Destroys a clone, the DFA is owned by the original miner.
+ */
+static void shift_and_miner_c_destroy_clone(shift_and_miner_c *self) {
+  self->destroy_super((miner_c *)self);
+}
+
+shift_and_miner_c *shift_and_miner_c_clone(shift_and_miner_c *self) {
+  shift_and_miner_c *clone = ALLOC(shift_and_miner_c);
+  miner_c_init_clone(&(clone->base), &(self->base), sizeof(shift_and_miner_c));
+  clone->base.destroy = (void (*)(miner_c *self))shift_and_miner_c_destroy_clone;
+  return clone;
+}
+
+shift_and_miner_c *shift_and_miner_c_create(const char *name, dfa_t *dfa) {
+  if (!dfa->shift_and) {
+    return NULL;
+  }
+
+  shift_and_miner_c *miner = ALLOC(shift_and_miner_c);
+  miner_c_init(&(miner->base), (name ? name : dfa->labels[0]), NULL, match_shift_and);
+  miner->destroy_super = miner->base.destroy;
+  miner->base.destroy = (void (*)(miner_c *self))shift_and_miner_c_destroy;
+  miner->base.clone = (miner_c *(*)(miner_c *self))shift_and_miner_c_clone;
+  miner->dfa = dfa;
+  return miner;
+}
+
+void shift_and_miner_c_destroy(shift_and_miner_c *self) {
+  dfa_destroy(self->dfa);
+  self->destroy_super((miner_c *)self);
+}
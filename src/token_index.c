@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <nativeextractor/miner.h>
+#include <nativeextractor/token_index.h>
+#include <nativeextractor/unicode.h>
+
+/**
+ * An ASCII character is a delimiter (space, punctuation, symbol or control)
+ * exactly when it is not alphanumeric.
+ */
+static inline bool ascii_is_delimiter(uint8_t c) {
+  uint8_t l = c | 0x20;
+  return !((c >= '0' && c <= '9') || (l >= 'a' && l <= 'z'));
+}
+
+#ifdef __SSE2__
+/** Returns a mask of delimiters among 16 ASCII bytes. */
+static inline uint64_t ascii_delimiters_16(__m128i v) {
+  __m128i digit = _mm_and_si128(
+    _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(
+    _mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+    _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)));
+  return (uint64_t)(~_mm_movemask_epi8(_mm_or_si128(digit, alpha)) & 0xFFFF);
+}
+#endif
+
+/** Classifies a character which starts before the index. */
+static bool previous_is_delimiter(stream_c* stream, const char* start) {
+  if (start <= stream->start) {
+    return true;
+  }
+  const char* p = start - 1;
+  while (p > stream->start && ((uint8_t)*p & 0xC0) == 0x80) {
+    --p;
+  }
+  return ((uint8_t)*p < 0x80)
+    ? ascii_is_delimiter((uint8_t)*p)
+    : is_delimiter((char*)p);
+}
+
+void token_index_t_build(token_index_t* self, stream_c* stream,
+  const char* start, const char* end) {
+  size_t len = (size_t)(end - start);
+  size_t words = (len + 63) / 64;
+
+  if (words > self->capacity) {
+    self->capacity = MAX(words, 2 * self->capacity);
+    self->delimiters = realloc(self->delimiters, self->capacity * sizeof(uint64_t));
+    self->starts = realloc(self->starts, self->capacity * sizeof(uint64_t));
+  }
+  memset(self->delimiters, 0, words * sizeof(uint64_t));
+  self->start = start;
+  self->end = end;
+
+  const uint8_t* s = (const uint8_t*)start;
+  size_t i = 0;
+  // Continuation bytes of the last multibyte character
+  size_t pending = 0;
+  bool pending_delimiter = false;
+
+  while (i < len) {
+#ifdef __SSE2__
+    if (pending == 0 && (i & 15) == 0 && i + 16 <= len) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+      if (_mm_movemask_epi8(v) == 0) {
+        self->delimiters[i >> 6] |= ascii_delimiters_16(v) << (i & 63);
+        i += 16;
+        continue;
+      }
+    }
+#endif
+    bool delimiter;
+    if (pending > 0) {
+      delimiter = pending_delimiter;
+      --pending;
+    } else if (s[i] < 0x80) {
+      delimiter = ascii_is_delimiter(s[i]);
+    } else if (s[i] >= 0xC0) {
+      size_t size = unicode_getbytesize((char*)(s + i));
+      // A character truncated by the stream end cannot be decoded
+      delimiter = ((const char*)(s + i + size) > stream->end)
+        || is_delimiter((char*)(s + i));
+      pending = size - 1;
+      pending_delimiter = delimiter;
+    } else {
+      delimiter = false; // stray continuation byte
+    }
+
+    if (delimiter) {
+      self->delimiters[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+    ++i;
+  }
+
+  uint64_t carry = previous_is_delimiter(stream, start);
+  for (size_t w = 0; w < words; ++w) {
+    uint64_t d = self->delimiters[w];
+    self->starts[w] = ~d & ((d << 1) | carry);
+    carry = d >> 63;
+  }
+  if (len & 63) {
+    self->starts[words - 1] &= ((uint64_t)1 << (len & 63)) - 1;
+  }
+}
+
+void token_index_t_clear(token_index_t* self) {
+  free(self->delimiters);
+  free(self->starts);
+  memset(self, 0, sizeof(token_index_t));
+}
@@ -0,0 +1,679 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <nativeextractor/dfa_miner.h>
+#include <nativeextractor/shift_and_miner.h>
+#include <nativeextractor/extractor.h>
+#include <nativeextractor/regex_generator.h>
+
+#define FIXTURE_0 "./tests/fixtures/regex_generator/fixture_0.txt"
+
+/**
+ * Runs a regex by the table backend, or bit-parallel, and joins the matches
+ * with '|'.
+ */
+static char* matches_by(const char* re_expr, const char* text, bool shift_and) {
+  regex_t* re = regex_compile(re_expr, "test", "TEST");
+  assert_true(re->state);
+  assert_non_null(re->dfa);
+
+  miner_c** miners = calloc(1, sizeof(miner_c*));
+  extractor_c* e = extractor_c_new(1, miners);
+  miner_c* miner = (shift_and
+    ? (miner_c*)shift_and_miner_c_create(NULL, dfa_copy(re->dfa))
+    : (miner_c*)dfa_miner_c_create(NULL, dfa_copy(re->dfa)));
+  assert_non_null(miner);
+  assert_true(e->add_miner(e, miner));
+
+  stream_buffer_c* s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  assert_true(e->set_stream(e, (stream_c*)s));
+
+  GString* out = g_string_new("");
+  while (!(e->stream->state_flags & STREAM_EOF)) {
+    occurrence_t** res = e->next(e, 1000);
+    for (occurrence_t** pres = res; *pres; ++pres) {
+      assert_string_equal((*pres)->label, re_expr);
+      if (out->len) {
+        g_string_append_c(out, '|');
+      }
+      g_string_append_len(out, (*pres)->str, (*pres)->len);
+      free(*pres);
+    }
+    free(res);
+  }
+
+  e->unset_stream(e);
+  DESTROY((stream_c*)s);
+  e->destroy(e);
+  free(e);
+  regex_destroy(re);
+
+  return g_string_free(out, false);
+}
+
+static char* matches(const char* re_expr, const char* text) {
+  return matches_by(re_expr, text, false);
+}
+
+static void check(const char* re_expr, const char* text, const char* expected) {
+  char* found = matches(re_expr, text);
+  assert_string_equal(found, expected);
+  g_free(found);
+}
+
+void longest_match(void **state) {
+  // The generated code stops at the first accepting branch, the table DFA
+  // keeps the last accept
+  check("a|abc", "abd abc", "a|abc");
+  check("ab*", "abbb a", "abbb|a");
+  check("x(yz)+", "xyzyzy xy", "xyzyz");
+}
+
+void classes(void **state) {
+  check("[0-9]{3}", "12 345 6789", "345|678");
+  check("[^ ]+@[^ ]+", "to a@b.cz, c@d", "a@b.cz,|c@d");
+  check("\\s\\w", "a b\tc", " b|\tc");
+  check("a.c", "abc a\nc", "abc");
+  check("[.]", "a.b", ".");
+}
+
+void unicode(void **state) {
+  check("[á-ž]+", "příliš žluťoučký", "ří|š|ž|ť|č|ý");
+  check("[a-zá-ž]+", "příliš žluťoučký", "příliš|žluťoučký");
+  check("ů|ň", "kůň", "ů|ň");
+  check("[^a-z ]+", "kůň úpěl", "ůň|ú|ě");
+  check("\\w+", "kůň—úpěl", "kůň|úpěl");
+}
+
+void anchors(void **state) {
+  check("^ab", "abab", "ab");
+  check("ab$", "abab", "ab");
+  check("^a+$", "aaa", "aaa");
+  check("^a+$", "aab", "");
+}
+
+void minimal_states(void **state) {
+  // The regexes of the regex_generator fixture, states include the dead one
+  // and the label sink. Powerset: 8 + 1 and 19 + 1 states.
+  regex_t* re_email = regex_compile("[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+", "simple_email", "EMAIL");
+  regex_t* re_tel = regex_compile("[+]?[(]?[0-9]{3}[)]?[-\\s.]?[0-9]{3}[-\\s.]?[0-9]{4,6}", "simple_tel", "TEL_NO");
+  assert_int_equal(re_email->dfa->states_count, 8);
+  assert_int_equal(re_tel->dfa->states_count, 20);
+  regex_destroy(re_email);
+  regex_destroy(re_tel);
+
+  // Alternation over common suffixes collapses
+  regex_t* re_months = regex_compile("(january|february|march|april|may|june|july|august|september|october|november|december)", "months", "MONTH");
+  assert_int_equal(re_months->dfa->states_count, 40 + 2);
+  regex_destroy(re_months);
+}
+
+void module(void **state) {
+  regex_module_c* module = regex_module_c_new("dfa_test", NULL);
+  module->backend = REGEX_BACKEND_TABLE;
+
+  regex_t* re_email = regex_compile("[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+", "simple_email", "EMAIL");
+  regex_t* re_tel = regex_compile("[+]?[(]?[0-9]{3}[)]?[-\\s.]?[0-9]{3}[-\\s.]?[0-9]{4,6}", "simple_tel", "TEL_NO");
+  assert_true(module->add_regex(module, re_email));
+  assert_true(module->add_regex(module, re_tel));
+  assert_true(module->build(module));
+  assert_null(module->so_path);
+
+  miner_c** miners = calloc(1, sizeof(miner_c*));
+  extractor_c* e = extractor_c_new(-1, miners);
+  assert_true(module->load(module, e));
+  assert_int_equal(e->miners_count, 2);
+
+  stream_file_c* strf = stream_file_c_new(FIXTURE_0);
+  e->set_stream(e, (stream_c*)strf);
+
+  uint32_t count = 0;
+  while (!(e->stream->state_flags & STREAM_EOF)) {
+    occurrence_t** res = e->next(e, 10000000);
+    for (occurrence_t** pres = res; *pres; ++pres) {
+      free(*pres);
+      ++count;
+    }
+    free(res);
+  }
+  assert_int_equal(count, 2);
+
+  DESTROY(strf);
+  e->unset_stream(e);
+  e->destroy(e);
+  free(e);
+  module->destroy(module);
+  regex_destroy(re_email);
+  regex_destroy(re_tel);
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/** Runs a loaded module over a text and returns its sorted occurrences. */
+static char* run_module(regex_module_c* module, size_t miners_count, const char* text) {
+  miner_c** miners = calloc(1, sizeof(miner_c*));
+  extractor_c* e = extractor_c_new(2, miners);
+  assert_true(module->load(module, e));
+  assert_int_equal(e->miners_count, miners_count);
+
+  stream_buffer_c* s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  e->set_stream(e, (stream_c*)s);
+
+  GPtrArray* lines = g_ptr_array_new();
+  while (!(e->stream->state_flags & STREAM_EOF)) {
+    occurrence_t** res = e->next(e, 7);
+    for (occurrence_t** pres = res; *pres; ++pres) {
+      g_ptr_array_add(lines, g_strdup_printf("%s@%lu+%u", (*pres)->label,
+        (unsigned long)(*pres)->pos, (*pres)->len));
+      free(*pres);
+    }
+    free(res);
+  }
+
+  // Counting finds the same occurrences without returning them
+  assert_true(e->set_flags(e, E_COUNT_ONLY));
+  DESTROY((stream_c*)s);
+  s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  e->set_stream(e, (stream_c*)s);
+  while (!(e->stream->state_flags & STREAM_EOF)) {
+    occurrence_t** res = e->next(e, 7);
+    assert_null(*res);
+    free(res);
+  }
+  uint64_t counted = 0;
+  label_count_t* counts = e->get_counts(e);
+  for (label_count_t* c = counts; c->label; ++c) {
+    counted += c->count;
+  }
+  free(counts);
+  assert_int_equal(counted, lines->len);
+
+  qsort(lines->pdata, lines->len, sizeof(char*), compare_strings);
+  GString* out = g_string_new("");
+  for (guint i = 0; i < lines->len; ++i) {
+    g_string_append_printf(out, "%s\n", (char*)g_ptr_array_index(lines, i));
+    free(g_ptr_array_index(lines, i));
+  }
+  g_ptr_array_free(lines, true);
+
+  e->unset_stream(e);
+  DESTROY((stream_c*)s);
+  e->destroy(e);
+  free(e);
+
+  return g_string_free(out, false);
+}
+
+/**
+ * Runs a table module over a text and returns its sorted occurrences. When
+ * path is set, the module is saved there and the loaded file is run instead.
+ */
+static char* module_occurrences(bool merge, const char** exprs, size_t count,
+  const char* text, const char* path) {
+  regex_module_c* module = regex_module_c_new("dfa_union", NULL);
+  module->backend = REGEX_BACKEND_TABLE;
+  module->merge = merge;
+
+  regex_t** res = malloc(count * sizeof(regex_t*));
+  for (size_t i = 0; i < count; ++i) {
+    res[i] = regex_compile(exprs[i], "union", "UNION");
+    assert_true(module->add_regex(module, res[i]));
+  }
+  assert_true(module->build(module));
+
+  size_t miners_count = (merge ? 1 : count);
+  if (path) {
+    assert_true(module->save(module, path));
+    module->destroy(module);
+    for (size_t i = 0; i < count; ++i) {
+      regex_destroy(res[i]);
+    }
+    module = regex_module_c_from_file("dfa_union", path);
+    assert_non_null(module);
+    count = 0;
+  }
+
+  char* out = run_module(module, miners_count, text);
+
+  module->destroy(module);
+  for (size_t i = 0; i < count; ++i) {
+    regex_destroy(res[i]);
+  }
+  free(res);
+
+  return out;
+}
+
+void union_module(void **state) {
+  const char* exprs[] = {
+    "[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+",
+    "[0-9]{3}[-\\s.]?[0-9]{3}",
+    "[a-zá-ž]+",
+    "a|abc",
+    "^[a-z]+",
+    "[0-9]+$",
+  };
+  const char* text = "abc jan@novák.cz 123 456 žluťoučký abd 777-888 9";
+
+  char* separate = module_occurrences(false, exprs, 6, text, NULL);
+  char* merged = module_occurrences(true, exprs, 6, text, NULL);
+  assert_true(strlen(separate) > 0);
+  assert_string_equal(merged, separate);
+  g_free(separate);
+  g_free(merged);
+}
+
+void caseless(void **state) {
+  check("(?i)kůň", "KŮŇ Kůň kůň koň", "KŮŇ|Kůň|kůň");
+  check("(?i)[a-zá-ž]+", "Příliš ŽLUŤOUČKÝ", "Příliš|ŽLUŤOUČKÝ");
+  check("(?i)[^a-z ]+", "AbC 1Ř", "1Ř");
+  check("(?i)x[0-9]+", "X12 x3", "X12|x3");
+
+  regex_t* re = regex_compile_flags("ab", "flags", "FLAGS", REGEX_CASELESS);
+  regex_t* inline_re = regex_compile("(?i)ab", "inline", "INLINE");
+  assert_true(re->flags & REGEX_CASELESS);
+  assert_true(inline_re->flags & REGEX_CASELESS);
+  assert_int_equal(re->dfa->states_count, inline_re->dfa->states_count);
+  regex_destroy(re);
+  regex_destroy(inline_re);
+
+  // Caseless and case-sensitive symbols stay apart in a union DFA
+  const char* exprs[] = { "abc", "(?i)abc", "Ab" };
+  const char* text = "abc ABC aBc Abd";
+  char* separate = module_occurrences(false, exprs, 3, text, NULL);
+  char* merged = module_occurrences(true, exprs, 3, text, NULL);
+  assert_string_equal(merged, separate);
+  g_free(separate);
+  g_free(merged);
+}
+
+void boundaries(void **state) {
+  check("\\bcat\\b", "cat concat cats cat", "cat|cat");
+  check("\\Bcat", "cat concat", "cat");
+  check("\\b[a-zá-ž]+\\b", "kůň5 úpěl", "úpěl");
+  check("a\\b|ab", "ab a", "ab|a");
+  check("^[a-z]+", "ab\ncd", "ab");
+  check("(?m)^[a-z]+$", "ab\ncd\nx1", "ab|cd");
+  check("(?im)^ab\\b", "AB\nabc\nab", "AB|ab");
+
+  // Assertions are passed at once, a run of them costs no states
+  regex_t* single = regex_compile("\\bcat\\b", "single", "SINGLE");
+  regex_t* repeated = regex_compile("\\b\\bcat\\b\\b", "repeated", "REPEATED");
+  assert_int_equal(repeated->dfa->flags, DFA_WORD_BOUNDARY);
+  assert_int_equal(repeated->dfa->contexts_count, 1);
+  assert_int_equal(repeated->dfa->states_count, single->dfa->states_count);
+  assert_null(dfa_create_unanchored(repeated->dfa));
+  regex_destroy(single);
+  regex_destroy(repeated);
+
+  // Regexes asserting different things share one union
+  const char* exprs[] = {
+    "\\b[a-z]+",
+    "(?m)^[0-9]+$",
+    "[0-9]+$",
+    "x\\B",
+    "[a-z]+\\b",
+  };
+  const char* text = "ab 12\nxy 34\nzx5 67";
+  const char* path = "/tmp/nativeextractor-boundaries.dfa";
+  char* separate = module_occurrences(false, exprs, 5, text, NULL);
+  char* merged = module_occurrences(true, exprs, 5, text, NULL);
+  char* loaded = module_occurrences(true, exprs, 5, text, path);
+  assert_true(strlen(separate) > 0);
+  assert_string_equal(merged, separate);
+  assert_string_equal(loaded, separate);
+  g_free(separate);
+  g_free(merged);
+  g_free(loaded);
+  remove(path);
+}
+
+void scan_mode(void **state) {
+  // Scan mode is used by single DFAs without anchors only
+  regex_t* re = regex_compile("a(b|c)*d", "scan", "SCAN");
+  dfa_miner_c* miner = dfa_miner_c_create(NULL, dfa_copy(re->dfa));
+  assert_non_null(miner->reverse);
+  DESTROY((miner_c*)miner);
+  regex_destroy(re);
+
+  re = regex_compile("^ab", "scan", "SCAN");
+  miner = dfa_miner_c_create(NULL, dfa_copy(re->dfa));
+  assert_null(miner->reverse);
+  DESTROY((miner_c*)miner);
+  regex_destroy(re);
+
+  check("ab|b", "aab xb", "ab|b");
+  check("a+b|a", "aaac aab", "a|a|a|aab");
+  check("xa*b|a*c", "xaaaac xaab", "aaaac|xaab");
+  check("[0-9]+", "ab 12 ččč 345", "12|345");
+  check("k", "žžž", "");
+
+  // Separate miners scan, the merged union DFA runs at every position
+  const char* exprs[] = {
+    "a|abc",
+    "(ab)+",
+    "a[^a]*a",
+    "[ab]+c",
+    "b*cb",
+    "ča",
+    "(a|bc)*d",
+  };
+  GString* text = g_string_new("");
+  uint32_t seed = 7;
+  const char* alphabet[] = { "a", "b", "c", "d", " ", "č" };
+  for (int i = 0; i < 3000; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    g_string_append(text, alphabet[(seed >> 16) % 6]);
+  }
+
+  char* separate = module_occurrences(false, exprs, 7, text->str, NULL);
+  char* merged = module_occurrences(true, exprs, 7, text->str, NULL);
+  assert_true(strlen(separate) > 0);
+  assert_string_equal(merged, separate);
+  g_free(separate);
+  g_free(merged);
+  g_string_free(text, true);
+}
+
+void lazy_dfa(void **state) {
+  // 2^21 states in the powerset, over the budget
+  const char* expr = "(a|b)*a(a|b){20}";
+  regex_t* re = regex_compile(expr, "lazy", "LAZY");
+  assert_true(re->state);
+  assert_non_null(re->dfa->lazy);
+
+  check(expr, "bbbbbabbbbbbbbbbbbbbbbbbbbbbbbb", "bbbbbabbbbbbbbbbbbbbbbbbbb");
+  check(expr, "aaaa", "");
+
+  // A long random text visits more states than the cache holds
+  const size_t length = 20000;
+  char* text = malloc(length + 1);
+  uint32_t seed = 11;
+  size_t last_end = 0;
+  for (size_t i = 0; i < length; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    text[i] = ((seed >> 16) & 1) ? 'a' : 'b';
+    if (text[i] == 'a' && i + 21 <= length) {
+      last_end = i + 21;
+    }
+  }
+  text[length] = '\0';
+
+  dfa_t* dfa = dfa_copy(re->dfa);
+  uint32_t st = dfa->start;
+  size_t accept = 0;
+  for (size_t i = 0; i < length && st != DFA_DEAD; ++i) {
+    st = dfa_next(dfa, st, dfa_class(dfa, &(text[i])));
+    if (dfa_is_accepting(dfa, st)) {
+      accept = i + 1;
+    }
+  }
+  assert_int_equal(accept, last_end);
+  assert_true(dfa_lazy_flushes(dfa) > 0);
+  dfa_destroy(dfa);
+
+  char* found = matches(expr, text);
+  assert_int_equal(strlen(found), last_end);
+  g_free(found);
+  free(text);
+
+  // A lazy union DFA agrees with separate miners
+  const char* exprs[] = { expr, "b+a", "[ab]{3}" };
+  const char* words = "abab bbbbbbbbbbbbbbbbbbbbbbb abaabbbbbbbbbbbbbbbbbbbbba bba";
+  char* separate = module_occurrences(false, exprs, 3, words, NULL);
+  char* merged = module_occurrences(true, exprs, 3, words, NULL);
+  assert_true(strlen(separate) > 0);
+  assert_string_equal(merged, separate);
+  g_free(separate);
+  g_free(merged);
+
+  regex_destroy(re);
+}
+
+/** Writes `set{l,h}` out as copies of the set, as without counting. */
+static char* expanded(const char* prefix, const char* set, int l, int h, const char* suffix) {
+  GString* expr = g_string_new(prefix);
+  for (int i = 0; i < l; ++i) {
+    g_string_append(expr, set);
+  }
+  if (h == -1) {
+    g_string_append_printf(expr, "%s*", set);
+  }
+  for (int i = l; i < h; ++i) {
+    g_string_append_printf(expr, "(%s", set);
+  }
+  for (int i = l; i < h; ++i) {
+    g_string_append(expr, ")?");
+  }
+  g_string_append(expr, suffix);
+  return g_string_free(expr, false);
+}
+
+void counted_repetition(void **state) {
+  // A state per phase of the count instead of one per count
+  regex_t* re = regex_compile("a{1,1000}", "counted", "COUNTED");
+  assert_true(re->state);
+  assert_non_null(re->dfa->counts);
+  assert_true(re->dfa->states_count < 8);
+  regex_destroy(re);
+
+  // Overlapping counts cannot share the counter, the repetition is expanded
+  re = regex_compile("[ab]*[ab]{16}", "overlapping", "OVERLAPPING");
+  assert_true(re->state);
+  assert_null(re->dfa->counts);
+  assert_true(re->dfa->states_count > 16);
+  regex_destroy(re);
+
+  struct {
+    const char* prefix;
+    const char* set;
+    int l;
+    int h;
+    const char* suffix;
+  } cases[] = {
+    { "", "[ab]", 16, 20, "" },
+    { "x", "[a-c]", 1, 40, "y" },
+    { "", "[0-9]", 18, -1, "" },
+    { "", "[a-c]", 0, 17, "c" },
+    { "\\b", "[0-9]", 16, 16, "\\b" },
+    { "(x", "[0-9]", 1, 20, ")+" },
+    { "", "[ab]", 0, 16, "[ab]" },
+    { "(?i)", "[a-c]", 16, 18, "" },
+    { "[ab]*", "[ab]", 16, 16, "" },
+  };
+
+  GString* text = g_string_new("");
+  uint32_t seed = 7;
+  const char* alphabet[] = { "a", "b", "c", "A", "x", "y", "1", "2", " " };
+  for (int i = 0; i < 20000; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    // Long runs of one group of characters reach the bounds
+    int run = (seed >> 24) % 40;
+    const char* c = alphabet[(seed >> 16) % 9];
+    for (int k = 0; k < run; ++k) {
+      seed = seed * 1103515245u + 12345u;
+      g_string_append(text, ((seed >> 16) % 5) ? c : alphabet[(seed >> 20) % 9]);
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    gchar* counted = (cases[i].h == -1)
+      ? g_strdup_printf("%s%s{%d,}%s", cases[i].prefix, cases[i].set, cases[i].l, cases[i].suffix)
+      : g_strdup_printf("%s%s{%d,%d}%s", cases[i].prefix, cases[i].set, cases[i].l, cases[i].h, cases[i].suffix);
+    char* reference = expanded(cases[i].prefix, cases[i].set, cases[i].l, cases[i].h, cases[i].suffix);
+
+    char* found = matches(counted, text->str);
+    char* expected = matches(reference, text->str);
+    assert_true(strlen(expected) > 0);
+    assert_string_equal(found, expected);
+    g_free(found);
+    g_free(expected);
+    g_free(counted);
+    g_free(reference);
+  }
+  g_string_free(text, true);
+}
+
+static size_t shift_and_positions(const char* re_expr) {
+  regex_t* re = regex_compile(re_expr, "positions", "POSITIONS");
+  assert_true(re->state);
+  size_t count = (re->dfa->shift_and ? re->dfa->shift_and->positions_count : 0);
+  regex_destroy(re);
+  return count;
+}
+
+void shift_and(void **state) {
+  // Positions are the characters plus the initial one
+  assert_int_equal(shift_and_positions("[0-9]{4}-[0-9]{2}-[0-9]{2}"), 11);
+  assert_int_equal(shift_and_positions("a|abc"), 5);
+  assert_int_equal(shift_and_positions("(a|b)*a(a|b){20}"), 44);
+  assert_int_equal(shift_and_positions("[0-9]{70}"), 0);
+  assert_int_equal(shift_and_positions("^ab"), 0);
+
+  const char* exprs[] = {
+    "a|abc",
+    "ab*",
+    "x(yz)+",
+    "[0-9]{3}[-\\s.]?[0-9]{3}",
+    "[^@ ]+@[^@ ]+\\.[a-z]+",
+    "[a-zá-ž]+",
+    "\\w+",
+    "(a|b)*a(a|b){5}",
+    "(ab|a)(bc|c)?",
+  };
+  const char* text = "abd abc xyzyzy 123 456 777-888 jan@novák.cz "
+    "příliš žluťoučký kůň bbabbbbb babba abc";
+
+  for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); ++i) {
+    char* table = matches_by(exprs[i], text, false);
+    char* bits = matches_by(exprs[i], text, true);
+    assert_string_equal(bits, table);
+    g_free(table);
+    g_free(bits);
+  }
+}
+
+/** Writes `size` bytes of a DFA file and returns true if it loads. */
+static bool corrupt_file_loads(const char* path, const char* contents, size_t size) {
+  assert_true(g_file_set_contents(path, contents, size, NULL));
+  dfa_file_c* file = dfa_file_c_from_file(path);
+  if (file) {
+    dfa_file_c_destroy(file);
+  }
+  return file != NULL;
+}
+
+void saved_module(void **state) {
+  const char* exprs[] = {
+    "[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+",
+    "[0-9]{3}[-\\s.]?[0-9]{3}",
+    "[a-zá-ž]+",
+    "^ab|cd$",
+    "x[0-9]{1,20}y",
+  };
+  const char* text = "abc jan@novák.cz 123 456 x123y\nžluťoučký abd 777-888 cd";
+  const char* path = "/tmp/nativeextractor-test.dfa";
+
+  for (int merge = 0; merge < 2; ++merge) {
+    char* compiled = module_occurrences(merge, exprs, 5, text, NULL);
+    char* loaded = module_occurrences(merge, exprs, 5, text, path);
+    assert_true(strlen(compiled) > 0);
+    assert_string_equal(loaded, compiled);
+    g_free(compiled);
+    g_free(loaded);
+  }
+
+  // Corrupt files are refused instead of read out of bounds
+  gchar* contents;
+  gsize size;
+  assert_true(g_file_get_contents(path, &contents, &size, NULL));
+  dfa_file_header_t* head = (dfa_file_header_t*)contents;
+  dfa_file_entry_t* entry = (dfa_file_entry_t*)(contents + head->entries_offset);
+  dfa_file_entry_t valid = *entry;
+  uint32_t* transitions = (uint32_t*)(contents + valid.transitions_offset);
+  uint32_t target = transitions[1];
+
+  entry->start = valid.states_count;
+  assert_false(corrupt_file_loads(path, contents, size));
+  *entry = valid;
+  entry->transitions_offset = size - sizeof(uint32_t);
+  assert_false(corrupt_file_loads(path, contents, size));
+  *entry = valid;
+  entry->labels_count = UINT32_MAX;
+  assert_false(corrupt_file_loads(path, contents, size));
+  *entry = valid;
+  transitions[1] = valid.states_count;
+  assert_false(corrupt_file_loads(path, contents, size));
+  transitions[1] = target;
+  contents[size - 1] = 'x';
+  assert_false(corrupt_file_loads(path, contents, size));
+  contents[size - 1] = '\0';
+  head->size = size / 2;
+  assert_false(corrupt_file_loads(path, contents, size / 2));
+  head->size = size;
+  assert_true(corrupt_file_loads(path, contents, size));
+  g_free(contents);
+
+  // Files of other formats and versions are refused
+  FILE* f = fopen(path, "r+b");
+  assert_non_null(f);
+  dfa_file_header_t header;
+  assert_int_equal(fread(&header, sizeof(header), 1, f), 1);
+  header.version = DFA_FILE_VERSION + 1;
+  rewind(f);
+  assert_int_equal(fwrite(&header, sizeof(header), 1, f), 1);
+  fclose(f);
+  assert_null(regex_module_c_from_file("dfa_union", path));
+  assert_null(dfa_file_c_from_file("/nonexistent/nativeextractor.dfa"));
+  remove(path);
+
+  // Lazy DFAs are not saved
+  regex_t* re = regex_compile("(a|b)*a(a|b){20}", "lazy", "LAZY");
+  assert_non_null(re->dfa->lazy);
+  assert_false(dfa_save(path, &(re->dfa), (const char**)&(re->naming),
+    (const char**)&(re->re_expr), 1));
+  regex_destroy(re);
+}
+
+int main(int argc, char *argv[]) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(longest_match),
+    cmocka_unit_test(classes),
+    cmocka_unit_test(unicode),
+    cmocka_unit_test(anchors),
+    cmocka_unit_test(minimal_states),
+    cmocka_unit_test(module),
+    cmocka_unit_test(union_module),
+    cmocka_unit_test(caseless),
+    cmocka_unit_test(boundaries),
+    cmocka_unit_test(scan_mode),
+    cmocka_unit_test(lazy_dfa),
+    cmocka_unit_test(counted_repetition),
+    cmocka_unit_test(shift_and),
+    cmocka_unit_test(saved_module),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
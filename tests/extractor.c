@@ -126,6 +126,205 @@ void mining_with_params(void **state) {
   DESTROY(str);
 }
 
+void statistics(void **state) {
+  extractor_c *te = g_ex;
+  stream_file_c * str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  te->reset_stats(te);
+
+  size_t count = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    occurrence_t **res = te->next(te, 1000);
+    for (occurrence_t **pres = res; *pres; ++pres) {
+      free(*pres);
+      ++count;
+    }
+    free(res);
+  }
+
+  miner_stats_t *stats = te->get_stats(te);
+#ifdef NE_STATS
+  assert_non_null(stats);
+  assert_string_equal(stats[0].name, "Glob");
+  assert_true(stats[0].positions > 0);
+  assert_true(stats[0].bytes > 0);
+  assert_int_equal(stats[0].occurrences, count);
+  assert_int_equal(stats[0].dropped, 0);
+  free(stats);
+#else
+  assert_null(stats);
+#endif
+
+  te->unset_stream(te);
+  DESTROY(str);
+}
+
+void budgets(void **state) {
+  extractor_c *te = g_ex;
+  stream_file_c * str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+
+  size_t count = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    occurrence_t **res = te->next(te, 1000);
+    for (occurrence_t **pres = res; *pres; ++pres) {
+      free(*pres);
+      ++count;
+    }
+    free(res);
+  }
+  assert_true(count > 1);
+
+  // One occurrence per batch, resumed without losses and duplicates
+  DESTROY(str);
+  str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  batch_budget_t budget = { .time_limit_us = 0, .max_occurrences = 1 };
+  size_t budget_count = 0;
+  size_t interrupted = 0;
+  size_t last_pos = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    occurrence_t **res = te->next_budget(te, 1000, &budget);
+    if (te->budget_exhausted) {
+      ++interrupted;
+      assert_int_equal(te->get_progress(te, 0), te->stream->unicode_offset);
+    }
+    for (occurrence_t **pres = res; *pres; ++pres) {
+      assert_true(budget_count == 0 || (*pres)->upos > last_pos);
+      last_pos = (*pres)->upos;
+      free(*pres);
+      ++budget_count;
+    }
+    assert_true(res[0] == NULL || res[1] == NULL);
+    free(res);
+  }
+  assert_int_equal(budget_count, count);
+  assert_true(interrupted > 0);
+
+  // Time budget still finishes the stream
+  DESTROY(str);
+  str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  budget.time_limit_us = 1;
+  budget.max_occurrences = 0;
+  budget_count = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    occurrence_t **res = te->next_budget(te, 1000, &budget);
+    for (occurrence_t **pres = res; *pres; ++pres) {
+      free(*pres);
+      ++budget_count;
+    }
+    free(res);
+  }
+  assert_int_equal(budget_count, count);
+
+  te->unset_stream(te);
+  DESTROY(str);
+}
+
+static size_t count_batch(extractor_c *ex, unsigned batch) {
+  size_t count = 0;
+  occurrence_t **res = ex->next(ex, batch);
+  for (occurrence_t **pres = res; *pres; ++pres) {
+    free(*pres);
+    ++count;
+  }
+  free(res);
+  return count;
+}
+
+void cloned_miners(void **state) {
+  extractor_c *te = g_ex;
+  miner_c **clones = calloc(te->miners_count + 1, sizeof(miner_c *));
+  for (unsigned m = 0; m < te->miners_count; ++m) {
+    clones[m] = te->miners[m]->clone(te->miners[m]);
+    assert_ptr_equal(clones[m]->name, te->miners[m]->name);
+    assert_ptr_equal(clones[m]->params, te->miners[m]->params);
+    assert_ptr_not_equal(clones[m]->stream, te->miners[m]->stream);
+  }
+  extractor_c *ce = extractor_c_new(1, clones);
+
+  stream_file_c *s1 = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  stream_file_c *s2 = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)s1));
+  assert_true(ce->set_stream(ce, (stream_c*)s2));
+
+  // Interleave both extractors over their own streams
+  size_t count1 = 0;
+  size_t count2 = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)
+      || !((ce->stream->state_flags) & STREAM_EOF)) {
+    if (!((te->stream->state_flags) & STREAM_EOF)) {
+      count1 += count_batch(te, 7);
+    }
+    if (!((ce->stream->state_flags) & STREAM_EOF)) {
+      count2 += count_batch(ce, 13);
+    }
+  }
+  assert_true(count1 > 0);
+  assert_int_equal(count1, count2);
+
+  DESTROY(ce);
+  te->unset_stream(te);
+  DESTROY(s1);
+  DESTROY(s2);
+}
+
+void count_modes(void **state) {
+  extractor_c *te = g_ex;
+  stream_file_c * str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  size_t count = 0;
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    count += count_batch(te, 1000);
+  }
+  assert_true(count > 1);
+
+  // Counted, nothing returned
+  assert_false(te->set_flags(te, E_COUNT_ONLY | E_NO_ENCLOSED_OCCURRENCES));
+  assert_true(te->set_flags(te, E_COUNT_ONLY));
+  DESTROY(str);
+  str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  while (!((te->stream->state_flags) & STREAM_EOF)) {
+    assert_int_equal(count_batch(te, 1000), 0);
+  }
+  label_count_t *counts = te->get_counts(te);
+  assert_string_equal(counts[0].label, "Glob");
+  assert_int_equal(counts[0].count, count);
+  assert_null(counts[1].label);
+  free(counts);
+
+  // Mining ends with the first occurrence, the stream is left as it was
+  assert_true(te->set_flags(te, E_FIRST_MATCH));
+  DESTROY(str);
+  str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  count_batch(te, 20);
+  assert_true(te->first_found);
+  assert_false((te->stream->state_flags) & STREAM_EOF);
+  count_batch(te, 20);
+  counts = te->get_counts(te);
+  assert_int_equal(counts[0].count, 1);
+  free(counts);
+
+  assert_true(te->unset_flags(te, E_COUNT_ONLY));
+  DESTROY(str);
+  str = stream_file_c_new("./tests/fixtures/test_glob_patterns.txt");
+  assert_true(te->set_stream(te, (stream_c*)str));
+  assert_int_equal(count_batch(te, 20), 1);
+  assert_true(te->first_found);
+  assert_int_equal(count_batch(te, 20), 0);
+
+  // Without the flag mining goes on
+  assert_true(te->unset_flags(te, E_FIRST_MATCH));
+  assert_true(count_batch(te, 1000) > 0);
+  assert_false(te->first_found);
+
+  te->unset_stream(te);
+  DESTROY(str);
+}
+
 void buffer_mining(void **steak) {
   miner_c **m = malloc(sizeof(miner_c *) * 1);
   m[0] = (miner_c *) NULL;
@@ -199,6 +398,10 @@ int main(int argc, char *argv[]) {
     cmocka_unit_test(null_file),
     //cmocka_unit_test(mining), // Nonfree only
     cmocka_unit_test(mining_with_params),
+    cmocka_unit_test(statistics),
+    cmocka_unit_test(budgets),
+    cmocka_unit_test(cloned_miners),
+    cmocka_unit_test(count_modes),
     //cmocka_unit_test(buffer_mining), // Nonfree only
     //cmocka_unit_test(meta_info) // Nonfree only
   };
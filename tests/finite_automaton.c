@@ -19,6 +19,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <cmocka.h>
+#include <time.h>
 
 #include <nativeextractor/finite_automaton.h>
 
@@ -60,9 +61,229 @@ void wiki() {
   assert_true(true);
 }
 
+/** Runs a DFA over a word of single character symbols. */
+static bool fa_accepts(fa_t *fa, const char *word) {
+  fa_node_t *node = fa_get_node(fa, 0);
+
+  for (; *word; ++word) {
+    fa_edge_t *edge = node->edges;
+    while (edge && !(edge->symbol[0] == *word && edge->symbol[1] == '\0')) {
+      edge = edge->next;
+    }
+    if (!edge) {
+      return false;
+    }
+    node = edge->to;
+  }
+
+  return node->is_final;
+}
+
+/** Fills single character symbols. */
+static void fa_symbols(char symbols[256][2]) {
+  for (int c = 0; c < 256; ++c) {
+    symbols[c][0] = (char)c;
+    symbols[c][1] = '\0';
+  }
+}
+
+/** Creates an alternation of words as a NFA. */
+static fa_t *fa_alternation(const char **words, size_t count, char symbols[256][2]) {
+  fa_t *nfa = fa_create();
+  fa_id_t start = fa_add_node(nfa);
+  fa_get_node(nfa, start)->is_starting = true;
+  for (size_t w = 0; w < count; ++w) {
+    fa_id_t node = fa_add_node(nfa);
+    fa_add_edge(nfa, start, NULL, node);
+    for (const char *c = words[w]; *c; ++c) {
+      fa_id_t next = fa_add_node(nfa);
+      fa_add_edge(nfa, node, symbols[(uint8_t)*c], next);
+      node = next;
+    }
+    fa_get_node(nfa, node)->is_final = true;
+  }
+  return nfa;
+}
+
+void minimize_wiki() {
+  // https://en.wikipedia.org/wiki/DFA_minimization, states a-f
+  fa_t *fa = fa_create();
+  for (int i = 0; i < 6; ++i) {
+    fa_add_node(fa);
+  }
+  fa_get_node(fa, 0)->is_starting = true;
+  fa_get_node(fa, 2)->is_final = true;
+  fa_get_node(fa, 3)->is_final = true;
+  fa_get_node(fa, 4)->is_final = true;
+
+  const size_t delta[6][2] = { {1, 2}, {0, 3}, {4, 5}, {4, 5}, {4, 5}, {5, 5} };
+  for (size_t q = 0; q < 6; ++q) {
+    fa_add_edge(fa, q, "0", delta[q][0]);
+    fa_add_edge(fa, q, "1", delta[q][1]);
+  }
+
+  // {a, b} and {c, d, e}; f cannot accept anymore and is dropped
+  fa_t *minimal = fa_minimize(fa);
+  assert_int_equal(minimal->next_node_id, 2);
+  assert_true(fa_get_node(minimal, 0)->is_starting);
+  assert_false(fa_get_node(minimal, 0)->is_final);
+  assert_true(fa_get_node(minimal, 1)->is_final);
+  assert_true(fa_accepts(minimal, "001000"));
+  assert_false(fa_accepts(minimal, "0011"));
+
+  fa_destroy(fa);
+  fa_destroy(minimal);
+}
+
+void minimize_suffixes() {
+  const char *months[] = {
+    "january", "february", "march", "april", "may", "june", "july",
+    "august", "september", "october", "november", "december"
+  };
+  char symbols[256][2];
+  fa_symbols(symbols);
+
+  fa_t *nfa = fa_alternation(months, 12, symbols);
+
+  fa_t *dfa = fa_create_powerset(nfa);
+  fa_t *minimal = fa_minimize(dfa);
+
+  // Common suffixes (-ember, -uary, ...) are shared by the minimal DFA
+  assert_int_equal(dfa->next_node_id, 69);
+  assert_int_equal(minimal->next_node_id, 40);
+
+  for (size_t w = 0; w < 12; ++w) {
+    assert_true(fa_accepts(dfa, months[w]));
+    assert_true(fa_accepts(minimal, months[w]));
+  }
+  assert_false(fa_accepts(minimal, "janember"));
+  assert_false(fa_accepts(minimal, "decuary"));
+  assert_false(fa_accepts(minimal, "jun"));
+
+  fa_destroy(nfa);
+  fa_destroy(dfa);
+  fa_destroy(minimal);
+}
+
+void frozen_suffixes() {
+  const char *months[] = {
+    "january", "february", "march", "april", "may", "june", "july",
+    "august", "september", "october", "november", "december"
+  };
+  char symbols[256][2];
+  fa_symbols(symbols);
+
+  fa_t *nfa = fa_alternation(months, 12, symbols);
+  fa_frozen_t *frozen = fa_freeze(nfa);
+
+  // Equal symbols share an id, epsilon edges go last
+  assert_int_equal(frozen->nodes_count, nfa->next_node_id);
+  assert_int_equal(frozen->edges_count, nfa->next_edge_id);
+  assert_int_equal(frozen->symbols_count, 21);
+  for (fa_id_t q = 0; q < frozen->nodes_count; ++q) {
+    for (size_t e = frozen->offsets[q] + 1; e < frozen->offsets[q + 1]; ++e) {
+      assert_true(frozen->edge_symbols[e - 1] <= frozen->edge_symbols[e]);
+    }
+  }
+  assert_int_equal(frozen->edge_symbols[frozen->offsets[0]], FA_EPSILON);
+
+  fa_frozen_t *dfa = fa_frozen_powerset(frozen, SIZE_MAX);
+  fa_frozen_t *minimal = fa_frozen_minimize(dfa);
+  assert_int_equal(dfa->nodes_count, 69);
+  assert_int_equal(minimal->nodes_count, 40);
+  assert_null(fa_frozen_powerset(frozen, 68));
+
+  fa_t *thawed = fa_thaw(minimal);
+  for (size_t w = 0; w < 12; ++w) {
+    assert_true(fa_accepts(thawed, months[w]));
+  }
+  assert_false(fa_accepts(thawed, "janember"));
+
+  fa_destroy(nfa);
+  fa_destroy(thawed);
+  fa_frozen_destroy(frozen);
+  fa_frozen_destroy(dfa);
+  fa_frozen_destroy(minimal);
+}
+
+static double elapsed_ms(struct timespec *from) {
+  struct timespec to;
+  clock_gettime(CLOCK_MONOTONIC, &to);
+  double ms = (to.tv_sec - from->tv_sec) * 1e3 + (to.tv_nsec - from->tv_nsec) / 1e6;
+  *from = to;
+  return ms;
+}
+
+void powerset_alternation() {
+  // Benchmark: 10k pseudo-random keywords, e.g. a list of names
+  const size_t count = 10000;
+  char **words = malloc(count * sizeof(char *));
+  uint32_t seed = 42;
+  for (size_t w = 0; w < count; ++w) {
+    size_t length = 4 + w % 7;
+    words[w] = malloc(length + 1);
+    for (size_t i = 0; i < length; ++i) {
+      seed = seed * 1103515245 + 12345;
+      words[w][i] = 'a' + (seed >> 16) % 26;
+    }
+    words[w][length] = '\0';
+  }
+  char symbols[256][2];
+  fa_symbols(symbols);
+
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  fa_t *nfa = fa_alternation((const char **)words, count, symbols);
+  double nfa_ms = elapsed_ms(&time);
+  fa_t *dfa = fa_create_powerset(nfa);
+  double powerset_ms = elapsed_ms(&time);
+  fa_t *minimal = fa_minimize(dfa);
+  double minimize_ms = elapsed_ms(&time);
+
+  printf("%zu words: NFA %zu nodes %.1f ms, powerset %zu nodes %.1f ms, "
+    "minimal %zu nodes %.1f ms\n", count, nfa->next_node_id, nfa_ms,
+    dfa->next_node_id, powerset_ms, minimal->next_node_id, minimize_ms);
+
+  // Without converting between the forms, as dfa_create_union does
+  fa_frozen_t *frozen = fa_freeze(nfa);
+  double freeze_ms = elapsed_ms(&time);
+  fa_frozen_t *frozen_dfa = fa_frozen_powerset(frozen, SIZE_MAX);
+  double frozen_powerset_ms = elapsed_ms(&time);
+  fa_frozen_t *frozen_minimal = fa_frozen_minimize(frozen_dfa);
+  double frozen_minimize_ms = elapsed_ms(&time);
+  printf("frozen: freeze %.1f ms, powerset %.1f ms, minimal %.1f ms\n",
+    freeze_ms, frozen_powerset_ms, frozen_minimize_ms);
+  assert_int_equal(frozen_minimal->nodes_count, minimal->next_node_id);
+  fa_frozen_destroy(frozen);
+  fa_frozen_destroy(frozen_dfa);
+  fa_frozen_destroy(frozen_minimal);
+
+  // The powerset of an alternation of words is their trie
+  assert_true(dfa->next_node_id < nfa->next_node_id);
+  assert_true(minimal->next_node_id <= dfa->next_node_id);
+  for (size_t w = 0; w < count; ++w) {
+    assert_true(fa_accepts(dfa, words[w]));
+    assert_true(fa_accepts(minimal, words[w]));
+  }
+  assert_false(fa_accepts(minimal, "abc"));
+  assert_false(fa_accepts(minimal, ""));
+
+  for (size_t w = 0; w < count; ++w) {
+    free(words[w]);
+  }
+  free(words);
+  fa_destroy(nfa);
+  fa_destroy(dfa);
+  fa_destroy(minimal);
+}
+
 int main(int argc, const char *argv) {
   const struct CMUnitTest tests[] = {
-    cmocka_unit_test(wiki)
+    cmocka_unit_test(wiki),
+    cmocka_unit_test(minimize_wiki),
+    cmocka_unit_test(minimize_suffixes),
+    cmocka_unit_test(frozen_suffixes),
+    cmocka_unit_test(powerset_alternation)
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
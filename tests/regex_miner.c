@@ -19,6 +19,8 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cmocka.h>
 
 #include <nativeextractor/extractor.h>
@@ -98,6 +100,337 @@ void cleanup() {
   free(g_e);
 }
 
+/** Builds a single-regex module in the cache directory and returns its inode. */
+static ino_t build_cached(char * cache_path, size_t cache_size, const char * re_expr, char ** so_path) {
+  regex_t * re = regex_compile(re_expr, "cached", "CACHED");
+  assert_true( re->state );
+
+  regex_module_c * module = regex_module_c_new("cached", NULL);
+  free(module->cache_path);
+  module->cache_path = g_strdup(cache_path);
+  module->cache_size = cache_size;
+  module->add_regex(module, re);
+  assert_true( module->build(module) );
+
+  struct stat st;
+  assert_int_equal( stat(module->so_path, &st), 0 );
+  *so_path = g_strdup(module->so_path);
+
+  module->destroy(module);
+  regex_destroy(re);
+  return st.st_ino;
+}
+
+void cached_build() {
+  char cache_path[] = "/tmp/ne_regex_cache_XXXXXX";
+  assert_non_null( mkdtemp(cache_path) );
+
+  char * first;
+  char * again;
+  char * other;
+  ino_t ino = build_cached(cache_path, REGEX_CACHE_SIZE, "a+b", &first);
+  assert_true( g_str_has_prefix(first, cache_path) );
+
+  // Same code is not compiled again
+  assert_int_equal( build_cached(cache_path, REGEX_CACHE_SIZE, "a+b", &again), ino );
+  assert_string_equal( first, again );
+  free(again);
+
+  // A library others can write to is not trusted and gets rebuilt
+  assert_int_equal( chmod(first, 0777), 0 );
+  assert_int_not_equal( build_cached(cache_path, REGEX_CACHE_SIZE, "a+b", &again), ino );
+  assert_string_equal( first, again );
+  free(again);
+
+  // Nor is a directory others can write to
+  assert_int_equal( chmod(cache_path, 0777), 0 );
+  build_cached(cache_path, REGEX_CACHE_SIZE, "a+b", &again);
+  assert_false( g_str_has_prefix(again, cache_path) );
+  unlink(again);
+  free(again);
+  assert_int_equal( chmod(cache_path, 0700), 0 );
+  build_cached(cache_path, REGEX_CACHE_SIZE, "a+b", &again);
+
+  // Other code gets its own entry, the older one is evicted over the limit
+  build_cached(cache_path, 1, "c+d", &other);
+  assert_string_not_equal( first, other );
+  assert_int_equal( access(other, R_OK), 0 );
+  assert_int_not_equal( access(first, R_OK), 0 );
+
+  unlink(other);
+  rmdir(cache_path);
+  free(first);
+  free(again);
+  free(other);
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/** Translation units of modules built by backend_occurrences, 0 for the default. */
+static int build_jobs = 0;
+
+/** Runs regexes by a backend over a text and returns sorted occurrences. */
+static char * backend_occurrences(int backend, const char ** exprs, size_t count, const char * text) {
+  regex_module_c * module = regex_module_c_new("backends", NULL);
+  module->backend = backend;
+  if (build_jobs) {
+    // Always run the compiler
+    module->build_jobs = build_jobs;
+    free(module->cache_path);
+    module->cache_path = NULL;
+  }
+
+  regex_t ** res = malloc(count * sizeof(regex_t*));
+  for (size_t i = 0; i < count; ++i) {
+    gchar * naming = g_strdup_printf("backend_%zu", i);
+    res[i] = regex_compile(exprs[i], naming, "BACKEND");
+    assert_true( res[i]->state );
+    module->add_regex(module, res[i]);
+    free(naming);
+  }
+  assert_true( module->build(module) );
+
+  miner_c ** miners = calloc(1, sizeof(miner_c*));
+  extractor_c * e = extractor_c_new(1, miners);
+  assert_true( module->load(module, e) );
+
+  stream_buffer_c * s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  e->set_stream(e, (stream_c*)s);
+
+  GPtrArray * lines = g_ptr_array_new();
+  while (!(e->stream->state_flags & STREAM_EOF)) {
+    occurrence_t ** res = e->next(e, 100000);
+    for (occurrence_t ** pres = res; *pres; ++pres) {
+      g_ptr_array_add(lines, g_strdup_printf("%s@%lu+%u", (*pres)->label,
+        (unsigned long)(*pres)->pos, (*pres)->len));
+      free(*pres);
+    }
+    free(res);
+  }
+
+  qsort(lines->pdata, lines->len, sizeof(char*), compare_strings);
+  GString * out = g_string_new("");
+  for (guint i = 0; i < lines->len; ++i) {
+    g_string_append_printf(out, "%s\n", (char*)lines->pdata[i]);
+    free(lines->pdata[i]);
+  }
+  g_ptr_array_free(lines, true);
+
+  e->unset_stream(e);
+  DESTROY((stream_c*)s);
+  e->destroy(e);
+  free(e);
+  module->destroy(module);
+  for (size_t i = 0; i < count; ++i) {
+    regex_destroy(res[i]);
+  }
+  free(res);
+
+  return g_string_free(out, false);
+}
+
+void backends_agree() {
+  const char * exprs[] = {
+    "a|abc",
+    "x(yz)+",
+    "[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+",
+    "[a-zá-ž]+",
+    "^[a-z]+",
+    "[0-9]+$",
+    "\\s\\w.",
+    "https?://[a-z.]+",
+    "IBAN ?[0-9]{2}",
+    "[0-9]+ Kč",
+    "(?i)iban ?[0-9]{2}",
+    "(?i)žluťoučký kůň",
+    "\\b[0-9]{2,8}\\b",
+    "(?m)^[a-z]+",
+    "\\Bzy",
+  };
+  const char * text = "abc abd xyzyzy jan@novák.cz žluťoučký kůň 123 45 "
+    "http://a.cz IBAN12 IBAN 3 45 Kč\niban 77 ŽLUŤOUČKÝ Kůň";
+
+  char * table = backend_occurrences(REGEX_BACKEND_TABLE, exprs, 15, text);
+  char * so = backend_occurrences(REGEX_BACKEND_SO, exprs, 15, text);
+  char * shift_and = backend_occurrences(REGEX_BACKEND_SHIFT_AND, exprs, 15, text);
+  assert_true( strstr(so, "a|abc@0+3\n") != NULL );
+  assert_true( strstr(so, "(?i)žluťoučký kůň@") != NULL );
+  assert_true( strstr(so, "(?m)^[a-z]+@89+4\n") != NULL );
+  assert_string_equal( so, table );
+  assert_string_equal( shift_and, table );
+  free(table);
+  free(so);
+  free(shift_and);
+}
+
+void lazy_fallback() {
+  // Over the state budget, the .so module runs the lazy DFA as a table
+  const char * exprs[] = {
+    "(a|b)*a(a|b){20}",
+    "[0-9]+",
+  };
+  const char * text = "12 bbbbbabbbbbbbbbbbbbbbbbbbbbbbbb 7";
+
+  regex_t * re = regex_compile(exprs[0], "lazy", "LAZY");
+  assert_true( re->state );
+  assert_non_null( re->dfa->lazy );
+  assert_null( re->code );
+  regex_destroy(re);
+
+  char * table = backend_occurrences(REGEX_BACKEND_TABLE, exprs, 2, text);
+  char * so = backend_occurrences(REGEX_BACKEND_SO, exprs, 2, text);
+  assert_true( strstr(so, "@3+26\n") != NULL );
+  assert_string_equal( so, table );
+  free(table);
+  free(so);
+}
+
+/** Compiles a regex and checks its required literal. */
+static void assert_literal(const char * re_expr, const char * literal, size_t offset) {
+  regex_t * re = regex_compile(re_expr, "literal", "LITERAL");
+  assert_true( re->state );
+  if (literal) {
+    assert_non_null( re->literal );
+    assert_string_equal( re->literal->str, literal );
+    assert_int_equal( re->literal_offset, offset );
+  } else {
+    assert_null( re->literal );
+  }
+  regex_destroy(re);
+}
+
+void required_literal() {
+  assert_literal("https?://[a-z.]+", "http", 0);
+  assert_literal("[a-z]+://[a-z.]+", "://", SIZE_MAX);
+  assert_literal("[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+", "@", SIZE_MAX);
+  assert_literal("IBAN ?[0-9]{2}", "IBAN", 0);
+  assert_literal("[0-9]+ Kč", " Kč", SIZE_MAX);
+  assert_literal("[0-9]{2,3}-x{2}y", "-xxy", 3);
+  assert_literal("(ab|cd)ž", "ž", 2);
+  assert_literal("(abc)+d", "abc", 0);
+  assert_literal("[a-z]*", NULL, 0);
+  assert_literal("a|b", NULL, 0);
+  // Caseless letters are sets, the literal is what the case cannot change
+  assert_literal("(?i)iban ?[0-9]{2}", NULL, 0);
+  assert_literal("(?i)[a-z]+ 2021", " 2021", SIZE_MAX);
+}
+
+void deep_input() {
+  // Generated code loops instead of recursing per character
+  size_t size = 1 << 22;
+  char * text = malloc(size + 1);
+  memset(text, 'a', size);
+  text[size] = '\0';
+
+  const char * exprs[] = { "a+" };
+  char * so = backend_occurrences(REGEX_BACKEND_SO, exprs, 1, text);
+  gchar * expected = g_strdup_printf("a+@0+%zu\n", size);
+  assert_string_equal( so, expected );
+  free(expected);
+  free(so);
+  free(text);
+}
+
+void counted_repetition() {
+  // Generated code keeps repeated states in a counter
+  const char * exprs[] = {
+    "[0-9]{1,20}",
+    "[a-c0-9]{2,9}",
+    "a{5}",
+    "b{6,}",
+    "(ab|c){2,7}",
+    "x[a-c]{1,6}b",
+    "[a-c]{3,8}[0-9]{2,5}",
+    "^[a-c]{4,6}",
+    "c{2,9}$",
+    "[a-c]+@[a-c]{2,6}\\.[a-c]{2,3}",
+    "x[a-c12]{2,30}b",
+    "[ab]{16,}",
+    "\\b[a-c]{16,18}\\b",
+  };
+  size_t count = sizeof(exprs) / sizeof(exprs[0]);
+
+  GString * text = g_string_new("");
+  uint32_t seed = 11;
+  const char * alphabet[] = { "a", "b", "c", "x", "1", "2", " ", "@", "." };
+  for (int i = 0; i < 20000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    g_string_append(text, alphabet[(seed >> 16) % 9]);
+  }
+
+  char * table = backend_occurrences(REGEX_BACKEND_TABLE, exprs, count, text->str);
+  char * so = backend_occurrences(REGEX_BACKEND_SO, exprs, count, text->str);
+  assert_true( strlen(so) > 0 );
+  assert_string_equal( so, table );
+  free(table);
+  free(so);
+  g_string_free(text, true);
+
+  // Neither the table nor the code grows with the count
+  regex_t * small = regex_compile("x[a-z]{1,5}y", "small", "SMALL");
+  regex_t * large = regex_compile("x[a-z]{1,500}y", "large", "LARGE");
+  assert_non_null( large->dfa->counts );
+  assert_true( large->dfa->states_count < 16 );
+  assert_true( strlen(large->code) < strlen(small->code) + 256 );
+  regex_destroy(small);
+  regex_destroy(large);
+}
+
+void parallel_build() {
+  const char * exprs[] = {
+    "[a-zá-ž]+",
+    "[0-9]{3}[-\\s.]?[0-9]{3}",
+    "[^@ \\t\\r\\n]+@[^@ \\t\\r\\n]+\\.[^@ \\t\\r\\n]+",
+    "https?://[a-z.]+",
+    "x[a-c]{1,6}b",
+  };
+  const char * text = "jan@novák.cz 123 456 http://a.cz xabcb žluťoučký 777-888";
+
+  char * table = backend_occurrences(REGEX_BACKEND_TABLE, exprs, 5, text);
+  build_jobs = 3;
+  char * so = backend_occurrences(REGEX_BACKEND_SO, exprs, 5, text);
+  build_jobs = 0;
+  assert_true( strlen(so) > 0 );
+  assert_string_equal( so, table );
+  free(table);
+  free(so);
+}
+
+void module_timing() {
+  // Many regexes are assembled into one module source
+  const size_t count = 100;
+  regex_t * res[count];
+  regex_module_c * module = regex_module_c_new("timed", NULL);
+  free(module->cache_path);
+  module->cache_path = NULL;
+
+  for (size_t i = 0; i < count; ++i) {
+    gchar * re_expr = g_strdup_printf("k%zux+", i);
+    gchar * naming = g_strdup_printf("timed_%zu", i);
+    res[i] = regex_compile(re_expr, naming, "TIMED");
+    assert_true( res[i]->state );
+    assert_true( res[i]->timing.dfa > 0 );
+    assert_true( res[i]->timing.codegen > 0 );
+    assert_true( module->add_regex(module, res[i]) );
+    free(re_expr);
+    free(naming);
+  }
+
+  assert_true( module->build(module) );
+  assert_non_null( strstr(module->code, "  \"timed_99\", \"k99x+\",\n  NULL\n};\n") );
+  assert_true( module->timing.dfa >= res[0]->timing.dfa );
+  assert_true( module->timing.cc > 0 );
+  regex_timing_print(&(module->timing), stdout);
+
+  unlink(module->so_path);
+  module->destroy(module);
+  for (size_t i = 0; i < count; ++i) {
+    regex_destroy(res[i]);
+  }
+}
+
 int main(int argc, char **argv)
 {
   const struct CMUnitTest tests[] = {
@@ -106,7 +439,15 @@ int main(int argc, char **argv)
     cmocka_unit_test(load_module),
     cmocka_unit_test(load_module),
     cmocka_unit_test(extract),
-    cmocka_unit_test(cleanup)
+    cmocka_unit_test(cleanup),
+    cmocka_unit_test(cached_build),
+    cmocka_unit_test(backends_agree),
+    cmocka_unit_test(lazy_fallback),
+    cmocka_unit_test(required_literal),
+    cmocka_unit_test(deep_input),
+    cmocka_unit_test(counted_repetition),
+    cmocka_unit_test(parallel_build),
+    cmocka_unit_test(module_timing)
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
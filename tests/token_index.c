@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2021 SpongeData s.r.o.
+ *
+ * NativeExtractor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NativeExtractor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with NativeExtractor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <nativeextractor/miner.h>
+#include <nativeextractor/stream.h>
+#include <nativeextractor/token_index.h>
+#include <nativeextractor/unicode.h>
+
+static const char* text =
+  "Příliš žluťoučký kůň úpěl ďábelské ódy, "
+  "quick brown fox jumps over the lazy dog (1234567890) <a@b.cz>\t\n"
+  "—dlouhá pomlčka— a nezlomitelná mezera; \x7f konec";
+
+/** Compares the index with is_delimiter at every character of the range. */
+static void check_range(stream_c* stream, const char* start, const char* end) {
+  token_index_t index = { 0 };
+  token_index_t_build(&index, stream, start, end);
+
+  bool previous = true;
+  if (start > stream->start) {
+    const char* p = start - 1;
+    while (((uint8_t)*p & 0xC0) == 0x80) { --p; }
+    previous = is_delimiter((char*)p);
+  }
+
+  for (const char* p = start; p < end; p += unicode_getbytesize((char*)p)) {
+    assert_true(token_index_t_covers(&index, p));
+    bool delimiter = is_delimiter((char*)p);
+    assert_int_equal(token_index_t_is_delimiter(&index, p), delimiter);
+    assert_int_equal(token_index_t_is_start(&index, p), !delimiter && previous);
+    assert_int_equal(token_index_t_is_inside(&index, p), !delimiter && !previous);
+    previous = delimiter;
+  }
+  assert_false(token_index_t_covers(&index, end));
+
+  token_index_t_clear(&index);
+}
+
+void whole_stream(void **state) {
+  stream_buffer_c *s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  check_range((stream_c*)s, s->stream.start, s->stream.end);
+  DESTROY((stream_c*)s);
+}
+
+void partial_ranges(void **state) {
+  stream_buffer_c *s = stream_buffer_c_new((const uint8_t*)text, strlen(text));
+  stream_c *stream = (stream_c*)s;
+
+  // Every character boundary as a start, so SIMD blocks get misaligned
+  for (char* start = stream->start; start < stream->end;
+      start += unicode_getbytesize(start)) {
+    check_range(stream, start, stream->end);
+    check_range(stream, start, MIN(stream->end, start + 17));
+  }
+  DESTROY((stream_c*)s);
+}
+
+int main(int argc, char *argv[]) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(whole_stream),
+    cmocka_unit_test(partial_ranges),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}